@@ -0,0 +1,139 @@
+// бенчмарк Document: разбор JSON, байты на документ и задержка getField
+// сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -Idb bench/document_bench.cpp db/document.cpp db/field_dictionary.cpp db/value_dictionary.cpp db/utills.cpp -o document_bench -pthread
+// запуск: ./document_bench <файл коллекции .json> [число вызовов getField]
+// файл - коллекция базы (массив, по документу в строке), например data/<db>/<db>.json
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <malloc.h>
+#include "document.h"
+
+using namespace std;
+
+static double elapsed_ns(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+static size_t heap_used()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        cerr << "usage: " << argv[0] << " <collection.json> [getField calls]" << endl;
+        return 1;
+    }
+    size_t calls = argc > 2 ? strtoull(argv[2], nullptr, 10) : 10000000;
+
+    ifstream in(argv[1]);
+    if (!in)
+    {
+        cerr << "ERROR: не удалось открыть " << argv[1] << endl;
+        return 1;
+    }
+    vector<string> lines;
+    size_t json_bytes = 0;
+    string line;
+    while (getline(in, line))
+    {
+        if (line == "[" || line == "]" || line.empty())
+            continue;
+        if (line.back() == ',')
+            line.pop_back();
+        json_bytes += line.size();
+        lines.push_back(move(line));
+    }
+    if (lines.empty())
+    {
+        cerr << "ERROR: в файле нет документов" << endl;
+        return 1;
+    }
+
+    FieldDictionary dict;
+    vector<Document *> docs;
+    docs.reserve(lines.size());
+
+    size_t heap_before = heap_used();
+    auto t = chrono::steady_clock::now();
+    for (const string &json : lines)
+    {
+        Document *doc = Document::deserialize(json, dict);
+        if (doc)
+            docs.push_back(doc);
+    }
+    double parse_ns = elapsed_ns(t);
+    // прирост кучи включает словари имён и значений
+    size_t heap_after = heap_used();
+
+    size_t n = docs.size();
+    size_t own_bytes = 0;
+    for (const Document *doc : docs)
+        own_bytes += doc->memoryBytes();
+
+    cout << n << " документов, " << dict.size() << " полей" << endl;
+    cout << fixed << setprecision(1);
+    cout << "  JSON             " << setw(10) << (double)json_bytes / n << " байт/документ" << endl;
+    cout << "  memoryBytes      " << setw(10) << (double)own_bytes / n << " байт/документ" << endl;
+    cout << "  прирост кучи     " << setw(10) << (double)(heap_after - heap_before) / n << " байт/документ" << endl;
+    cout << "  deserialize      " << setw(10) << parse_ns / n << " ns/документ" << endl;
+
+    // случайные пары (документ, поле); имена берём из самих документов
+    mt19937_64 rng(42);
+    const size_t PAIRS = 1 << 16;
+    vector<pair<const Document *, uint32_t>> pairs;
+    vector<string> names;
+    pairs.reserve(PAIRS);
+    names.reserve(PAIRS);
+    while (pairs.size() < PAIRS)
+    {
+        const Document *doc = docs[rng() % n];
+        if (doc->fieldCount() == 0)
+            continue;
+        size_t index = rng() % doc->fieldCount();
+        pairs.emplace_back(doc, doc->fieldId(index));
+        names.push_back(doc->fieldKey(index, dict));
+    }
+
+    size_t checksum = 0;
+    t = chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; i++)
+    {
+        const auto &p = pairs[i & (PAIRS - 1)];
+        string_view value;
+        if (p.first->getField(p.second, value, dict))
+            checksum += value.size();
+    }
+    cout << "  getField (номер) " << setw(10) << elapsed_ns(t) / calls << " ns/вызов" << endl;
+
+    t = chrono::steady_clock::now();
+    string value;
+    for (size_t i = 0; i < calls; i++)
+    {
+        size_t k = i & (PAIRS - 1);
+        if (pairs[k].first->getField(names[k], value, dict))
+            checksum += value.size();
+    }
+    cout << "  getField (имя)   " << setw(10) << elapsed_ns(t) / calls << " ns/вызов" << endl;
+    // не даём компилятору выбросить циклы
+    cout << "  checksum " << checksum << endl;
+
+    for (Document *doc : docs)
+    {
+        doc->releaseValues(dict);
+        delete doc;
+    }
+    return 0;
+}
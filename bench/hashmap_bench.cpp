@@ -0,0 +1,138 @@
+// микробенчмарк CustomHashMap: вставка, поиск, обход и удаление на 1M-10M ключей
+// сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -Idb bench/hashmap_bench.cpp db/custom_hashmap.cpp db/document.cpp db/field_dictionary.cpp db/value_dictionary.cpp db/utills.cpp -o hashmap_bench -pthread
+// запуск: ./hashmap_bench [число ключей ...]   (по умолчанию 1000000 4000000 10000000)
+// ключи - десятичные _id в случайном порядке, как у документов базы;
+// для сравнения те же операции гоняются на std::unordered_map
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include "custom_hashmap.h"
+
+using namespace std;
+
+static double elapsed_ns(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const string &name, size_t n, double ns)
+{
+    cout << "  " << left << setw(28) << name << right << setw(10) << fixed << setprecision(1)
+         << ns / n << " ns/op" << setw(10) << setprecision(0) << ns / 1e6 << " ms" << endl;
+}
+
+static void bench(size_t n)
+{
+    vector<string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        keys.push_back(to_string(i));
+    mt19937_64 rng(42);
+    shuffle(keys.begin(), keys.end(), rng);
+
+    // поиск идёт в другом случайном порядке, чем вставка
+    vector<size_t> probe(n);
+    for (size_t i = 0; i < n; i++)
+        probe[i] = i;
+    shuffle(probe.begin(), probe.end(), rng);
+
+    // значения не владеют памятью: все ключи удаляются до деструктора карты
+    Document dummy;
+    Document *value = &dummy;
+    size_t checksum = 0;
+
+    cout << n << " ключей" << endl;
+    {
+        CustomHashMap map;
+
+        auto t = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+            map.put(keys[i], value, false);
+        report("CustomHashMap put", n, elapsed_ns(t));
+
+        t = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+            checksum += map.get(keys[probe[i]]) == value;
+        report("CustomHashMap get (hit)", n, elapsed_ns(t));
+
+        t = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+            checksum += map.get(keys[probe[i]] + "x") != nullptr;
+        report("CustomHashMap get (miss)", n, elapsed_ns(t));
+
+        t = chrono::steady_clock::now();
+        size_t seen = 0;
+        for (size_t i = 0; i < map.getCapacity(); i++)
+        {
+            const HashSlot *slot = map.getSlot(i);
+            if (slot)
+            {
+                seen++;
+                checksum += slot->key.size();
+            }
+        }
+        report("CustomHashMap iterate", n, elapsed_ns(t));
+        if (seen != n)
+            cerr << "ERROR: обход нашёл " << seen << " ключей из " << n << endl;
+
+        t = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+            checksum += map.remove(keys[probe[i]]) == value;
+        report("CustomHashMap remove", n, elapsed_ns(t));
+    }
+    {
+        unordered_map<string, Document *> map;
+
+        auto t = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+            map[keys[i]] = value;
+        report("unordered_map insert", n, elapsed_ns(t));
+
+        t = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            auto it = map.find(keys[probe[i]]);
+            checksum += it != map.end() && it->second == value;
+        }
+        report("unordered_map find (hit)", n, elapsed_ns(t));
+
+        t = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+            checksum += map.find(keys[probe[i]] + "x") != map.end();
+        report("unordered_map find (miss)", n, elapsed_ns(t));
+
+        t = chrono::steady_clock::now();
+        for (const auto &kv : map)
+            checksum += kv.first.size();
+        report("unordered_map iterate", n, elapsed_ns(t));
+
+        t = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+            checksum += map.erase(keys[probe[i]]);
+        report("unordered_map erase", n, elapsed_ns(t));
+    }
+    // не даём компилятору выбросить циклы
+    cout << "  checksum " << checksum << endl;
+}
+
+int main(int argc, char **argv)
+{
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; i++)
+        sizes.push_back(strtoull(argv[i], nullptr, 10));
+    if (sizes.empty())
+        sizes = {1000000, 4000000, 10000000};
+
+    for (size_t n : sizes)
+        if (n > 0)
+            bench(n);
+    return 0;
+}
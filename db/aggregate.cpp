@@ -0,0 +1,1333 @@
+#include "aggregate.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "cursor.h"
+#include "ordered_index.h"
+#include "query.h"
+#include "utills.h"
+
+using namespace std;
+
+const size_t Aggregation::MAX_GROUPS;
+const uint32_t Aggregation::ID_FIELD;
+
+Aggregation::Aggregation(const FieldDictionary &dict) : dict(dict) {}
+
+uint32_t Aggregation::resolve(const string &name) const
+{
+    return name == "_id" ? ID_FIELD : dict.lookup(name);
+}
+
+bool Aggregation::value_of(const Document *doc, uint32_t field_id, string_view &out) const
+{
+    if (field_id == ID_FIELD)
+    {
+        out = doc->_id;
+        return true;
+    }
+    return field_id != FieldDictionary::NO_FIELD && doc->getField(field_id, out, dict);
+}
+
+// groupBy: "поле" или ["поле", ...]
+static bool parse_group_by(const string &raw, vector<string> &names, string &error)
+{
+    string value = trim(raw);
+    if (!value.empty() && value.front() == '[')
+    {
+        if (!splitJsonArray(value, names))
+        {
+            error = "groupBy must be a field name or an array of names";
+            return false;
+        }
+    }
+    else
+    {
+        names.assign(1, unquoteJsonValue(value));
+    }
+    for (const string &name : names)
+    {
+        if (name.empty())
+        {
+            error = "groupBy field name is empty";
+            return false;
+        }
+    }
+    return true;
+}
+
+// накопитель из fields до перевода имени поля в номер
+struct AccumulatorSpec
+{
+    string name;
+    Aggregation::Op op;
+    string field; // у $count пусто
+};
+
+// fields: {"имя": {"$count": 1} | {"$min": "поле"} | ...}
+static bool parse_accumulators(const string &raw, vector<AccumulatorSpec> &out, string &error)
+{
+    vector<pair<string, string>> outputs;
+    if (!splitJsonObject(raw, outputs))
+    {
+        error = "fields must be an object {\"name\": {\"$count\": 1}}";
+        return false;
+    }
+    for (const auto &output : outputs)
+    {
+        vector<pair<string, string>> op;
+        if (!splitJsonObject(output.second, op) || op.size() != 1)
+        {
+            error = "Accumulator " + output.first + " must be {\"$op\": field}";
+            return false;
+        }
+        AccumulatorSpec acc;
+        acc.name = output.first;
+        const string &name = op[0].first;
+        if (name == "$count")
+            acc.op = Aggregation::Op::Count;
+        else if (name == "$min")
+            acc.op = Aggregation::Op::Min;
+        else if (name == "$max")
+            acc.op = Aggregation::Op::Max;
+        else if (name == "$sum")
+            acc.op = Aggregation::Op::Sum;
+        else
+        {
+            error = "Unknown accumulator: " + name + " (use $count, $min, $max, $sum)";
+            return false;
+        }
+        if (acc.op != Aggregation::Op::Count)
+            acc.field = unquoteJsonValue(op[0].second);
+        out.push_back(acc);
+    }
+    return true;
+}
+
+bool Aggregation::parse(const string &spec_json, string &error)
+{
+    string spec = trim(spec_json);
+    vector<pair<string, string>> fields;
+    if (!spec.empty() && spec != "[]" && !splitJsonObject(spec, fields))
+    {
+        error = "Invalid aggregate JSON";
+        return false;
+    }
+
+    for (const auto &field : fields)
+    {
+        if (field.first == "groupBy")
+        {
+            if (!parse_group_by(field.second, group_names, error))
+                return false;
+        }
+        else if (field.first == "fields")
+        {
+            vector<AccumulatorSpec> specs;
+            if (!parse_accumulators(field.second, specs, error))
+                return false;
+            for (const AccumulatorSpec &acc : specs)
+            {
+                accumulators.push_back(Accumulator{acc.name, acc.op,
+                                                   acc.op == Op::Count ? FieldDictionary::NO_FIELD : resolve(acc.field)});
+            }
+        }
+        else
+        {
+            error = "Unknown aggregate option: " + field.first;
+            return false;
+        }
+    }
+
+    for (const string &name : group_names)
+    {
+        group_ids.push_back(resolve(name));
+    }
+    if (accumulators.empty())
+        accumulators.push_back(Accumulator{"count", Op::Count, FieldDictionary::NO_FIELD});
+    return true;
+}
+
+// целое для $sum: [+-]цифры в пределах int64, иначе значение не считается
+static bool parse_sum_value(string_view value, int64_t &out)
+{
+    value = trim_view(value);
+    if (!is_integer_string(value))
+        return false;
+    if (value.front() == '+')
+        value.remove_prefix(1);
+    auto result = from_chars(value.data(), value.data() + value.size(), out);
+    return result.ec == errc() && result.ptr == value.data() + value.size();
+}
+
+// сумма с проверкой: значения приходят от клиентов, переполнение int64 - не UB, а отметка
+static void add_sum(int64_t &sum, bool &overflow, int64_t number)
+{
+    if (!overflow && __builtin_add_overflow(sum, number, &sum))
+        overflow = true;
+}
+
+void Aggregation::accumulate(const Accumulator &acc, Value &value, const Document *doc) const
+{
+    if (acc.op == Op::Count)
+    {
+        value.count++;
+        return;
+    }
+
+    string_view raw;
+    if (!value_of(doc, acc.field_id, raw))
+        return;
+    if (acc.op == Op::Sum)
+    {
+        int64_t number = 0;
+        if (parse_sum_value(raw, number))
+        {
+            add_sum(value.sum, value.overflow, number);
+            value.has = true;
+        }
+        return;
+    }
+
+    string_view v = trim_view(raw);
+    int cmp = value.has ? compareFieldValues(v, value.text) : 0;
+    if (!value.has || (acc.op == Op::Min ? cmp < 0 : cmp > 0))
+    {
+        value.text.assign(v.data(), v.size());
+        value.has = true;
+    }
+}
+
+// значение поля группы в ключ: '\0' (поля нет) или '\1' + u32 длина + значение
+static void append_key_value(string &key, const string_view *value)
+{
+    if (!value)
+    {
+        key.push_back('\0');
+        return;
+    }
+    string_view v = trim_view(*value);
+    uint32_t len = static_cast<uint32_t>(v.size());
+    key.push_back('\1');
+    key.append(reinterpret_cast<const char *>(&len), sizeof(len));
+    key.append(v.data(), v.size());
+}
+
+bool Aggregation::add(const Document *doc)
+{
+    key.clear();
+    for (uint32_t id : group_ids)
+    {
+        string_view value;
+        append_key_value(key, value_of(doc, id, value) ? &value : nullptr);
+    }
+
+    auto it = groups.find(key);
+    if (it == groups.end())
+    {
+        if (groups.size() >= MAX_GROUPS)
+            return false;
+        it = groups.emplace(key, vector<Value>(accumulators.size())).first;
+    }
+    for (size_t i = 0; i < accumulators.size(); i++)
+    {
+        accumulate(accumulators[i], it->second[i], doc);
+    }
+    return true;
+}
+
+bool Aggregation::merge(const Aggregation &other)
+{
+    for (const auto &group : other.groups)
+    {
+        auto it = groups.find(group.first);
+        if (it == groups.end())
+        {
+            if (groups.size() >= MAX_GROUPS)
+                return false;
+            groups.emplace(group.first, group.second);
+            continue;
+        }
+        for (size_t i = 0; i < accumulators.size(); i++)
+        {
+            Value &value = it->second[i];
+            const Value &from = group.second[i];
+            value.count += from.count;
+            if (!from.has)
+                continue;
+            if (accumulators[i].op == Op::Sum)
+            {
+                value.overflow = value.overflow || from.overflow;
+                add_sum(value.sum, value.overflow, from.sum);
+            }
+            else if (!value.has || (accumulators[i].op == Op::Min ? compareFieldValues(from.text, value.text) < 0
+                                                                 : compareFieldValues(from.text, value.text) > 0))
+                value.text = from.text;
+            value.has = true;
+        }
+    }
+    return true;
+}
+
+// значения полей группы из ключа; first = false - поля нет
+static void decode_key(const string &key, vector<pair<bool, string_view>> &out)
+{
+    out.clear();
+    size_t pos = 0;
+    while (pos < key.size())
+    {
+        if (key[pos++] == '\0')
+        {
+            out.emplace_back(false, string_view());
+            continue;
+        }
+        uint32_t len = 0;
+        memcpy(&len, key.data() + pos, sizeof(len));
+        pos += sizeof(len);
+        out.emplace_back(true, string_view(key.data() + pos, len));
+        pos += len;
+    }
+}
+
+// порядок групп - как у sort по полям groupBy: поля нет - раньше любого значения
+static bool group_values_less(const vector<pair<bool, string_view>> &a, const vector<pair<bool, string_view>> &b)
+{
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        const auto &x = a[i];
+        const auto &y = b[i];
+        if (x.first != y.first)
+            return !x.first;
+        int cmp = x.first ? compareFieldValues(x.second, y.second) : 0;
+        if (cmp != 0)
+            return cmp < 0;
+    }
+    return false;
+}
+
+// "имя": перед значением поля строки ответа
+static void append_json_name(string &out, bool &first, const string &name)
+{
+    if (!first)
+        out.push_back(',');
+    first = false;
+    out += '"';
+    out += name;
+    out += "\":";
+}
+
+// поля groupBy строки ответа: "поле": "значение" | null
+static void append_group_values(string &out, bool &first, const vector<string> &names,
+                                const vector<pair<bool, string_view>> &values)
+{
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        append_json_name(out, first, names[i]);
+        if (!values[i].first)
+        {
+            out += "null";
+            continue;
+        }
+        out += '"';
+        out.append(values[i].second.data(), values[i].second.size());
+        out += '"';
+    }
+}
+
+void Aggregation::toJson(string &out_array_json) const
+{
+    vector<pair<vector<pair<bool, string_view>>, const vector<Value> *>> rows;
+    rows.reserve(groups.size());
+    for (const auto &group : groups)
+    {
+        rows.emplace_back();
+        decode_key(group.first, rows.back().first);
+        rows.back().second = &group.second;
+    }
+    // без groupBy ответ - всегда одна строка, даже если ничего не совпало
+    vector<Value> empty(accumulators.size());
+    if (rows.empty() && group_names.empty())
+        rows.emplace_back(vector<pair<bool, string_view>>(), &empty);
+    sort(rows.begin(), rows.end(), [](const auto &a, const auto &b)
+         { return group_values_less(a.first, b.first); });
+
+    out_array_json = "[";
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        if (r > 0)
+            out_array_json.push_back(',');
+        out_array_json.push_back('{');
+        bool first = true;
+        append_group_values(out_array_json, first, group_names, rows[r].first);
+        for (size_t i = 0; i < accumulators.size(); i++)
+        {
+            append_json_name(out_array_json, first, accumulators[i].name);
+            const Value &value = (*rows[r].second)[i];
+            if (accumulators[i].op == Op::Count)
+                out_array_json += to_string(value.count);
+            else if (!value.has)
+                out_array_json += "null";
+            else if (accumulators[i].op == Op::Sum)
+                out_array_json += value.overflow ? string("\"overflow\"") : to_string(value.sum);
+            else
+            {
+                out_array_json += '"';
+                out_array_json += value.text;
+                out_array_json += '"';
+            }
+        }
+        out_array_json.push_back('}');
+    }
+    out_array_json.push_back(']');
+}
+
+size_t Aggregation::groupCount() const
+{
+    return groups.empty() && group_names.empty() ? 1 : groups.size();
+}
+
+const size_t TimeHistogram::MAX_BUCKETS;
+const size_t TimeHistogram::MAX_SPLIT_CELLS;
+
+TimeHistogram::TimeHistogram(const FieldDictionary &dict)
+    : dict(dict), field_id(FieldDictionary::NO_FIELD), split_id(FieldDictionary::NO_FIELD), has_split(false),
+      from_ms(0), to_ms(0), bucket_ms(0), split_cells(0) {}
+
+// ширина интервала: 90 (секунды), "30s", "5m", "1h", "1d"
+static bool parse_bucket(const string &raw, int64_t &ms)
+{
+    string value = unquoteJsonValue(raw);
+    if (value.empty())
+        return false;
+    int64_t unit = 1000;
+    switch (value.back())
+    {
+    case 's':
+        value.pop_back();
+        break;
+    case 'm':
+        unit = 60000;
+        value.pop_back();
+        break;
+    case 'h':
+        unit = 3600000;
+        value.pop_back();
+        break;
+    case 'd':
+        unit = 86400000;
+        value.pop_back();
+        break;
+    default:
+        break;
+    }
+    if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != string::npos)
+        return false;
+    ms = stoll(value) * unit;
+    return ms > 0;
+}
+
+bool TimeHistogram::parse(const string &spec_json, const string &default_field, string &error)
+{
+    vector<pair<string, string>> fields;
+    if (!splitJsonObject(spec_json, fields))
+    {
+        error = "histogram requires data {\"from\", \"to\", \"bucket\"}";
+        return false;
+    }
+
+    field_name = default_field;
+    bool has_from = false, has_to = false, has_bucket = false;
+    for (const auto &field : fields)
+    {
+        const string &key = field.first;
+        if (key == "from" || key == "to")
+        {
+            int64_t &ms = key == "from" ? from_ms : to_ms;
+            if (!OrderedIndex::parseIsoMillis(unquoteJsonValue(field.second), ms))
+            {
+                error = "Option " + key + " must be a time like 2026-10-15T00:00:00.000Z";
+                return false;
+            }
+            (key == "from" ? has_from : has_to) = true;
+        }
+        else if (key == "bucket")
+        {
+            if (!parse_bucket(field.second, bucket_ms))
+            {
+                error = "Option bucket must be seconds or a width like 30s, 1m, 1h, 1d";
+                return false;
+            }
+            has_bucket = true;
+        }
+        else if (key == "field")
+        {
+            field_name = unquoteJsonValue(field.second);
+        }
+        else if (key == "splitBy")
+        {
+            split_name = unquoteJsonValue(field.second);
+            has_split = !split_name.empty();
+        }
+        else
+        {
+            error = "Unknown histogram option: " + key;
+            return false;
+        }
+    }
+
+    if (!has_from || !has_to || !has_bucket)
+    {
+        error = "histogram requires from, to and bucket";
+        return false;
+    }
+    if (to_ms <= from_ms)
+    {
+        error = "histogram range is empty (to must be after from)";
+        return false;
+    }
+    int64_t buckets = (to_ms - from_ms + bucket_ms - 1) / bucket_ms;
+    if (buckets > static_cast<int64_t>(MAX_BUCKETS))
+    {
+        error = "Too many buckets (more than " + to_string(MAX_BUCKETS) + "), use a wider bucket";
+        return false;
+    }
+
+    field_id = dict.lookup(field_name);
+    if (has_split)
+        split_id = dict.lookup(split_name);
+    counts.assign(static_cast<size_t>(buckets), 0);
+    if (has_split)
+        split_counts.resize(counts.size());
+    return true;
+}
+
+const string &TimeHistogram::fieldName() const
+{
+    return field_name;
+}
+
+uint32_t TimeHistogram::fieldId() const
+{
+    return field_id;
+}
+
+bool TimeHistogram::hasSplit() const
+{
+    return has_split;
+}
+
+int64_t TimeHistogram::fromMs() const
+{
+    return from_ms;
+}
+
+int64_t TimeHistogram::toMs() const
+{
+    return to_ms;
+}
+
+int64_t TimeHistogram::bucketMs() const
+{
+    return bucket_ms;
+}
+
+void TimeHistogram::addTime(int64_t ms, uint64_t n)
+{
+    if (ms >= from_ms && ms < to_ms)
+        counts[static_cast<size_t>((ms - from_ms) / bucket_ms)] += n;
+}
+
+bool TimeHistogram::add(const Document *doc)
+{
+    string_view value;
+    int64_t ms = 0;
+    if (field_id == FieldDictionary::NO_FIELD || !doc->getField(field_id, value, dict) ||
+        !OrderedIndex::parseIsoMillis(trim_view(value), ms) || ms < from_ms || ms >= to_ms)
+        return true;
+
+    size_t bucket = static_cast<size_t>((ms - from_ms) / bucket_ms);
+    counts[bucket]++;
+    if (!has_split)
+        return true;
+
+    // документ без поля splitBy - под значением null
+    string_view split_value;
+    bool has_value = split_id != FieldDictionary::NO_FIELD && doc->getField(split_id, split_value, dict);
+    split_key.assign(has_value ? "\1" : "\0", 1);
+    if (has_value)
+    {
+        split_value = trim_view(split_value);
+        split_key.append(split_value.data(), split_value.size());
+    }
+    auto &cells = split_counts[bucket];
+    auto it = cells.find(split_key);
+    if (it == cells.end())
+    {
+        if (split_cells >= MAX_SPLIT_CELLS)
+            return false;
+        split_cells++;
+        it = cells.emplace(split_key, 0).first;
+    }
+    it->second++;
+    return true;
+}
+
+void TimeHistogram::toJson(string &out_array_json) const
+{
+    out_array_json = "[";
+    char time_buf[24];
+    vector<pair<string_view, uint64_t>> values;
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        if (i > 0)
+            out_array_json.push_back(',');
+        OrderedIndex::formatIsoMillis(from_ms + static_cast<int64_t>(i) * bucket_ms, time_buf);
+        out_array_json += "{\"bucket\":\"";
+        out_array_json.append(time_buf, 24);
+        out_array_json += "\",\"count\":";
+        out_array_json += to_string(counts[i]);
+        if (has_split)
+        {
+            // значения по порядку сортировки find, null - первым
+            values.clear();
+            for (const auto &cell : split_counts[i])
+            {
+                values.emplace_back(cell.first, cell.second);
+            }
+            sort(values.begin(), values.end(), [](const auto &a, const auto &b)
+                 {
+                if (a.first[0] != b.first[0])
+                    return a.first[0] == '\0';
+                return compareFieldValues(a.first.substr(1), b.first.substr(1)) < 0; });
+
+            out_array_json += ",\"";
+            out_array_json += split_name;
+            out_array_json += "\":{";
+            for (size_t v = 0; v < values.size(); v++)
+            {
+                if (v > 0)
+                    out_array_json.push_back(',');
+                string_view name = values[v].first.substr(1);
+                out_array_json += '"';
+                out_array_json.append(values[v].first[0] == '\0' ? string_view("null") : name);
+                out_array_json += "\":";
+                out_array_json += to_string(values[v].second);
+            }
+            out_array_json.push_back('}');
+        }
+        out_array_json.push_back('}');
+    }
+    out_array_json.push_back(']');
+}
+
+size_t TimeHistogram::bucketCount() const
+{
+    return counts.size();
+}
+
+const size_t TopK::MAX_K;
+const size_t TopK::EXACT_LIMIT;
+const size_t TopK::CMS_WIDTH;
+const size_t TopK::CMS_DEPTH;
+
+TopK::TopK(const FieldDictionary &dict)
+    : dict(dict), field_id(FieldDictionary::NO_FIELD), is_id(false), k(10), capacity(0), mode(Mode::Auto), total(0) {}
+
+bool TopK::parse(const string &spec_json, string &error)
+{
+    vector<pair<string, string>> fields;
+    if (!splitJsonObject(spec_json, fields))
+    {
+        error = "topk requires data {\"field\": \"name\", \"k\": 10}";
+        return false;
+    }
+
+    for (const auto &field : fields)
+    {
+        const string &name = field.first;
+        string value = unquoteJsonValue(field.second);
+        if (name == "field")
+        {
+            field_name = value;
+        }
+        else if (name == "k" || name == "capacity")
+        {
+            if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != string::npos ||
+                stoull(value) == 0)
+            {
+                error = "Option " + name + " must be a positive integer";
+                return false;
+            }
+            (name == "k" ? k : capacity) = static_cast<size_t>(stoull(value));
+        }
+        else if (name == "mode")
+        {
+            if (value == "auto")
+                mode = Mode::Auto;
+            else if (value == "exact")
+                mode = Mode::Exact;
+            else if (value == "sketch")
+                mode = Mode::Sketch;
+            else
+            {
+                error = "Unknown topk mode: " + value + " (use auto, exact, sketch)";
+                return false;
+            }
+        }
+        else
+        {
+            error = "Unknown topk option: " + name;
+            return false;
+        }
+    }
+
+    if (field_name.empty())
+    {
+        error = "topk requires data {\"field\": \"name\"}";
+        return false;
+    }
+    if (k > MAX_K)
+    {
+        error = "Option k must be at most " + to_string(MAX_K);
+        return false;
+    }
+    // кандидатов с запасом: значения на границе k вытесняются реже
+    if (capacity == 0)
+        capacity = max<size_t>(1024, 20 * k);
+    capacity = min(max(capacity, k), EXACT_LIMIT);
+
+    is_id = field_name == "_id";
+    if (!is_id)
+        field_id = dict.lookup(field_name);
+    if (mode == Mode::Sketch)
+        start_sketch();
+    return true;
+}
+
+// переход на скетч: точные счётчики переносятся, лишние кандидаты вытесняются как обычно
+void TopK::start_sketch()
+{
+    summary.reset(new SpaceSaving(capacity));
+    cms.reset(new CountMinSketch(CMS_WIDTH, CMS_DEPTH));
+    for (const auto &entry : exact)
+    {
+        summary->add(entry.first, entry.second);
+        cms->add(sketchHash(entry.first), static_cast<uint32_t>(min<uint64_t>(entry.second, UINT32_MAX)));
+    }
+    exact.clear();
+    exact.rehash(0);
+}
+
+bool TopK::add(const Document *doc)
+{
+    string_view value;
+    if (is_id)
+        value = doc->_id;
+    else if (field_id == FieldDictionary::NO_FIELD || !doc->getField(field_id, value, dict))
+        return true;
+    value = trim_view(value);
+    total++;
+
+    if (summary)
+    {
+        key.assign(value.data(), value.size());
+        summary->add(key);
+        cms->add(sketchHash(value));
+        return true;
+    }
+
+    key.assign(value.data(), value.size());
+    auto it = exact.find(key);
+    if (it != exact.end())
+    {
+        it->second++;
+        return true;
+    }
+    if (exact.size() >= EXACT_LIMIT)
+    {
+        if (mode == Mode::Exact)
+            return false;
+        start_sketch();
+        summary->add(key);
+        cms->add(sketchHash(value));
+        return true;
+    }
+    exact.emplace(key, 1);
+    return true;
+}
+
+bool TopK::isExact() const
+{
+    return !summary;
+}
+
+uint64_t TopK::counted() const
+{
+    return total;
+}
+
+void TopK::toJson(string &out_array_json, size_t &out_rows) const
+{
+    struct Row
+    {
+        const string *value;
+        uint64_t count;
+        uint64_t error;
+    };
+    vector<Row> rows;
+    if (summary)
+    {
+        // обе оценки не меньше настоящей частоты - берём меньшую;
+        // нижняя граница - счётчик Space-Saving без унаследованной ошибки
+        for (const SpaceSaving::Item &item : summary->items())
+        {
+            uint64_t upper = min(item.count, cms->estimate(sketchHash(item.value)));
+            uint64_t lower = item.count - item.error;
+            rows.push_back(Row{&item.value, upper, upper > lower ? upper - lower : 0});
+        }
+    }
+    else
+    {
+        rows.reserve(exact.size());
+        for (const auto &entry : exact)
+        {
+            rows.push_back(Row{&entry.first, entry.second, 0});
+        }
+    }
+
+    auto order = [](const Row &a, const Row &b)
+    {
+        return a.count != b.count ? a.count > b.count : *a.value < *b.value;
+    };
+    size_t n = min(k, rows.size());
+    partial_sort(rows.begin(), rows.begin() + n, rows.end(), order);
+
+    out_array_json = "[";
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i > 0)
+            out_array_json.push_back(',');
+        out_array_json += "{\"value\":\"";
+        out_array_json += *rows[i].value;
+        out_array_json += "\",\"count\":";
+        out_array_json += to_string(rows[i].count);
+        if (summary)
+        {
+            out_array_json += ",\"error\":";
+            out_array_json += to_string(rows[i].error);
+        }
+        out_array_json.push_back('}');
+    }
+    out_array_json.push_back(']');
+    out_rows = n;
+}
+
+bool DistinctSpec::parse(const string &spec_json, DistinctSpec &out, string &error)
+{
+    out = DistinctSpec();
+    vector<pair<string, string>> fields;
+    if (!splitJsonObject(spec_json, fields))
+    {
+        error = "approxDistinct requires data {\"field\": \"name\"}";
+        return false;
+    }
+
+    bool has_from = false, has_to = false;
+    for (const auto &field : fields)
+    {
+        const string &key = field.first;
+        string value = trim(field.second);
+        if (key == "field")
+        {
+            if (!value.empty() && value.front() == '[')
+            {
+                if (!splitJsonArray(value, out.fields))
+                {
+                    error = "field must be a name or an array of names";
+                    return false;
+                }
+            }
+            else
+            {
+                out.fields.assign(1, unquoteJsonValue(value));
+            }
+        }
+        else if (key == "from" || key == "to")
+        {
+            int64_t &ms = key == "from" ? out.from_ms : out.to_ms;
+            if (!OrderedIndex::parseIsoMillis(unquoteJsonValue(value), ms))
+            {
+                error = "Option " + key + " must be a time like 2026-10-15T00:00:00.000Z";
+                return false;
+            }
+            (key == "from" ? has_from : has_to) = true;
+        }
+        else if (key == "bySegment")
+        {
+            out.by_segment = unquoteJsonValue(value) == "true";
+        }
+        else if (key == "databases")
+        {
+            if (!splitJsonArray(value, out.databases))
+            {
+                error = "databases must be an array of names";
+                return false;
+            }
+        }
+        else
+        {
+            error = "Unknown approxDistinct option: " + key;
+            return false;
+        }
+    }
+
+    out.fields.erase(remove(out.fields.begin(), out.fields.end(), string()), out.fields.end());
+    if (out.fields.empty())
+    {
+        error = "approxDistinct requires data {\"field\": \"name\"}";
+        return false;
+    }
+    if (has_from != has_to)
+    {
+        error = "approxDistinct range needs both from and to";
+        return false;
+    }
+    out.has_range = has_from;
+    if (out.has_range && out.to_ms <= out.from_ms)
+    {
+        error = "approxDistinct range is empty (to must be after from)";
+        return false;
+    }
+    return true;
+}
+
+void DistinctSpec::appendRow(const vector<HyperLogLog> &sketches, const string *segment, string &out) const
+{
+    out.push_back('{');
+    if (segment)
+    {
+        out += "\"segment\":\"";
+        out += *segment;
+        out += "\",";
+    }
+    for (size_t i = 0; i < fields.size(); i++)
+    {
+        if (i > 0)
+            out.push_back(',');
+        out += '"';
+        out += fields[i];
+        out += "\":";
+        out += to_string(sketches[i].estimate());
+    }
+    out.push_back('}');
+}
+
+const size_t MaterializedView::MAX_GROUPS;
+const size_t MaterializedView::MAX_EXTREME_VALUES;
+
+bool MaterializedView::ValueLess::operator()(const string &a, const string &b) const
+{
+    int cmp = compareFieldValues(a, b);
+    return cmp != 0 ? cmp < 0 : a < b;
+}
+
+MaterializedView::MaterializedView(FieldDictionary &dict)
+    : dict(dict), compiled_fields(0), time_id(FieldDictionary::NO_FIELD), bucket_ms(0), group_count(0),
+      overflow(false), stale(false) {}
+
+bool MaterializedView::parse(const string &filter, const string &spec, const string &default_time_field,
+                             string &error)
+{
+    vector<pair<string, string>> fields;
+    if (!splitJsonObject(spec, fields))
+    {
+        error = "createView requires data {\"name\", \"groupBy\", \"bucket\", \"fields\"}";
+        return false;
+    }
+
+    vector<AccumulatorSpec> specs;
+    time_name = default_time_field;
+    for (const auto &field : fields)
+    {
+        const string &key = field.first;
+        if (key == "name")
+        {
+            view_name = unquoteJsonValue(field.second);
+        }
+        else if (key == "groupBy")
+        {
+            if (!parse_group_by(field.second, group_names, error))
+                return false;
+        }
+        else if (key == "fields")
+        {
+            if (!parse_accumulators(field.second, specs, error))
+                return false;
+        }
+        else if (key == "bucket")
+        {
+            if (!parse_bucket(field.second, bucket_ms))
+            {
+                error = "Option bucket must be seconds or a width like 30s, 1m, 1h, 1d";
+                return false;
+            }
+        }
+        else if (key == "field")
+        {
+            time_name = unquoteJsonValue(field.second);
+        }
+        else
+        {
+            error = "Unknown view option: " + key;
+            return false;
+        }
+    }
+    if (view_name.empty() || view_name.find_first_of("\t\r\n\"\\") != string::npos)
+    {
+        error = "View name is required and must not contain quotes, tabs or line breaks";
+        return false;
+    }
+    if (bucket_ms > 0 && time_name.empty())
+    {
+        error = "Option field (time of the event) is empty";
+        return false;
+    }
+
+    // поля, которых ещё нет, заводятся сразу: номера не меняются, когда появятся документы
+    auto resolve = [&](const string &name)
+    { return name == "_id" ? Aggregation::ID_FIELD : dict.intern(name); };
+    for (const string &name : group_names)
+    {
+        group_ids.push_back(resolve(name));
+    }
+    for (const AccumulatorSpec &acc : specs)
+    {
+        accumulators.push_back(Accumulator{acc.name, acc.op,
+                                           acc.op == Aggregation::Op::Count ? FieldDictionary::NO_FIELD : resolve(acc.field)});
+    }
+    if (accumulators.empty())
+        accumulators.push_back(Accumulator{"count", Aggregation::Op::Count, FieldDictionary::NO_FIELD});
+    if (bucket_ms > 0)
+        time_id = dict.intern(time_name);
+
+    query_json = trim(filter);
+    if (query_json.empty())
+        query_json = "{}";
+    spec_json = trim(spec);
+    query.reset(new CompiledQuery(query_json, dict, false));
+    compiled_fields = dict.size();
+    if (query->matchesNone())
+    {
+        error = "Invalid view query";
+        return false;
+    }
+    return true;
+}
+
+const string &MaterializedView::name() const
+{
+    return view_name;
+}
+
+const string &MaterializedView::queryJson() const
+{
+    return query_json;
+}
+
+const string &MaterializedView::specJson() const
+{
+    return spec_json;
+}
+
+bool MaterializedView::value_of(const Document *doc, uint32_t field_id, string_view &out) const
+{
+    if (field_id == Aggregation::ID_FIELD)
+    {
+        out = doc->_id;
+        return true;
+    }
+    return doc->getField(field_id, out, dict);
+}
+
+bool MaterializedView::group_of(const Document *doc, int64_t &bucket)
+{
+    // имя из запроса, которого не было в словаре, ничему не равно - после его появления
+    // запрос компилируется заново (документы без поля не подходили и не подходят)
+    if (dict.size() != compiled_fields)
+    {
+        query.reset(new CompiledQuery(query_json, dict, false));
+        compiled_fields = dict.size();
+    }
+    if (!query->matches(doc))
+        return false;
+
+    bucket = 0;
+    if (bucket_ms > 0)
+    {
+        string_view value;
+        int64_t ms = 0;
+        if (!doc->getField(time_id, value, dict) || !OrderedIndex::parseIsoMillis(trim_view(value), ms))
+            return false;
+        int64_t rem = ms % bucket_ms;
+        bucket = ms - (rem < 0 ? rem + bucket_ms : rem);
+    }
+
+    key.clear();
+    for (uint32_t id : group_ids)
+    {
+        string_view value;
+        append_key_value(key, value_of(doc, id, value) ? &value : nullptr);
+    }
+    return true;
+}
+
+void MaterializedView::add(const Document *doc)
+{
+    int64_t bucket = 0;
+    if (overflow || !group_of(doc, bucket))
+        return;
+
+    auto &groups = buckets[bucket];
+    auto it = groups.find(key);
+    if (it == groups.end())
+    {
+        if (group_count >= MAX_GROUPS)
+        {
+            // неполная таблица хуже ошибки: чтение сообщит, что представление надо пересоздать
+            overflow = true;
+            buckets.clear();
+            group_count = 0;
+            return;
+        }
+        it = groups.emplace(key, Group()).first;
+        it->second.values.resize(accumulators.size());
+        group_count++;
+    }
+
+    Group &group = it->second;
+    group.documents++;
+    for (size_t i = 0; i < accumulators.size(); i++)
+    {
+        const Accumulator &acc = accumulators[i];
+        Value &value = group.values[i];
+        if (acc.op == Aggregation::Op::Count)
+        {
+            value.count++;
+            continue;
+        }
+        string_view raw;
+        if (acc.field_id == FieldDictionary::NO_FIELD || !value_of(doc, acc.field_id, raw))
+            continue;
+        if (acc.op == Aggregation::Op::Sum)
+        {
+            int64_t number = 0;
+            if (parse_sum_value(raw, number))
+            {
+                add_sum(value.sum, value.overflow, number);
+                value.count++;
+            }
+            continue;
+        }
+        add_extreme(acc.op, value, raw);
+    }
+}
+
+// значение $min/$max: хранятся только MAX_EXTREME_VALUES лучших, остальные - лишь граница bound
+void MaterializedView::add_extreme(Aggregation::Op op, Value &value, string_view raw) const
+{
+    ValueLess less;
+    string v(trim_view(raw));
+    auto better = [&](const string &a, const string &b)
+    { return op == Aggregation::Op::Min ? less(a, b) : less(b, a); };
+
+    auto found = value.values.find(v);
+    if (found != value.values.end())
+    {
+        found->second++;
+        return;
+    }
+    if (value.truncated && !better(v, value.bound))
+        return;
+    if (value.values.size() >= MAX_EXTREME_VALUES)
+    {
+        auto worst = op == Aggregation::Op::Min ? prev(value.values.end()) : value.values.begin();
+        if (!better(v, worst->first))
+        {
+            value.bound = move(v);
+            value.truncated = true;
+            return;
+        }
+        value.bound = worst->first;
+        value.truncated = true;
+        value.values.erase(worst);
+    }
+    value.values.emplace(move(v), 1);
+}
+
+void MaterializedView::remove(const Document *doc)
+{
+    int64_t bucket = 0;
+    if (overflow || !group_of(doc, bucket))
+        return;
+
+    auto bucket_it = buckets.find(bucket);
+    if (bucket_it == buckets.end())
+        return;
+    auto it = bucket_it->second.find(key);
+    if (it == bucket_it->second.end())
+        return;
+
+    Group &group = it->second;
+    bool lost = false; // накопитель группы стал неизвестен
+    for (size_t i = 0; i < accumulators.size(); i++)
+    {
+        const Accumulator &acc = accumulators[i];
+        Value &value = group.values[i];
+        if (acc.op == Aggregation::Op::Count)
+        {
+            value.count--;
+            continue;
+        }
+        string_view raw;
+        if (acc.field_id == FieldDictionary::NO_FIELD || !value_of(doc, acc.field_id, raw))
+            continue;
+        if (acc.op == Aggregation::Op::Sum)
+        {
+            int64_t number = 0;
+            if (parse_sum_value(raw, number))
+            {
+                // после переполнения сумма неизвестна: без пересчёта в int64 она не вернётся
+                if (value.overflow || __builtin_sub_overflow(value.sum, number, &value.sum))
+                    lost = true;
+                value.count--;
+            }
+            continue;
+        }
+        // значения нет среди хранимых - оно было отброшено и на ответ не влияет
+        auto value_it = value.values.find(string(trim_view(raw)));
+        if (value_it != value.values.end() && --value_it->second == 0)
+        {
+            value.values.erase(value_it);
+            if (value.values.empty() && value.truncated)
+                lost = true;
+        }
+    }
+
+    // группа без документов исчезает, как если бы её никогда не было
+    if (--group.documents == 0)
+    {
+        bucket_it->second.erase(it);
+        group_count--;
+        if (bucket_it->second.empty())
+            buckets.erase(bucket_it);
+    }
+    else if (lost)
+    {
+        stale = true;
+    }
+}
+
+bool MaterializedView::isOverflow() const
+{
+    return overflow;
+}
+
+bool MaterializedView::needsRebuild() const
+{
+    return stale;
+}
+
+void MaterializedView::clear()
+{
+    buckets.clear();
+    group_count = 0;
+    overflow = false;
+    stale = false;
+}
+
+size_t MaterializedView::groupCount() const
+{
+    return group_count;
+}
+
+bool MaterializedView::toJson(bool has_range, int64_t from_ms, int64_t to_ms, string &out_array_json,
+                              size_t &out_rows, string &error) const
+{
+    out_rows = 0;
+    if (overflow)
+    {
+        error = "View " + view_name + " has more than " + to_string(MAX_GROUPS) +
+                " groups and is no longer maintained; drop it and create it with a wider bucket";
+        return false;
+    }
+    if (has_range && bucket_ms == 0)
+    {
+        error = "View " + view_name + " has no bucket, from/to are not supported";
+        return false;
+    }
+
+    auto begin = has_range ? buckets.lower_bound(from_ms) : buckets.begin();
+    auto end = has_range ? buckets.lower_bound(to_ms) : buckets.end();
+    char time_buf[24];
+    vector<pair<vector<pair<bool, string_view>>, const Group *>> rows;
+    out_array_json = "[";
+    for (auto b = begin; b != end && (!has_range || from_ms < to_ms); ++b)
+    {
+        rows.clear();
+        rows.reserve(b->second.size());
+        for (const auto &group : b->second)
+        {
+            rows.emplace_back();
+            decode_key(group.first, rows.back().first);
+            rows.back().second = &group.second;
+        }
+        sort(rows.begin(), rows.end(), [](const auto &x, const auto &y)
+             { return group_values_less(x.first, y.first); });
+
+        for (const auto &row : rows)
+        {
+            if (out_rows++ > 0)
+                out_array_json.push_back(',');
+            out_array_json.push_back('{');
+            bool first = true;
+            if (bucket_ms > 0)
+            {
+                OrderedIndex::formatIsoMillis(b->first, time_buf);
+                out_array_json += "\"bucket\":\"";
+                out_array_json.append(time_buf, 24);
+                out_array_json += '"';
+                first = false;
+            }
+            append_group_values(out_array_json, first, group_names, row.first);
+            for (size_t i = 0; i < accumulators.size(); i++)
+            {
+                append_json_name(out_array_json, first, accumulators[i].name);
+                const Value &value = row.second->values[i];
+                Aggregation::Op op = accumulators[i].op;
+                if (op == Aggregation::Op::Count)
+                    out_array_json += to_string(value.count);
+                else if (op == Aggregation::Op::Sum)
+                    out_array_json += value.count == 0 ? string("null")
+                                      : value.overflow ? string("\"overflow\"")
+                                                       : to_string(value.sum);
+                else if (value.values.empty())
+                    out_array_json += "null";
+                else
+                {
+                    const string &text = op == Aggregation::Op::Min ? value.values.begin()->first
+                                                                    : value.values.rbegin()->first;
+                    out_array_json += '"';
+                    out_array_json += text;
+                    out_array_json += '"';
+                }
+            }
+            out_array_json.push_back('}');
+        }
+    }
+    out_array_json.push_back(']');
+    return true;
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <map>
+#include <cstdint>
+#include "document.h"
+#include "field_dictionary.h"
+#include "query.h"
+#include "sketch.h"
+
+// агрегация совпавших документов за один проход: группы по значениям полей и накопители
+//   {"groupBy": "поле" | ["поле", ...],
+//    "fields": {"имя": {"$count": 1} | {"$min": "поле"} | {"$max": "поле"} | {"$sum": "поле"}}}
+// без groupBy - одна группа на все документы, без fields - {"count": {"$count": 1}};
+// $sum складывает целые int64, сумма вне int64 выдаётся строкой "overflow"
+class Aggregation
+{
+public:
+    static const std::size_t MAX_GROUPS = 100000; // больше - ошибка, а не ответ на сотни МБ
+    static const std::uint32_t ID_FIELD = FieldDictionary::NO_FIELD - 1; // _id документа вместо номера поля
+
+    enum class Op
+    {
+        Count,
+        Min,
+        Max,
+        Sum
+    };
+
+private:
+    struct Accumulator
+    {
+        std::string name;
+        Op op;
+        std::uint32_t field_id; // NO_FIELD - поля нет ни в одном документе (и у $count)
+    };
+
+    // состояние накопителя в группе; min/max - по порядку сортировки find
+    struct Value
+    {
+        std::uint64_t count = 0;
+        std::int64_t sum = 0;
+        bool has = false;      // min/max/sum: встретилось подходящее значение
+        bool overflow = false; // sum вышла за int64, дальше не считается
+        std::string text;      // min/max
+    };
+
+    const FieldDictionary &dict;
+    std::vector<std::string> group_names;
+    std::vector<std::uint32_t> group_ids;
+    std::vector<Accumulator> accumulators;
+    // ключ группы: по каждому полю '\0' (поля нет) или '\1' + u32 длина + значение
+    std::unordered_map<std::string, std::vector<Value>> groups;
+    std::string key; // буфер ключа, чтобы не выделять память на каждый документ
+
+    std::uint32_t resolve(const std::string &name) const;
+    bool value_of(const Document *doc, std::uint32_t field_id, std::string_view &out) const;
+    void accumulate(const Accumulator &acc, Value &value, const Document *doc) const;
+
+public:
+    explicit Aggregation(const FieldDictionary &dict);
+
+    bool parse(const std::string &spec_json, std::string &error);
+    // false - групп стало больше MAX_GROUPS
+    bool add(const Document *doc);
+    // добавить группы другой агрегации с той же спецификацией (проход по частям в разных потоках);
+    // false - групп стало больше MAX_GROUPS
+    bool merge(const Aggregation &other);
+    // группы по возрастанию значений groupBy: [{"поле": "значение" | null, ..., "имя": накопитель}];
+    // без groupBy - ровно одна строка
+    void toJson(std::string &out_array_json) const;
+    std::size_t groupCount() const; // строк ответа
+};
+
+// число документов по интервалам времени одной ширины в [from, to):
+//   {"from": "2026-10-15T00:00:00.000Z", "to": "2026-10-15T06:00:00.000Z",
+//    "bucket": "1m" | "30s" | "1h" | "1d" | секунды, "field": "timestamp", "splitBy": "severity"}
+// время - значение поля в каноническом виде (как у секций и ordered-индекса), прочие не считаются
+class TimeHistogram
+{
+public:
+    static const std::size_t MAX_BUCKETS = 100000;
+    static const std::size_t MAX_SPLIT_CELLS = 1000000; // пар (интервал, значение splitBy)
+
+private:
+    const FieldDictionary &dict;
+    std::string field_name;
+    std::string split_name;
+    std::uint32_t field_id;
+    std::uint32_t split_id;
+    bool has_split;
+    std::int64_t from_ms;
+    std::int64_t to_ms;
+    std::int64_t bucket_ms;
+    std::vector<std::uint64_t> counts;
+    std::vector<std::unordered_map<std::string, std::uint64_t>> split_counts; // только со splitBy
+    std::size_t split_cells;
+    std::string split_key; // буфер значения splitBy
+
+public:
+    explicit TimeHistogram(const FieldDictionary &dict);
+
+    // default_field - поле времени, если "field" не указано
+    bool parse(const std::string &spec_json, const std::string &default_field, std::string &error);
+    const std::string &fieldName() const;
+    std::uint32_t fieldId() const;
+    bool hasSplit() const;
+    std::int64_t fromMs() const;
+    std::int64_t toMs() const;
+    std::int64_t bucketMs() const;
+
+    // n событий в момент ms (вне [from, to) - не считаются); только без splitBy
+    void addTime(std::int64_t ms, std::uint64_t n = 1);
+    // событие документа; false - со splitBy пар стало больше MAX_SPLIT_CELLS
+    bool add(const Document *doc);
+    // все интервалы по порядку, пустые тоже: [{"bucket": начало, "count": n, "<splitBy>": {"значение": n}}]
+    void toJson(std::string &out_array_json) const;
+    std::size_t bucketCount() const;
+};
+
+// самые частые значения поля: {"field": "ip", "k": 10, "mode": "auto" | "exact" | "sketch", "capacity": n}
+//   exact  - точный подсчёт хешем (не больше EXACT_LIMIT различных значений);
+//   sketch - Space-Saving на capacity кандидатов + Count-Min: память ограничена, счётчик -
+//            оценка сверху, error - на сколько он может быть завышен;
+//   auto   - точно, пока различных значений не больше EXACT_LIMIT, затем sketch
+class TopK
+{
+public:
+    static const std::size_t MAX_K = 10000;
+    static const std::size_t EXACT_LIMIT = 100000;
+    static const std::size_t CMS_WIDTH = 1 << 16;
+    static const std::size_t CMS_DEPTH = 4;
+
+    enum class Mode
+    {
+        Auto,
+        Exact,
+        Sketch
+    };
+
+private:
+    const FieldDictionary &dict;
+    std::string field_name;
+    std::uint32_t field_id;
+    bool is_id;
+    std::size_t k;
+    std::size_t capacity; // кандидатов Space-Saving
+    Mode mode;
+    std::uint64_t total; // учтено значений
+    std::unordered_map<std::string, std::uint64_t> exact;
+    std::unique_ptr<SpaceSaving> summary; // с переходом на скетч
+    std::unique_ptr<CountMinSketch> cms;
+    std::string key; // буфер значения
+
+    void start_sketch();
+
+public:
+    explicit TopK(const FieldDictionary &dict);
+
+    bool parse(const std::string &spec_json, std::string &error);
+    // false - в режиме exact различных значений стало больше EXACT_LIMIT
+    bool add(const Document *doc);
+    bool isExact() const;
+    std::uint64_t counted() const;
+    // до k значений по убыванию частоты: [{"value", "count"}], в режиме скетча ещё "error"
+    void toJson(std::string &out_array_json, std::size_t &out_rows) const;
+};
+
+// approxDistinct: {"field": "ip" | ["ip", "user"], "from": время, "to": время,
+//                  "bySegment": true, "databases": ["db1", "db2"]}
+// оценка - слияние HyperLogLog секций, зона которых пересекает [from, to) (граница - с точностью
+// до секции); без from/to - все секции, включая документы без времени
+struct DistinctSpec
+{
+    std::vector<std::string> fields;
+    bool has_range = false;
+    std::int64_t from_ms = 0;
+    std::int64_t to_ms = 0;
+    bool by_segment = false;
+    std::vector<std::string> databases; // пусто - только база запроса
+
+    static bool parse(const std::string &spec_json, DistinctSpec &out, std::string &error);
+    // строка ответа {"segment": метка, "поле": оценка, ...}; segment nullptr - без метки
+    void appendRow(const std::vector<HyperLogLog> &sketches, const std::string *segment, std::string &out) const;
+};
+
+// непрерывный агрегат (материализованное представление): группы и накопители по документам
+// запроса, которые ведут вставки и удаления базы, поэтому чтение отдаёт готовую таблицу
+//   {"name": "sev_per_min", "groupBy": ["severity", "hostname"], "bucket": "1m", "field": "timestamp",
+//    "fields": {"имя": {"$count": 1} | {"$min": "поле"} | {"$max": "поле"} | {"$sum": "поле"}}}
+// с bucket группы ещё и по интервалам времени field: документы без времени не считаются.
+// $min/$max держат в группе не больше MAX_EXTREME_VALUES лучших значений с числом документов:
+// удаление обычно обходится без пересчёта, а память не растёт с числом разных значений
+// (например, $max по timestamp). Если удаления сняли все хранимые значения, а отброшенные
+// были, представление пересчитывается по базе при следующем чтении (needsRebuild)
+class MaterializedView
+{
+public:
+    static const std::size_t MAX_GROUPS = Aggregation::MAX_GROUPS;
+    static const std::size_t MAX_EXTREME_VALUES = 16;
+
+private:
+    struct Accumulator
+    {
+        std::string name;
+        Aggregation::Op op;
+        std::uint32_t field_id;
+    };
+
+    // порядок find, при равенстве - побайтно: "1" и "01" - разные значения
+    struct ValueLess
+    {
+        bool operator()(const std::string &a, const std::string &b) const;
+    };
+
+    struct Value
+    {
+        std::uint64_t count = 0; // $count; у $sum - сколько значений сложено
+        std::int64_t sum = 0;
+        bool overflow = false;   // $sum вышла за int64
+        std::map<std::string, std::uint64_t, ValueLess> values; // $min/$max: значение -> документов
+        bool truncated = false;  // $min/$max: часть значений отброшена,
+        std::string bound;       // лучшая из отброшенных - хранимые все лучше неё
+    };
+
+    struct Group
+    {
+        std::uint64_t documents = 0;
+        std::vector<Value> values;
+    };
+
+    FieldDictionary &dict;
+    std::string view_name;
+    std::string query_json;
+    std::string spec_json;
+    std::unique_ptr<CompiledQuery> query;
+    std::size_t compiled_fields; // размер словаря при компиляции: новые поля - компилируем заново
+    std::vector<std::string> group_names;
+    std::vector<std::uint32_t> group_ids;
+    std::vector<Accumulator> accumulators;
+    std::string time_name;
+    std::uint32_t time_id;
+    std::int64_t bucket_ms; // 0 - без интервалов времени
+    // начало интервала (0 без bucket) -> ключ группы (как у Aggregation) -> накопители
+    std::map<std::int64_t, std::unordered_map<std::string, Group>> buckets;
+    std::size_t group_count;
+    bool overflow; // групп стало больше MAX_GROUPS: таблица сброшена до пересоздания
+    bool stale;    // накопитель группы больше нельзя вести по удалениям - нужен пересчёт
+    std::string key; // буфер ключа
+
+    bool value_of(const Document *doc, std::uint32_t field_id, std::string_view &out) const;
+    // интервал и ключ группы документа; false - документ не подходит представлению
+    bool group_of(const Document *doc, std::int64_t &bucket);
+    void add_extreme(Aggregation::Op op, Value &value, std::string_view raw) const;
+
+public:
+    explicit MaterializedView(FieldDictionary &dict);
+
+    // query_json - отбор документов, spec_json - описание выше; имена полей добавляются в словарь
+    bool parse(const std::string &query_json, const std::string &spec_json, const std::string &default_time_field,
+               std::string &error);
+    const std::string &name() const;
+    const std::string &queryJson() const;
+    const std::string &specJson() const;
+
+    void add(const Document *doc);
+    void remove(const Document *doc); // только для документов, которые были добавлены
+    bool isOverflow() const;
+    bool needsRebuild() const;
+    void clear(); // снять все группы перед пересчётом
+    std::size_t groupCount() const;
+
+    // строки по интервалам [from, to) (has_range = false - все), внутри - по значениям groupBy:
+    // [{"bucket": начало, "поле": "значение", ..., "имя": накопитель}]
+    bool toJson(bool has_range, std::int64_t from_ms, std::int64_t to_ms, std::string &out_array_json,
+                std::size_t &out_rows, std::string &error) const;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// массив, который растёт кусками 64, 128, 256, ... элементов и никогда не переезжает:
+// элемент можно читать без блокировки, пока писатель (под своей блокировкой) добавляет новые
+template <typename T>
+class ChunkedArray
+{
+private:
+    static const unsigned FIRST_CHUNK_BITS = 6;
+    static const unsigned MAX_CHUNKS = 32 - FIRST_CHUNK_BITS;
+
+    std::atomic<T *> chunks[MAX_CHUNKS];
+
+    // кусок k вмещает 64 << k элементов и начинается с индекса (64 << k) - 64
+    static void locate(std::uint32_t index, unsigned &chunk, std::size_t &offset)
+    {
+        std::uint64_t v = static_cast<std::uint64_t>(index) + (1u << FIRST_CHUNK_BITS);
+        unsigned top = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        chunk = top - FIRST_CHUNK_BITS;
+        offset = static_cast<std::size_t>(v - (std::uint64_t(1) << top));
+    }
+
+public:
+    ChunkedArray()
+    {
+        for (auto &chunk : chunks)
+        {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~ChunkedArray()
+    {
+        for (auto &chunk : chunks)
+        {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    ChunkedArray(const ChunkedArray &) = delete;
+    ChunkedArray &operator=(const ChunkedArray &) = delete;
+
+    // для писателя: выделяет кусок при первом обращении
+    T &slot(std::uint32_t index)
+    {
+        unsigned chunk = 0;
+        std::size_t offset = 0;
+        locate(index, chunk, offset);
+        T *items = chunks[chunk].load(std::memory_order_relaxed);
+        if (!items)
+        {
+            items = new T[std::size_t(1) << (FIRST_CHUNK_BITS + chunk)];
+            chunks[chunk].store(items, std::memory_order_release);
+        }
+        return items[offset];
+    }
+
+    // кусок с index уже должен существовать
+    T &operator[](std::uint32_t index)
+    {
+        unsigned chunk = 0;
+        std::size_t offset = 0;
+        locate(index, chunk, offset);
+        return chunks[chunk].load(std::memory_order_acquire)[offset];
+    }
+
+    const T &operator[](std::uint32_t index) const
+    {
+        unsigned chunk = 0;
+        std::size_t offset = 0;
+        locate(index, chunk, offset);
+        return chunks[chunk].load(std::memory_order_acquire)[offset];
+    }
+};
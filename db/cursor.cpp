@@ -0,0 +1,172 @@
+#include "cursor.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "query.h"
+#include "utills.h"
+
+using namespace std;
+
+// неотрицательное целое параметра: 10 или "10"
+static bool parse_count(const string &raw, size_t &out)
+{
+    string value = unquoteJsonValue(raw);
+    if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != string::npos)
+        return false;
+    out = static_cast<size_t>(stoull(value));
+    return true;
+}
+
+bool FindOptions::parse(const string &options_json, const FieldDictionary &dict, FindOptions &out,
+                        string &error)
+{
+    out = FindOptions();
+    string options = trim(options_json);
+    if (options.empty())
+        return true;
+
+    vector<pair<string, string>> fields;
+    if (!splitJsonObject(options, fields))
+    {
+        error = "Invalid options JSON";
+        return false;
+    }
+
+    for (const auto &field : fields)
+    {
+        const string &key = field.first;
+        if (key == "skip" || key == "limit" || key == "batchSize")
+        {
+            size_t value = 0;
+            if (!parse_count(field.second, value))
+            {
+                error = "Option " + key + " must be a non-negative integer";
+                return false;
+            }
+            (key == "skip" ? out.skip : key == "limit" ? out.limit : out.batch_size) = value;
+        }
+        else if (key == "sort")
+        {
+            vector<pair<string, string>> keys;
+            if (!splitJsonObject(field.second, keys))
+            {
+                error = "Option sort must be an object {\"field\": 1 | -1}";
+                return false;
+            }
+            for (const auto &sort_key : keys)
+            {
+                string direction = unquoteJsonValue(sort_key.second);
+                if (direction != "1" && direction != "-1")
+                {
+                    error = "Sort direction for " + sort_key.first + " must be 1 or -1";
+                    return false;
+                }
+                SortKey k;
+                k.is_id = sort_key.first == "_id";
+                if (!k.is_id)
+                    k.field_id = dict.lookup(sort_key.first);
+                k.direction = direction == "1" ? 1 : -1;
+                out.sort.push_back(k);
+            }
+        }
+        else
+        {
+            error = "Unknown find option: " + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FindOptions::parseProjection(const string &projection_json, const FieldDictionary &dict,
+                                  Document::Projection &out, string &error)
+{
+    out = Document::Projection();
+    string projection = trim(projection_json);
+    if (projection.empty())
+        return true;
+
+    vector<pair<string, string>> fields;
+    if (!splitJsonObject(projection, fields))
+    {
+        error = "Invalid projection JSON";
+        return false;
+    }
+
+    bool has_include = false, has_exclude = false;
+    for (const auto &field : fields)
+    {
+        string value = unquoteJsonValue(field.second);
+        bool keep = value == "1" || value == "true";
+        if (!keep && value != "0" && value != "false")
+        {
+            error = "Projection value for " + field.first + " must be 1 or 0";
+            return false;
+        }
+        if (field.first == "_id")
+        {
+            out.with_id = keep;
+            continue;
+        }
+        (keep ? has_include : has_exclude) = true;
+        // поля нет ни в одном документе - выдавать или исключать нечего
+        uint32_t id = dict.lookup(field.first);
+        if (id != FieldDictionary::NO_FIELD)
+            out.field_ids.push_back(id);
+    }
+    if (has_include && has_exclude)
+    {
+        error = "Projection cannot mix included and excluded fields";
+        return false;
+    }
+    out.include = has_include;
+    // {"_id": 1} без других полей - только _id
+    if (!has_exclude && !has_include && out.with_id && !fields.empty())
+        out.include = true;
+    std::sort(out.field_ids.begin(), out.field_ids.end());
+    return true;
+}
+
+DocumentOrder::DocumentOrder(const vector<FindOptions::SortKey> &keys, const FieldDictionary &dict)
+    : keys(keys), dict(dict) {}
+
+// смешанное сравнение запросов ("2" < "10" < "1a" < "2") не даёт порядка для сортировки,
+// поэтому целые отделены от строк
+int compareFieldValues(string_view a, string_view b)
+{
+    int x = 0, y = 0;
+    bool a_int = is_integer_string(a) && parse_int(a, x);
+    bool b_int = is_integer_string(b) && parse_int(b, y);
+    if (a_int != b_int)
+        return a_int ? -1 : 1;
+    if (a_int)
+        return x < y ? -1 : (x > y ? 1 : 0);
+    int cmp = a.compare(b);
+    return cmp < 0 ? -1 : (cmp > 0 ? 1 : 0);
+}
+
+bool DocumentOrder::operator()(const Document *a, const Document *b) const
+{
+    for (const FindOptions::SortKey &key : keys)
+    {
+        int cmp = 0;
+        if (key.is_id)
+        {
+            cmp = compareFieldValues(a->_id, b->_id);
+        }
+        else if (key.field_id != FieldDictionary::NO_FIELD)
+        {
+            string_view va, vb;
+            bool has_a = a->getField(key.field_id, va, dict);
+            bool has_b = b->getField(key.field_id, vb, dict);
+            if (has_a != has_b)
+                cmp = has_a ? 1 : -1;
+            else if (has_a)
+                cmp = compareFieldValues(trim_view(va), trim_view(vb));
+        }
+        if (cmp != 0)
+            return key.direction * cmp < 0;
+    }
+    return compareFieldValues(a->_id, b->_id) < 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "document.h"
+#include "field_dictionary.h"
+
+// параметры выдачи find: {"skip": n, "limit": n, "sort": {"поле": 1 | -1, ...}, "batchSize": n}
+struct FindOptions
+{
+    struct SortKey
+    {
+        bool is_id = false;
+        std::uint32_t field_id = FieldDictionary::NO_FIELD; // NO_FIELD - поля нет ни в одном документе
+        int direction = 1;                                  // 1 - по возрастанию, -1 - по убыванию
+    };
+
+    std::size_t skip = 0;
+    std::size_t limit = 0;      // 0 - без ограничения
+    std::size_t batch_size = 0; // 0 - весь ответ сразу, иначе остаток - через курсор
+    std::vector<SortKey> sort;
+    Document::Projection projection;
+
+    // пустая строка - параметры по умолчанию; false - кривой JSON или неизвестный параметр
+    static bool parse(const std::string &options_json, const FieldDictionary &dict, FindOptions &out,
+                      std::string &error);
+    // {"поле": 1, ...} - только эти поля, {"поле": 0, ...} - все, кроме них; _id выдаётся,
+    // если не указано "_id": 0. Пустая строка или {} - документ целиком
+    static bool parseProjection(const std::string &projection_json, const FieldDictionary &dict,
+                                Document::Projection &out, std::string &error);
+};
+
+// порядок двух значений полей (-1, 0, 1): целые в пределах int - как числа и раньше строк,
+// строки - побайтно; значения уже без пробелов по краям
+int compareFieldValues(std::string_view a, std::string_view b);
+
+// порядок документов по ключам сортировки: целые - как числа и раньше строк, строки -
+// побайтно без пробелов по краям, документ без поля - раньше любого значения;
+// при равенстве - по _id, чтобы страницы не зависели от порядка обхода
+class DocumentOrder
+{
+private:
+    const std::vector<FindOptions::SortKey> &keys;
+    const FieldDictionary &dict;
+
+public:
+    DocumentOrder(const std::vector<FindOptions::SortKey> &keys, const FieldDictionary &dict);
+    bool operator()(const Document *a, const Document *b) const; // a идёт раньше b
+};
+
+// серверный курсор find: _id оставшихся документов ответа, отдаются getMore порциями.
+// Документ ищется заново при выдаче: курсор не держит удалённые документы в памяти,
+// а удалённые после открытия просто пропускаются
+struct Cursor
+{
+    std::vector<std::string> ids;
+    std::size_t pos = 0;
+    std::size_t batch_size = 0;
+    Document::Projection projection;
+    std::chrono::steady_clock::time_point last_used;
+};
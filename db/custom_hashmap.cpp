@@ -1,199 +1,365 @@
 #include "custom_hashmap.h"
 #include "utills.h"
 
-using namespace std;
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
 
-ListNode::ListNode(const string &k, Document *v)
-    : key(k), value(v), next(nullptr) {}
+using namespace std;
 
-CustomList::CustomList() : head(nullptr) {}
-CustomList::~CustomList()
+static inline size_t round_up_pow2(size_t n)
 {
-    ListNode *current = head;
-    while (current)
+    size_t p = 1;
+    while (p < n)
     {
-        ListNode *next = current->next;
-        delete current;
-        current = next;
+        p <<= 1;
     }
+    return p;
 }
-ListNode *CustomList::find(const ::string &key) const
+
+// calloc/malloc больших блоков отдаёт ленивые страницы mmap:
+// выделение новой таблицы не трогает всю память сразу
+void CustomHashMap::alloc_table(HashTable &t, size_t capacity)
 {
-    ListNode *current = head;
-    while (current)
+    t.capacity = round_up_pow2(capacity);
+    t.size = 0;
+    t.meta = static_cast<SlotMeta *>(calloc(t.capacity, sizeof(SlotMeta)));
+    t.slots = static_cast<HashSlot *>(malloc(t.capacity * sizeof(HashSlot)));
+    if (!t.meta || !t.slots)
     {
-        if (current->key == key)
-        {
-            return current;
-        }
-        current = current->next;
+        free(t.meta);
+        free(t.slots);
+        throw bad_alloc();
     }
-    return nullptr;
 }
-Document *CustomList::remove(const ::string &key)
-{
-    ListNode *current = head;
-    ListNode *prev = nullptr;
 
-    while (current)
+void CustomHashMap::free_table(HashTable &t, bool delete_values)
+{
+    // после переноса таблица пуста - не проходим её целиком
+    for (size_t i = 0; t.size > 0 && i < t.capacity; i++)
     {
-        if (current->key == key)
+        if (t.meta[i].dist != 0)
         {
-            if (prev)
+            if (delete_values)
             {
-                prev->next = current->next;
+                delete t.slots[i].value;
             }
-            else
-            {
-                head = current->next;
-            }
-
-            Document *removed_value = current->value;
-            current->value = nullptr;
-            delete current;
-            return removed_value;
+            t.slots[i].~HashSlot();
         }
-        prev = current;
-        current = current->next;
     }
-    return nullptr;
+    free(t.meta);
+    free(t.slots);
+    t.meta = nullptr;
+    t.slots = nullptr;
+    t.capacity = 0;
+    t.size = 0;
 }
 
 CustomHashMap::CustomHashMap(size_t initial_capacity)
+    : old{nullptr, nullptr, 0, 0}, migrate_pos(0)
 {
     if (initial_capacity == 0)
     {
         initial_capacity = DEFAULT_CAPACITY;
     }
-    capacity = initial_capacity;
-    size = 0;
-    buckets = new CustomList[capacity];
+    alloc_table(table, initial_capacity);
 }
 
 CustomHashMap::~CustomHashMap()
 {
-    for (size_t i = 0; i < capacity; i++)
+    free_table(table, true);
+    free_table(old, true);
+}
+
+// 64-битный хеш в стиле wyhash: по 8 байт за шаг, перемешивание через 128-битное умножение
+static inline uint64_t mum(uint64_t a, uint64_t b)
+{
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+uint64_t CustomHashMap::_hash(const char *data, size_t len)
+{
+    const uint64_t k0 = 0xa0761d6478bd642fULL;
+    const uint64_t k1 = 0xe7037ed1a0b428dbULL;
+    const uint64_t k2 = 0x8ebc6af09c88c6e3ULL;
+
+    uint64_t h = k0 ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
     {
-        ListNode *current = buckets[i].head;
+        uint64_t block;
+        memcpy(&block, data + i, 8);
+        h = mum(h ^ block, k1);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, len - i);
+    h = mum(h ^ tail, k2);
+    return mum(h, k1 ^ len);
+}
 
-        while (current)
+// индекс ячейки с ключом или t.capacity, если ключа нет
+size_t CustomHashMap::find_index(const HashTable &t, const char *key, size_t len, uint64_t h)
+{
+    if (t.size == 0)
+        return t.capacity;
+
+    size_t mask = t.capacity - 1;
+    uint32_t h32 = static_cast<uint32_t>(h);
+    size_t index = h32 & mask;
+    uint32_t dist = 1;
+
+    // инвариант Robin Hood: дальше ячейки с меньшим расстоянием ключа быть не может
+    while (t.meta[index].dist >= dist)
+    {
+        if (t.meta[index].hash == h32)
+        {
+            const string &k = t.slots[index].key;
+            if (k.size() == len && memcmp(k.data(), key, len) == 0)
+            {
+                return index;
+            }
+        }
+        index = (index + 1) & mask;
+        dist++;
+    }
+    return t.capacity;
+}
+
+// вставка заведомо нового ключа: "бедный" (дальний от дома) вытесняет "богатого";
+// для индекса хватает 32 бит хеша (таблицы меньше 2^32 ячеек)
+void CustomHashMap::insert_slot(HashTable &t, string &&key, Document *value, uint32_t h)
+{
+    size_t mask = t.capacity - 1;
+    size_t index = h & mask;
+
+    HashSlot entry{move(key), value};
+    SlotMeta entry_meta{h, 1};
+
+    while (true)
+    {
+        SlotMeta &m = t.meta[index];
+        if (m.dist == 0)
         {
-            delete current->value;
-            current = current->next;
+            new (&t.slots[index]) HashSlot(move(entry));
+            m = entry_meta;
+            t.size++;
+            return;
         }
+        if (m.dist < entry_meta.dist)
+        {
+            swap(t.slots[index], entry);
+            swap(m, entry_meta);
+        }
+        index = (index + 1) & mask;
+        entry_meta.dist++;
     }
-    delete[] buckets;
 }
 
-size_t CustomHashMap::_hash(const ::string &key) const
-{ // вычисление индекса
-    size_t hash_value = 0;
-    unsigned int prime = 31;
-    for (unsigned char c : key)
+// удаление обратным сдвигом вместо надгробий: подтягиваем хвост кластера на шаг назад
+void CustomHashMap::erase_at(HashTable &t, size_t index)
+{
+    size_t mask = t.capacity - 1;
+    size_t next = (index + 1) & mask;
+    while (t.meta[next].dist > 1)
     {
-        hash_value = hash_value * prime + c;
+        t.slots[index] = move(t.slots[next]);
+        t.meta[index] = t.meta[next];
+        t.meta[index].dist--;
+        index = next;
+        next = (next + 1) & mask;
     }
-    return hash_value % capacity;
+    t.slots[index].~HashSlot();
+    t.meta[index].dist = 0;
+    t.size--;
 }
 
-void CustomHashMap::resize_rehash()
+// начало расширения: старая таблица остаётся доступной для поиска,
+// ключи переносятся из неё понемногу в каждой операции
+void CustomHashMap::start_grow(size_t new_capacity)
 {
-    // сохраняем старые значения
-    size_t old_capacity = capacity;
-    CustomList *old_buckets = buckets;
+    finish_migration(); // предыдущее расширение к этому моменту почти всегда уже завершено
+    old = table;
+    alloc_table(table, new_capacity);
+    migrate_pos = 0;
+}
 
-    capacity *= 2;
-    size = 0;
-    buckets = new CustomList[capacity];
+void CustomHashMap::migrate_step(size_t max_items)
+{
+    if (!old.meta)
+        return;
 
-    for (size_t i = 0; i < old_capacity; ++i)
+    size_t mask = old.capacity - 1;
+    size_t moved = 0;
+    size_t scanned = 0;
+    // удаление обратным сдвигом держит old корректной таблицей Robin Hood,
+    // поэтому поиск в ней работает на любом шаге переноса
+    while (old.size > 0 && moved < max_items && scanned < MIGRATE_SCAN)
     {
-        ListNode *current = old_buckets[i].head;
-        while (current)
+        if (old.meta[migrate_pos].dist != 0)
+        {
+            HashSlot &slot = old.slots[migrate_pos];
+            insert_slot(table, move(slot.key), slot.value, old.meta[migrate_pos].hash);
+            erase_at(old, migrate_pos); // на место migrate_pos мог сдвинуться следующий ключ
+            moved++;
+        }
+        else
         {
-            string key = current->key;
-            Document *value = current->value;
+            migrate_pos = (migrate_pos + 1) & mask;
+            scanned++;
+        }
+    }
 
-            current->value = nullptr;
+    if (old.size == 0)
+    {
+        free_table(old, false);
+        migrate_pos = 0;
+    }
+}
 
-            // кладём в новую таблицу
-            put(key, value, false);
+void CustomHashMap::finish_migration()
+{
+    while (old.meta)
+    {
+        migrate_step(old.size + 1);
+    }
+}
 
-            current = current->next;
-        }
+void CustomHashMap::rehash_to(size_t new_capacity)
+{
+    finish_migration();
+    HashTable prev = table;
+    alloc_table(table, new_capacity);
+    for (size_t i = 0; i < prev.capacity; ++i)
+    {
+        if (prev.meta[i].dist == 0)
+            continue;
+        insert_slot(table, move(prev.slots[i].key), prev.slots[i].value, prev.meta[i].hash);
     }
-    delete[] old_buckets; // удаление старыъ
+    free_table(prev, false);
 }
 
-void CustomHashMap::put(const ::string &key, Document *value, bool delete_on_update)
+void CustomHashMap::reserve(size_t expected_size)
 {
-    string cleaned_key = trim(key);
-    if ((float)size / capacity >= LOAD_FACTOR)
+    size_t target = table.capacity;
+    while ((float)expected_size / target >= LOAD_FACTOR)
+    {
+        target *= 2;
+    }
+    if (target > table.capacity)
     {
-        resize_rehash();
+        rehash_to(target);
     }
+}
 
-    size_t index = _hash(cleaned_key);
-    ListNode *node = buckets[index].find(cleaned_key); // поиск узла в бакете
+void CustomHashMap::put(const string &key, Document *value, bool delete_on_update)
+{
+    if (needs_trim(key))
+    {
+        put(trim(key), value, delete_on_update);
+        return;
+    }
+
+    migrate_step(MIGRATE_ITEMS);
 
-    if (node)
+    uint64_t h = _hash(key.data(), key.size());
+    HashTable *owner = &table;
+    size_t index = find_index(table, key.data(), key.size(), h);
+    if (index == table.capacity && old.meta)
     {
-        if (delete_on_update)
+        owner = &old;
+        index = find_index(old, key.data(), key.size(), h);
+    }
+    if (index != owner->capacity)
+    {
+        HashSlot &slot = owner->slots[index];
+        if (delete_on_update && slot.value != value)
         {
-            delete node->value;
+            delete slot.value;
         }
-        node->value = value;
+        slot.value = value;
         return;
     }
-    else
+
+    // ключи old ещё займут место в table - учитываем их в заполненности
+    if ((float)(table.size + old.size + 1) / table.capacity >= LOAD_FACTOR)
     {
-        ListNode *new_node = new ListNode(cleaned_key, value);
-        new_node->next = buckets[index].head;
-        buckets[index].head = new_node;
-        size++;
+        start_grow(table.capacity * 2);
     }
+    insert_slot(table, string(key), value, static_cast<uint32_t>(h));
 }
 
-Document *CustomHashMap::get(const ::string &key) const
+Document *CustomHashMap::get(const string &key) const
 {
-    string cleaned_key = trim(key);
-    size_t index = _hash(cleaned_key);
-    ListNode *node = buckets[index].find(cleaned_key);
-    if (node)
+    if (needs_trim(key))
     {
-        return node->value;
+        return get(trim(key));
     }
-    else
+    uint64_t h = _hash(key.data(), key.size());
+    size_t index = find_index(table, key.data(), key.size(), h);
+    if (index != table.capacity)
+        return table.slots[index].value;
+    if (old.meta)
     {
-        return nullptr;
+        index = find_index(old, key.data(), key.size(), h);
+        if (index != old.capacity)
+            return old.slots[index].value;
     }
+    return nullptr;
 }
 
-Document *CustomHashMap::remove(const ::string &key)
+Document *CustomHashMap::remove(const string &key)
 {
-    string cleaned_key = trim(key);
-    size_t index = _hash(cleaned_key);
-    Document *removed = buckets[index].remove(cleaned_key);
-    if (removed != nullptr)
-        size--;
+    if (needs_trim(key))
+    {
+        return remove(trim(key));
+    }
+
+    migrate_step(MIGRATE_ITEMS);
+
+    uint64_t h = _hash(key.data(), key.size());
+    HashTable *owner = &table;
+    size_t index = find_index(table, key.data(), key.size(), h);
+    if (index == table.capacity && old.meta)
+    {
+        owner = &old;
+        index = find_index(old, key.data(), key.size(), h);
+    }
+    if (index == owner->capacity)
+        return nullptr;
+
+    Document *removed = owner->slots[index].value;
+    erase_at(*owner, index);
     return removed;
 }
 
 size_t CustomHashMap::getSize() const
 {
-    return size;
+    return table.size + old.size;
+}
+
+bool CustomHashMap::isMigrating() const
+{
+    return old.meta != nullptr;
 }
 
 size_t CustomHashMap::getCapacity() const
 {
-    return capacity;
+    return table.capacity + old.capacity;
 }
 
-ListNode *CustomHashMap::getBucketHead(size_t index) const
+const HashSlot *CustomHashMap::getSlot(size_t index) const
 {
-    if (index < capacity)
+    const HashTable *t = &table;
+    if (index >= table.capacity)
+    {
+        t = &old;
+        index -= table.capacity;
+    }
+    if (index < t->capacity && t->meta[index].dist != 0)
     {
-        return buckets[index].head;
+        return &t->slots[index];
     }
     return nullptr;
 }
@@ -1,49 +1,76 @@
+#pragma once
+
 #include <string>
+#include <cstdint>
 #include "document.h"
 
-struct ListNode
+// ячейка таблицы с открытой адресацией (Robin Hood)
+struct HashSlot
 {
     std::string key;
     Document *value;
-    ListNode *next;
-
-    ListNode(const std::string &k, Document *v);
 };
-class CustomList
-{
-public:
-    ListNode *head;
 
-    CustomList();
-    ~CustomList();
+// служебные данные ячейки лежат отдельным плотным массивом:
+// пробирование читает только их, до строки ключа доходим при совпадении хеша
+struct SlotMeta
+{
+    std::uint32_t hash; // младшие 32 бита хеша
+    std::uint32_t dist; // 0 - ячейка пуста, иначе расстояние от домашней ячейки + 1
+};
 
-    ListNode *find(const std::string &key) const;
-    Document *remove(const std::string &key);
+// одна таблица: meta обнулена calloc, slots - сырая память,
+// объект HashSlot живёт только в занятых ячейках
+struct HashTable
+{
+    SlotMeta *meta;
+    HashSlot *slots;
+    size_t capacity; // всегда степень двойки
+    size_t size;
 };
 
 class CustomHashMap
 {
 private:
-    CustomList *buckets; // цепочки
-    size_t capacity;
-    size_t size;
+    HashTable table;    // основная таблица, сюда идут все вставки
+    HashTable old;      // во время расширения - предыдущая таблица, иначе пустая
+    size_t migrate_pos; // откуда продолжать перенос из old
 
     static const size_t DEFAULT_CAPACITY = 16;
-    static constexpr float LOAD_FACTOR = 0.75f;
+    static constexpr float LOAD_FACTOR = 0.875f;
+    // за одну операцию переносим не больше MIGRATE_ITEMS ключей
+    // и просматриваем не больше MIGRATE_SCAN пустых ячеек
+    static const size_t MIGRATE_ITEMS = 16;
+    static const size_t MIGRATE_SCAN = 128;
 
-    size_t _hash(const std::string &key) const;
-    void resize_rehash();
+    static std::uint64_t _hash(const char *data, size_t len);
+    static void alloc_table(HashTable &t, size_t capacity);
+    static void free_table(HashTable &t, bool delete_values);
+    static size_t find_index(const HashTable &t, const char *key, size_t len, std::uint64_t h);
+    static void insert_slot(HashTable &t, std::string &&key, Document *value, std::uint32_t h);
+    static void erase_at(HashTable &t, size_t index);
+
+    void start_grow(size_t new_capacity);
+    void migrate_step(size_t max_items);
+    void finish_migration();
+    void rehash_to(size_t new_capacity);
 
 public:
     CustomHashMap(size_t initial_capacity = DEFAULT_CAPACITY);
     ~CustomHashMap();
+    CustomHashMap(const CustomHashMap &) = delete;
+    CustomHashMap &operator=(const CustomHashMap &) = delete;
 
     void put(const std::string &key, Document *value, bool delete_on_update = true);
     Document *get(const std::string &key) const;
     Document *remove(const std::string &key);
+    void reserve(size_t expected_size); // заранее расширить под expected_size ключей (сразу, не по шагам)
 
     size_t getSize() const;
-    size_t getCapacity() const;
+    bool isMigrating() const;
 
-    ListNode *getBucketHead(size_t index) const;
+    // обход: ячейки 0..getCapacity()-1, nullptr для пустых;
+    // во время расширения индексы покрывают обе таблицы
+    size_t getCapacity() const;
+    const HashSlot *getSlot(size_t index) const;
 };
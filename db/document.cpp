@@ -1,54 +1,299 @@
 #include "document.h"
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
 
 using namespace std;
 
-Document::Document(string id) : _id(id)
+Document::Document(string id) : _id(id), fields(nullptr)
 { // _id = id
 }
 
-void Document::addField(const string &key, const string &value) // добавление файла
+Document::~Document()
 {
-    for (size_t i = 0; i < keys.getSize(); i++)
+    free(fields);
+}
+
+uint32_t Document::count() const
+{
+    if (!fields)
+        return 0;
+    uint32_t n;
+    memcpy(&n, fields, sizeof(n));
+    return n;
+}
+
+const uint32_t *Document::offsets() const
+{
+    return reinterpret_cast<const uint32_t *>(fields + sizeof(uint32_t));
+}
+
+const char *Document::bytes() const
+{
+    return fields + sizeof(uint32_t) * (1 + 2 * count());
+}
+
+// собираем новый блок целиком и только потом освобождаем старый:
+// list может ссылаться на байты старого блока
+void Document::setFieldIds(const FieldIdList &list, FieldDictionary &dict)
+{
+    // повтор ключа заменяет значение на месте первого вхождения, как addField
+    FieldIdList unique_list;
+    unique_list.reserve(list.size());
+    for (const auto &field : list)
+    {
+        bool replaced = false;
+        for (auto &existing : unique_list)
+        {
+            if (existing.first == field.first)
+            {
+                existing.second = field.second;
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced)
+            unique_list.push_back(field);
+    }
+
+    char *block = nullptr;
+    if (!unique_list.empty())
+    {
+        // сначала коды словарей: от них зависит размер блока;
+        // для обычных документов (до 32 полей) без выделения памяти
+        uint16_t small_codes[32];
+        uint8_t small_encoded[32];
+        vector<uint16_t> big_codes;
+        vector<uint8_t> big_encoded;
+        uint16_t *codes = small_codes;
+        uint8_t *encoded = small_encoded;
+        if (unique_list.size() > 32)
+        {
+            big_codes.resize(unique_list.size());
+            big_encoded.resize(unique_list.size());
+            codes = big_codes.data();
+            encoded = big_encoded.data();
+        }
+        size_t data_size = 0;
+        for (size_t i = 0; i < unique_list.size(); i++)
+        {
+            const auto &field = unique_list[i];
+            encoded[i] = dict.values(field.first).store(field.second, codes[i]);
+            data_size += encoded[i] ? sizeof(uint16_t) : field.second.size();
+        }
+
+        uint32_t n = static_cast<uint32_t>(unique_list.size());
+        size_t header = sizeof(uint32_t) * (1 + 2 * static_cast<size_t>(n));
+        block = static_cast<char *>(malloc(header + data_size));
+        if (!block)
+            throw bad_alloc();
+
+        memcpy(block, &n, sizeof(n));
+        uint32_t *offs = reinterpret_cast<uint32_t *>(block + sizeof(uint32_t));
+        char *data = block + header;
+        uint32_t pos = 0;
+        for (size_t i = 0; i < unique_list.size(); i++)
+        {
+            const auto &field = unique_list[i];
+            if (encoded[i])
+            {
+                offs[2 * i] = field.first | ENCODED;
+                memcpy(data + pos, &codes[i], sizeof(uint16_t));
+                pos += sizeof(uint16_t);
+            }
+            else
+            {
+                offs[2 * i] = field.first;
+                memcpy(data + pos, field.second.data(), field.second.size());
+                pos += static_cast<uint32_t>(field.second.size());
+            }
+            offs[2 * i + 1] = pos;
+        }
+    }
+
+    release_block(fields, dict);
+    free(fields);
+    fields = block;
+}
+
+void Document::release_block(const char *block, FieldDictionary &dict) const
+{
+    if (!block)
+        return;
+    uint32_t n;
+    memcpy(&n, block, sizeof(n));
+    const uint32_t *offs = reinterpret_cast<const uint32_t *>(block + sizeof(uint32_t));
+    const char *data = block + sizeof(uint32_t) * (1 + 2 * static_cast<size_t>(n));
+    for (uint32_t i = 0; i < n; i++)
     {
-        if (keys[i] == key)
+        bool encoded = (offs[2 * i] & ENCODED) != 0;
+        uint16_t code = 0;
+        if (encoded)
         {
-            values[i] = value;
-            return;
+            memcpy(&code, data + (i == 0 ? 0 : offs[2 * i - 1]), sizeof(code));
         }
+        dict.values(offs[2 * i] & ~ENCODED).drop(encoded, code);
+    }
+}
+
+void Document::releaseValues(FieldDictionary &dict)
+{
+    release_block(fields, dict);
+    free(fields);
+    fields = nullptr;
+}
+
+void Document::setFields(const FieldList &list, FieldDictionary &dict)
+{
+    FieldIdList ids;
+    ids.reserve(list.size());
+    for (const auto &field : list)
+    {
+        ids.emplace_back(dict.intern(field.first), field.second);
+    }
+    setFieldIds(ids, dict);
+}
+
+void Document::addField(const string &key, const string &value, FieldDictionary &dict) // добавление файла
+{
+    FieldIdList list;
+    list.reserve(fieldCount() + 1);
+    for (size_t i = 0; i < fieldCount(); i++)
+    {
+        list.emplace_back(fieldId(i), fieldValue(i, dict));
     }
-    keys.push(key);
-    values.push(value);
+    list.emplace_back(dict.intern(key), value);
+    setFieldIds(list, dict);
 }
-bool Document::getField(const string &key, string &out) const // ищем значение по ключу
-{                                                             // проверка на наличие ключа
-    for (size_t i = 0; i < keys.getSize(); i++)
+
+bool Document::getFieldRef(uint32_t field_id, FieldRef &out) const // ищем значение по номеру ключа
+{
+    uint32_t n = count();
+    if (n == 0)
+        return false;
+    const uint32_t *offs = offsets();
+    for (uint32_t i = 0; i < n; i++)
     {
-        if (keys[i] == key)
+        if ((offs[2 * i] & ~ENCODED) == field_id)
         {
-            out = values[i];
+            uint32_t start = i == 0 ? 0 : offs[2 * i - 1];
+            out.encoded = (offs[2 * i] & ENCODED) != 0;
+            if (out.encoded)
+            {
+                memcpy(&out.code, bytes() + start, sizeof(out.code));
+            }
+            else
+            {
+                out.raw = string_view(bytes() + start, offs[2 * i + 1] - start);
+            }
             return true;
         }
     }
     return false;
 }
 
-string Document::serialize() const // создание json
+bool Document::getField(uint32_t field_id, string_view &out, const FieldDictionary &dict) const
+{
+    FieldRef ref;
+    if (!getFieldRef(field_id, ref))
+        return false;
+    out = ref.encoded ? string_view(dict.values(field_id).decode(ref.code)) : ref.raw;
+    return true;
+}
+
+bool Document::getField(const string &key, string &out, const FieldDictionary &dict) const // проверка на наличие ключа
+{
+    uint32_t field_id = dict.lookup(key);
+    string_view value;
+    if (field_id == FieldDictionary::NO_FIELD || !getField(field_id, value, dict))
+        return false;
+    out.assign(value.data(), value.size());
+    return true;
+}
+
+size_t Document::fieldCount() const
+{
+    return count();
+}
+
+size_t Document::memoryBytes() const
+{
+    size_t n = count();
+    size_t block = fields ? sizeof(uint32_t) * (1 + 2 * n) + (n ? offsets()[2 * n - 1] : 0) : 0;
+    return sizeof(Document) + _id.size() + block;
+}
+
+uint32_t Document::fieldId(size_t index) const
+{
+    return offsets()[2 * index] & ~ENCODED;
+}
+
+const string &Document::fieldKey(size_t index, const FieldDictionary &dict) const
+{
+    return dict.name(fieldId(index));
+}
+
+string_view Document::fieldValue(size_t index, const FieldDictionary &dict) const
+{
+    const uint32_t *offs = offsets();
+    uint32_t start = index == 0 ? 0 : offs[2 * index - 1];
+    if (offs[2 * index] & ENCODED)
+    {
+        uint16_t code;
+        memcpy(&code, bytes() + start, sizeof(code));
+        return dict.values(fieldId(index)).decode(code);
+    }
+    return string_view(bytes() + start, offs[2 * index + 1] - start);
+}
+
+bool Document::Projection::keeps(uint32_t field_id) const
 {
-    string json = "{";
-    json += "\"_id\":\"" + _id + "\"";
+    bool listed = binary_search(field_ids.begin(), field_ids.end(), field_id);
+    return listed == include;
+}
 
-    for (size_t i = 0; i < keys.getSize(); i++)
+string Document::serialize(const FieldDictionary &dict) const // создание json
+{
+    string json;
+    // значение и имя поля в среднем ~12 байт плюс 6 символов кавычек, двоеточия и запятой
+    json.reserve(_id.size() + 10 + 30 * count());
+    appendJson(json, dict);
+    return json;
+}
+
+void Document::appendJson(string &out, const FieldDictionary &dict, const Projection *projection) const
+{
+    uint32_t n = count();
+    bool first = true;
+    out += '{';
+    if (!projection || projection->with_id)
+    {
+        out += "\"_id\":\"";
+        out += _id;
+        out += '"';
+        first = false;
+    }
+
+    for (size_t i = 0; i < n; i++)
     { // проверка ключ ли id
-        if (keys[i] == "_id")
+        if (projection && !projection->keeps(fieldId(i)))
+            continue;
+        const string &key = fieldKey(i, dict);
+        if (key == "_id")
             continue;
-        json += ",\"" + keys[i] + "\":\"" + values[i] + "\"";
+        out += first ? "\"" : ",\"";
+        out += key;
+        out += "\":\"";
+        out += fieldValue(i, dict);
+        out += '"';
+        first = false;
     }
-    json += "}";
-    return json;
+    out += '}';
 }
 
-Document *Document::deserialize(const std::string &json_line) // мини парсер
+Document *Document::deserialize(const std::string &json_line, FieldDictionary &dict) // мини парсер
 {
     string s = trim(json_line); // очищаем строку
     if (s.size() < 2 || s.front() != '{' || s.back() != '}')
@@ -58,6 +303,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
     }
 
     Document *doc = new Document();
+    FieldList list; // ссылки в s, блок полей собирается один раз в конце
     size_t i = 1;
     while (i < s.size() - 1)
     {
@@ -83,7 +329,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
             return nullptr;
         }
 
-        string key = s.substr(key_start, key_end - key_start);
+        string_view key(s.data() + key_start, key_end - key_start);
         i = key_end + 1;
 
         while (i < s.size() - 1 && (s[i] == ' ' || s[i] == '\t' || s[i] == ',' || s[i] == '\n' || s[i] == '\r'))
@@ -101,7 +347,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
             ++i;
 
         // поиск значений
-        string value;
+        string_view value;
         if (s[i] == '"')
         {
             size_t val_start = i + 1;
@@ -113,7 +359,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
                 return nullptr;
             }
 
-            value = s.substr(val_start, val_end - val_start);
+            value = string_view(s.data() + val_start, val_end - val_start);
             i = val_end + 1;
         }
 
@@ -128,8 +374,10 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
                 delete doc;
                 return nullptr;
             }
-            string raw = s.substr(val_start, val_end - val_start);
-            value = trim(raw);
+            size_t first = s.find_first_not_of(" \t\n\r", val_start);
+            size_t last = s.find_last_not_of(" \t\n\r", val_end - 1);
+            if (first < val_end && last != string::npos && last >= first)
+                value = string_view(s.data() + first, last - first + 1);
             i = val_end;
         }
 
@@ -137,19 +385,19 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
         {
             if (doc->_id.empty())
             {
-                doc->_id = value;
+                doc->_id = string(value);
             }
         }
         else
         {
-            doc->addField(key, value);
+            list.emplace_back(key, value);
         }
     }
-
     if (doc->_id.empty())
     {
         delete doc;
         return nullptr;
     }
+    doc->setFields(list, dict);
     return doc;
 }
\ No newline at end of file
@@ -1,7 +1,11 @@
 #pragma once
 
 #include <string>
-#include "myarray.h"
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "field_dictionary.h"
 #include "utills.h"
 
 class Document
@@ -9,17 +13,64 @@ class Document
 public:
     std::string _id; // id документа
 private:
-    myarray keys; // ключи(name, city)
-    myarray values;
+    // все поля одним блоком точного размера (nullptr - полей нет):
+    //   u32 число полей | на каждое поле u32 номер имени, u32 конец значения | байты значений
+    //   имена полей - в FieldDictionary базы, документ хранит только номера;
+    //   старший бит номера - значение закодировано словарём поля (в байтах 2-байтовый код)
+    static const std::uint32_t ENCODED = 0x80000000u;
+    char *fields;
+
+    std::uint32_t count() const;
+    const std::uint32_t *offsets() const;
+    const char *bytes() const;
+    void release_block(const char *block, FieldDictionary &dict) const;
 
 public:
+    using FieldList = std::vector<std::pair<std::string_view, std::string_view>>; // имя, значение
+    using FieldIdList = std::vector<std::pair<std::uint32_t, std::string_view>>;  // номер имени, значение
+
+    // какие поля выдавать в ответе: перечисленные или все, кроме перечисленных
+    struct Projection
+    {
+        bool include = false;                 // false - исключить перечисленные (пусто - все поля)
+        bool with_id = true;
+        std::vector<std::uint32_t> field_ids; // номера имён по возрастанию
+        bool keeps(std::uint32_t field_id) const;
+    };
+
+    // значение поля как оно лежит в документе
+    struct FieldRef
+    {
+        bool encoded;
+        std::uint16_t code;    // если encoded
+        std::string_view raw;  // если !encoded
+    };
+
     Document(std::string id = ""); // конструктор задает _id
+    ~Document();
     Document(const Document &) = delete;
     Document &operator=(const Document &) = delete; // запрещает копирование, не дает создать 2 файл
 
-    void addField(const std::string &key, const std::string &value); // добавление полей
-    bool getField(const std::string &key, std::string &out) const;   // проверка ключа
+    void addField(const std::string &key, const std::string &value, FieldDictionary &dict); // добавление полей
+    bool getField(const std::string &key, std::string &out, const FieldDictionary &dict) const;
+    bool getField(std::uint32_t field_id, std::string_view &out, const FieldDictionary &dict) const;
+    bool getFieldRef(std::uint32_t field_id, FieldRef &out) const; // без раскодирования
+    // заменить все поля разом (повтор ключа - побеждает последнее значение)
+    void setFields(const FieldList &list, FieldDictionary &dict);
+    void setFieldIds(const FieldIdList &list, FieldDictionary &dict);
+    // снять ссылки на словари значений; вызывать перед delete документа базы
+    void releaseValues(FieldDictionary &dict);
+
+    // обход полей (без _id); string_view живут, пока документ не меняется
+    std::size_t fieldCount() const;
+    // примерный объём в памяти: объект, _id и блок полей (словари значений не считаются)
+    std::size_t memoryBytes() const;
+    std::uint32_t fieldId(std::size_t index) const;
+    const std::string &fieldKey(std::size_t index, const FieldDictionary &dict) const;
+    std::string_view fieldValue(std::size_t index, const FieldDictionary &dict) const;
 
-    std::string serialize() const; // возвращаем файл строкой
-    static Document *deserialize(const std::string &json_line);
-};
\ No newline at end of file
+    std::string serialize(const FieldDictionary &dict) const; // возвращаем файл строкой
+    // JSON документа дописывается в out (без промежуточной строки); projection nullptr - все поля
+    void appendJson(std::string &out, const FieldDictionary &dict, const Projection *projection = nullptr) const;
+    static Document *deserialize(const std::string &json_line, FieldDictionary &dict);
+};
@@ -0,0 +1,57 @@
+#include "field_dictionary.h"
+
+#include <mutex>
+
+using namespace std;
+
+FieldDictionary::FieldDictionary() : count(0) {}
+
+uint32_t FieldDictionary::lookup(string_view name) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+    auto it = ids.find(string(name));
+    return it == ids.end() ? NO_FIELD : it->second;
+}
+
+uint32_t FieldDictionary::intern(string_view name)
+{
+    string key(name);
+    {
+        shared_lock<shared_mutex> lock(mtx);
+        auto it = ids.find(key);
+        if (it != ids.end())
+            return it->second;
+    }
+
+    unique_lock<shared_mutex> lock(mtx);
+    auto it = ids.find(key);
+    if (it != ids.end())
+        return it->second; // успел добавить другой поток
+
+    uint32_t id = count.load(memory_order_relaxed);
+    slots.slot(id).name = key;
+    count.store(id + 1, memory_order_release);
+    ids.emplace(move(key), id);
+    return id;
+}
+
+// id берётся из документа или запроса, созданного после intern(): запись уже заполнена
+const string &FieldDictionary::name(uint32_t id) const
+{
+    return slots[id].name;
+}
+
+ValueDictionary &FieldDictionary::values(uint32_t id)
+{
+    return slots[id].values;
+}
+
+const ValueDictionary &FieldDictionary::values(uint32_t id) const
+{
+    return slots[id].values;
+}
+
+size_t FieldDictionary::size() const
+{
+    return count.load(memory_order_acquire);
+}
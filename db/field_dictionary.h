@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+#include "chunked_array.h"
+#include "value_dictionary.h"
+
+// словарь имён полей базы: документ хранит вместо ключа его номер
+//   номера выдаются подряд с 0 и не переиспользуются;
+//   записи не переезжают (ChunkedArray), поэтому name() и values() работают без блокировки,
+//   пока другой поток добавляет новые имена
+class FieldDictionary
+{
+private:
+    struct FieldSlot
+    {
+        std::string name;
+        ValueDictionary values; // словарь значений этого поля
+    };
+
+    ChunkedArray<FieldSlot> slots;
+    std::atomic<std::uint32_t> count;
+    std::unordered_map<std::string, std::uint32_t> ids;
+    mutable std::shared_mutex mtx; // охраняет ids и выдачу номеров
+
+public:
+    static const std::uint32_t NO_FIELD = UINT32_MAX;
+
+    FieldDictionary();
+    FieldDictionary(const FieldDictionary &) = delete;
+    FieldDictionary &operator=(const FieldDictionary &) = delete;
+
+    std::uint32_t intern(std::string_view name);       // номер имени, новое имя добавляется
+    std::uint32_t lookup(std::string_view name) const; // NO_FIELD, если такого имени нет
+    const std::string &name(std::uint32_t id) const;
+    ValueDictionary &values(std::uint32_t id);
+    const ValueDictionary &values(std::uint32_t id) const;
+    std::size_t size() const;
+};
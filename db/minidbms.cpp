@@ -1,18 +1,60 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <climits>
+#include <cstdint>
+
+#include <unistd.h>
 
 #include "minidbms.h"
 #include "document.h"
+#include "snapshot.h"
 
 using namespace std;
 
+const char MiniDBMS::PARTITION_FIELD[] = "timestamp";
+const size_t MiniDBMS::MAX_CURSORS;
+const int MiniDBMS::CURSOR_IDLE_SEC;
+const size_t MiniDBMS::DROP_SLICE_DOCS;
+const size_t MiniDBMS::SCAN_CHUNK_DOCS;
+
 MiniDBMS::MiniDBMS(const string &db_name, const string &db_folder)
-    : db_name(db_name), db_folder(db_folder), data_store(), next_id(1) {}
-MiniDBMS::~MiniDBMS() {} // у хэша есть свой тут не нужен
+    : db_name(db_name), db_folder(db_folder), data_store(),
+      segments(field_names.intern(PARTITION_FIELD), PartitionUnit::Day), legacy_snapshot(false),
+      retention_hours(0), retention_mb(0),
+      next_id(1), wal_enabled(true),
+      db_mutex(nullptr), maintenance_stop(false),
+      checkpoint_wal_bytes(DEFAULT_CHECKPOINT_WAL_BYTES),
+      checkpoint_interval_sec(DEFAULT_CHECKPOINT_INTERVAL_SEC),
+      checkpoint_running(false), next_cursor_id(1) {}
+
+MiniDBMS::~MiniDBMS()
+{
+    stopMaintenance(); // документы в хэше удалит его деструктор
+    cursors.clear();
+    flush_graveyard();
+}
 
 
 
+bool MiniDBMS::existsOnDisk(const string &db_name, const string &db_folder)
+{
+    MiniDBMS probe(db_name, db_folder);
+    error_code ec;
+    for (const string &path : {probe.get_collection_path(), probe.get_snapshot_path(), probe.get_segments_dir(),
+                               probe.get_wal_path(), probe.get_checkpoint_wal_path()})
+    {
+        if (filesystem::exists(path, ec))
+            return true;
+    }
+    return false;
+}
+
 string MiniDBMS::generate_id()
 {
     string id = to_string(next_id);
@@ -25,88 +67,274 @@ string MiniDBMS::get_collection_path() const
     return (db_folder + "/" + db_name + ".json");
 }
 
+string MiniDBMS::get_snapshot_path() const
+{
+    return (db_folder + "/" + db_name + ".snap");
+}
+
+// файлы секций: <db>.segments/<метка>.snap, формат - как у единого снимка
+string MiniDBMS::get_segments_dir() const
+{
+    return (db_folder + "/" + db_name + ".segments");
+}
+
+string MiniDBMS::get_segment_path(const string &label) const
+{
+    return (get_segments_dir() + "/" + label + ".snap");
+}
+
+string MiniDBMS::get_wal_path() const
+{
+    return (db_folder + "/" + db_name + ".wal");
+}
+
+// журнал, отложенный контрольной точкой до записи снимка
+string MiniDBMS::get_checkpoint_wal_path() const
+{
+    return get_wal_path() + ".ckpt";
+}
+
+// поля вторичных индексов, по одному на строку
+string MiniDBMS::get_indexes_path() const
+{
+    return (db_folder + "/" + db_name + ".indexes");
+}
+
+// срок хранения: "max_age_hours <n>" и "max_mb <n>", по строке
+string MiniDBMS::get_retention_path() const
+{
+    return (db_folder + "/" + db_name + ".retention");
+}
+
+// непрерывные агрегаты: запрос, табуляция, описание - по строке на представление
+string MiniDBMS::get_views_path() const
+{
+    return (db_folder + "/" + db_name + ".views");
+}
+
+void MiniDBMS::setWalEnabled(bool enabled)
+{
+    wal_enabled = enabled;
+    if (!wal_enabled)
+    {
+        wal.close();
+    }
+}
+
+bool MiniDBMS::isWalEnabled() const
+{
+    return wal_enabled;
+}
+
+void MiniDBMS::setPartitionUnit(PartitionUnit unit)
+{
+    segments.setUnit(unit);
+}
+
+// срок хранения в допустимых пределах: отрицательное - без ограничения, слишком большое
+// не должно переполниться при переводе в миллисекунды и байты (иначе лимит стал бы крошечным)
+static void clamp_retention(long long &max_age_hours, long long &max_mb)
+{
+    max_age_hours = min(max(0LL, max_age_hours), static_cast<long long>(INT64_MAX / 3600000));
+    max_mb = min(max(0LL, max_mb), static_cast<long long>(min<size_t>(SIZE_MAX >> 20, LLONG_MAX)));
+}
+
+void MiniDBMS::setDefaultRetention(long long max_age_hours, long long max_mb)
+{
+    clamp_retention(max_age_hours, max_mb);
+    retention_hours = max_age_hours;
+    retention_mb = max_mb;
+}
+
+// учёт максимального числового _id, чтобы next_id не повторялся
+void MiniDBMS::track_max_id(const string &id, long long &max_id)
+{
+    try
+    {
+        long long current_id = stoll(id);
+        if (current_id > max_id)
+        {
+            max_id = current_id;
+        }
+    }
+    catch (const exception &e)
+    {
+        cerr << "WARNING: Не удалось преобразовать _id '" << id
+             << "' в число: " << e.what() << endl;
+    }
+}
+
 void MiniDBMS::loadFromDisk()
 {
-    string path = get_collection_path();
-    ifstream file(path);
-    if (!file.is_open())
+    long long max_id = 0;
+    long long snapshot_next_id = 1;
+
+    // основной формат - файлы секций; единый снимок старого формата читаем первым
+    // (переход мог прерваться на середине), JSON - пока нет ни того, ни другого
+    vector<Document *> loaded;
+    // битый старый снимок тоже удаляется первой контрольной точкой:
+    // прочитанные из него секции грязные и запишутся целиком
+    SnapshotLoad legacy = loadBinarySnapshot(get_snapshot_path(), loaded, snapshot_next_id, field_names);
+    if (legacy != SnapshotLoad::Failed)
     {
-        // файла нет — начинаем с пустой базы
-        cout << " Файл коллекции не найден. Новая база." << endl;
-        next_id = 1;
-        return;
+        data_store.reserve(loaded.size());
+        for (Document *doc : loaded)
+        {
+            store_document(doc);
+            track_max_id(doc->_id, max_id);
+        }
+        legacy_snapshot = true;
+    }
+    bool legacy_empty = legacy == SnapshotLoad::Failed || (legacy == SnapshotLoad::Corrupt && loaded.empty());
+    if (!load_segment_files(max_id, snapshot_next_id) && legacy_empty)
+    {
+        load_json_snapshot(max_id);
+    }
+
+    if (wal_enabled)
+    {
+        // снимок + журнал(ы) = актуальное состояние
+        string ckpt_path = get_checkpoint_wal_path();
+        error_code ec;
+        bool had_ckpt = filesystem::exists(ckpt_path, ec);
+
+        size_t replayed = replay_wal(ckpt_path, max_id);
+        replayed += replay_wal(get_wal_path(), max_id);
+        if (replayed > 0)
+        {
+            cout << "INFO: Из журнала применено записей: " << replayed << endl;
+        }
+
+        // прерванная контрольная точка - доделываем её до открытия журнала
+        if (had_ckpt)
+        {
+            SegmentStore::Flush flush;
+            segments.takeDirty(flush);
+            if (write_segments(flush, max(max_id + 1, snapshot_next_id)))
+            {
+                if (legacy_snapshot)
+                    ::unlink(get_snapshot_path().c_str());
+                legacy_snapshot = false;
+                ::unlink(ckpt_path.c_str());
+                ::unlink(get_wal_path().c_str());
+            }
+            else
+            {
+                segments.restoreDirty(flush);
+            }
+        }
+        wal.open(get_wal_path());
     }
 
-    // читаем весь файл в одну строку
-    string all;
+    // индексы строятся по загруженным документам, дальше их ведут вставки и удаления
+    load_indexes();
+    load_views();
+    load_retention();
+
+    // next_id из снимка не даёт переиспользовать _id удалённых документов
+    next_id = max(max_id + 1, snapshot_next_id);
+    cout << "INFO: Загрузка завершена. Документов: "
+         << data_store.getSize()
+         << ", секций: " << segments.segmentCount()
+         << ". next_id = " << next_id << endl;
+}
+
+size_t MiniDBMS::replay_wal(const string &path, long long &max_id)
+{
+    return WriteAheadLog::replay(path, [&](char op, const string &payload)
     {
-        string line;
-        while (getline(file, line))
+        if (op == 'I')
+        {
+            Document *doc = Document::deserialize(payload, field_names);
+            if (doc)
+            {
+                track_max_id(doc->_id, max_id);
+                store_document(doc);
+            }
+        }
+        else if (op == 'D')
+        {
+            Document *doc = data_store.remove(payload);
+            unindex_document(doc);
+            release_document(doc);
+        }
+        else if (op == 'S')
         {
-            all += line;
+            drop_segment(payload);
+            release_detached();
         }
+    });
+}
+
+// JSON-массив коллекции: границы объектов ищем одним лёгким проходом,
+// дорогой Document::deserialize идёт параллельно на всех ядрах
+void MiniDBMS::load_json_snapshot(long long &max_id)
+{
+    MappedFile file;
+    if (!file.open(get_collection_path()))
+    {
+        // файла нет — начинаем с пустой базы
+        cout << " Файл коллекции не найден. Новая база." << endl;
+        return;
     }
-    file.close();
 
-    string s = trim(all);
-    if (s.empty())
+    const char *s = file.data();
+    size_t begin = 0;
+    size_t end = file.size();
+    auto is_space = [](char c)
+    { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    while (begin < end && is_space(s[begin]))
+        ++begin;
+    while (end > begin && is_space(s[end - 1]))
+        --end;
+    if (begin == end)
     {
-        next_id = 1;
         return;
     }
 
-    if (s.front() != '[' || s.back() != ']')
+    if (s[begin] != '[' || s[end - 1] != ']')
     {
         cerr << "Некорректный формат файла (ожидался JSON-массив)." << endl;
-        next_id = 1;
         return;
     }
 
-    // содержимое между [ и ]
-    string content = s.substr(1, s.length() - 2);
-    size_t pos = 0;
-    long long max_id = 0;
-
-    while (pos < content.size())
+    // границы объектов [start, finish) по балансу скобок вне строк
+    vector<pair<size_t, size_t>> objects;
+    size_t pos = begin + 1;
+    size_t limit = end - 1;
+    while (pos < limit)
     {
         // пропускаем пробелы, табы, переводы строк, запятые
-        while (pos < content.size() &&
-        (content[pos] == ' ' ||
-        content[pos] == '\t' ||
-        content[pos] == '\n' ||
-        content[pos] == '\r' ||
-        content[pos] == ',')) {
-        ++pos;
-        }
-        if (pos >= content.size())
+        while (pos < limit && (is_space(s[pos]) || s[pos] == ','))
+            ++pos;
+        if (pos >= limit)
             break;
 
-        if (content[pos] != '{')
+        if (s[pos] != '{')
         {
             cerr << "Ожидался '{' при разборе массива документов." << endl;
             break;
         }
 
-        // ищем конец объекта по балансу скобок
         size_t start_obj = pos;
         int bracket_count = 0;
+        bool in_string = false;
         bool found_end = false;
-
-        while (pos < content.size())
+        for (; pos < limit; ++pos)
         {
-            if (content[pos] == '{')
+            char c = s[pos];
+            if (c == '"' && s[pos - 1] != '\\')
+                in_string = !in_string;
+            if (in_string)
+                continue;
+            if (c == '{')
                 bracket_count++;
-            if (content[pos] == '}')
+            else if (c == '}' && --bracket_count == 0)
             {
-                bracket_count--;
-                if (bracket_count == 0)
-                {
-                    found_end = true;
-                    ++pos; // включаем '}' и двигаем pos на следующий символ
-                    break;
-                }
+                found_end = true;
+                ++pos; // включаем '}'
+                break;
             }
-            ++pos;
         }
 
         if (!found_end)
@@ -114,765 +342,1753 @@ void MiniDBMS::loadFromDisk()
             cerr << "ERROR: Не смогли найти конец JSON-объекта в массиве." << endl;
             break;
         }
+        objects.emplace_back(start_obj, pos);
+    }
 
-        // вырезаем одну строку
-        string obj_str = content.substr(start_obj, pos - start_obj);
-        obj_str = trim(obj_str);
-        if (obj_str.empty())
-            continue;
+    // таблица сразу нужного размера вместо цепочки resize_rehash
+    data_store.reserve(data_store.getSize() + objects.size());
 
-        Document *doc = Document::deserialize(obj_str);
-        if (doc)
+    size_t workers = thread::hardware_concurrency();
+    workers = max<size_t>(1, min(workers, objects.size() / 1024 + 1));
+    vector<vector<Document *>> parts(workers);
+    vector<thread> threads;
+    for (size_t w = 0; w < workers; w++)
+    {
+        size_t from = objects.size() * w / workers;
+        size_t to = objects.size() * (w + 1) / workers;
+        threads.emplace_back([&, w, from, to]()
         {
-            data_store.put(doc->_id, doc);
-            try
-            {
-                long long current_id = stoll(doc->_id);
-                if (current_id > max_id)
-                {
-                    max_id = current_id;
-                }
-            }
-            catch (const exception &e)
+            vector<Document *> &part = parts[w];
+            part.reserve(to - from);
+            for (size_t i = from; i < to; i++)
             {
-                cerr << "WARNING: Не удалось преобразовать _id '" << doc->_id
-                     << "' в число: " << e.what() << endl;
+                Document *doc = Document::deserialize(
+                    string(s + objects[i].first, objects[i].second - objects[i].first), field_names);
+                if (doc)
+                    part.push_back(doc);
             }
-        }
+        });
+    }
+    for (thread &t : threads)
+    {
+        t.join();
     }
 
-    next_id = max_id + 1;
-    cout << "INFO: Загрузка завершена. Документов: "
-         << data_store.getSize()
-         << ". next_id = " << next_id << endl;
+    // слияние по порядку файла: при повторе _id побеждает последний
+    for (vector<Document *> &part : parts)
+    {
+        for (Document *doc : part)
+        {
+            store_document(doc);
+            track_max_id(doc->_id, max_id);
+        }
+    }
 }
 
-void MiniDBMS::saveToDisk() 
+// файлы секций по порядку имён; секция, чей файл совпал с памятью, чистая -
+// её не надо переписывать. Файл с документами чужих секций (сменился размер секции)
+// удаляется после записи новых
+bool MiniDBMS::load_segment_files(long long &max_id, long long &snapshot_next_id)
 {
-    string path = get_collection_path();
-    ofstream file(path); // открываем для перезаписи
-    if (!file.is_open())
+    error_code ec;
+    vector<string> labels;
+    for (filesystem::directory_iterator it(get_segments_dir(), ec), end; !ec && it != end; it.increment(ec))
     {
-        cerr << "Ошибка открытия файла \n";
-        return;
+        string name = it->path().filename().string();
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".snap") == 0)
+            labels.push_back(name.substr(0, name.size() - 5));
     }
+    sort(labels.begin(), labels.end());
 
-    file << "[\n";
-
-    bool first = true;
-
-    // проход по все бакетам
-    for (size_t i = 0; i < data_store.getCapacity(); i++)
+    bool any = false;
+    vector<Document *> loaded;
+    for (const string &label : labels)
     {
-        ListNode *current = data_store.getBucketHead(i);
-        while (current)
-        {
-            Document *doc = current->value;
-            if (!doc)
-            {
-                current = current->next;
-                continue;
-            }
-
-            if (!first)
-            {
-                file << ",\n";
-            }
-            first = false;
-
-            file << doc->serialize();
+        long long file_next_id = 1;
+        loaded.clear();
+        SnapshotLoad status = loadBinarySnapshot(get_segment_path(label), loaded, file_next_id, field_names);
+        if (status == SnapshotLoad::Failed)
+            continue;
+        any = true;
+        snapshot_next_id = max(snapshot_next_id, file_next_id);
+        data_store.reserve(data_store.getSize() + loaded.size());
 
-            current = current->next;
+        bool in_place = true;
+        for (Document *doc : loaded)
+        {
+            in_place = in_place && segments.labelOf(doc, field_names) == label;
+            store_document(doc);
+            track_max_id(doc->_id, max_id);
         }
+        // битый файл остаётся грязным: следующая контрольная точка перепишет его тем,
+        // что удалось прочитать (или удалит, если не прочитано ничего)
+        if (!in_place || status == SnapshotLoad::Corrupt)
+            segments.dropFile(label);
+        else if (!legacy_snapshot)
+            segments.markClean(label);
+    }
+    return any;
+}
+
+// запись секций из flush; файлы опустевших секций удаляются только после
+// записи остальных - до этого их документы ещё могут понадобиться при загрузке
+bool MiniDBMS::write_segments(const SegmentStore::Flush &flush, long long snapshot_next_id)
+{
+    error_code ec;
+    filesystem::create_directories(get_segments_dir(), ec);
+    bool ok = true;
+    for (const auto &entry : flush.write)
+    {
+        ok = writeBinarySnapshot(get_segment_path(entry.first), entry.second, snapshot_next_id, field_names) && ok;
+    }
+    if (!ok)
+        return false;
+    for (const string &label : flush.remove)
+    {
+        ::unlink(get_segment_path(label).c_str());
     }
+    return true;
+}
 
-    file << "\n]\n";
+void MiniDBMS::collect_documents(vector<Document *> &out) const
+{
+    out.clear();
+    out.reserve(data_store.getSize());
+    data_store.forEach([&](Document *doc)
+                       { out.push_back(doc); });
+}
 
-    file.close();
+// экспорт коллекции в JSON-массив <db>.json
+void MiniDBMS::saveToDisk()
+{
+    vector<Document *> docs;
+    collect_documents(docs);
+    writeJsonSnapshot(get_collection_path(), docs, field_names);
 }
 
-// проверка есть ли в строке цифры или + -
-bool MiniDBMS::is_integer_string(const string &s)
+bool MiniDBMS::writeSnapshot()
 {
-    string t = trim(s);
-    if (t.empty())
-        return false;
-    size_t i = 0;
-    if (t[0] == '+' || t[0] == '-')
+    SegmentStore::Flush flush;
+    segments.takeDirty(flush);
+    if (!write_segments(flush, next_id))
     {
-        if (t.size() == 1)
-            return false;
-        i = 1;
+        segments.restoreDirty(flush);
+        return false;
     }
-    for (; i < t.size(); i++)
+    if (legacy_snapshot)
     {
-        if (t[i] < '0' || t[i] > '9')
-            return false;
+        ::unlink(get_snapshot_path().c_str());
+        legacy_snapshot = false;
     }
     return true;
 }
 
-static bool like_match_impl(const string &value, const string &pattern, size_t i, size_t j)
-{ // patern - шаблон поиска
-    if (j == pattern.size())
+// вставка с заменой: прежний документ с тем же _id освобождается как удалённый
+void MiniDBMS::store_document(Document *doc)
+{
+    Document *prev = data_store.get(doc->_id);
+    data_store.put(doc->_id, doc, false);
+    if (prev != doc)
+    {
+        unindex_document(prev);
+        release_document(prev);
+        index_document(doc);
+    }
+}
+
+// индексы и секция документа
+void MiniDBMS::index_document(Document *doc)
+{
+    segments.add(doc, field_names);
+    for (auto &entry : secondary_indexes)
     {
-        return i == value.size();
+        entry.second->add(doc, field_names);
     }
-    char pc = pattern[j]; // текуший символ
-    if (pc == '%')        // любой
+    for (auto &entry : ordered_indexes)
     {
-        return like_match_impl(value, pattern, i, j + 1) ||
-               (i < value.size() && like_match_impl(value, pattern, i + 1, j));
+        entry.second->add(doc, field_names);
     }
-    if (pc == '_') //  один символ
+    for (auto &view : views)
     {
-        return (i < value.size() &&
-                like_match_impl(value, pattern, i + 1, j + 1));
+        view->add(doc);
     }
-    // Обычный символ – должен совпасть по значению
-    return (i < value.size() &&
-            value[i] == pc &&
-            like_match_impl(value, pattern, i + 1, j + 1));
 }
 
-bool MiniDBMS::like_match(const string &value, const string &pattern)
+// вызывать до release_document: ключ берётся из значения поля документа
+void MiniDBMS::unindex_document(Document *doc)
 {
-    return like_match_impl(value, pattern, 0, 0);
+    if (!doc)
+        return;
+    segments.remove(doc, field_names);
+    for (auto &entry : secondary_indexes)
+    {
+        entry.second->remove(doc, field_names);
+    }
+    for (auto &entry : ordered_indexes)
+    {
+        entry.second->remove(doc, field_names);
+    }
+    for (auto &view : views)
+    {
+        view->remove(doc);
+    }
 }
 
-// сравниваем одно поле с одним из условий
-bool MiniDBMS::match_query_value(const string &doc_value_raw, const string &query_value_obj)
+void MiniDBMS::build_index(uint32_t field_id, bool ordered)
 {
-    string doc_value = trim(doc_value_raw);       // строковое значение
-    string trimmed_query = trim(query_value_obj); // строка с условием
+    if (ordered)
+    {
+        unique_ptr<OrderedIndex> index(new OrderedIndex(field_id));
+        data_store.forEach([&](Document *doc)
+                           { index->add(doc, field_names); });
+        ordered_indexes[field_id] = move(index);
+        return;
+    }
+    unique_ptr<SecondaryIndex> index(new SecondaryIndex(field_id));
+    data_store.forEach([&](Document *doc)
+                       { index->add(doc, field_names); });
+    secondary_indexes[field_id] = move(index);
+}
 
-    // постой случай
-    if (trimmed_query.empty())
-        return false;
-    if (trimmed_query.front() != '{')
-    { // неявное равеносто (нету)
-        if (trimmed_query.length() >= 2 && trimmed_query.front() == '"' && trimmed_query.back() == '"')
+// строка файла: имя поля (хеш-индекс) или имя поля, табуляция, "ordered"
+void MiniDBMS::load_indexes()
+{
+    ifstream in(get_indexes_path());
+    string line;
+    while (getline(in, line))
+    {
+        bool ordered = false;
+        size_t tab = line.find('\t');
+        if (tab != string::npos)
         {
-            trimmed_query = trimmed_query.substr(1, trimmed_query.length() - 2); // вырезаем середину
+            ordered = trim(line.substr(tab + 1)) == "ordered";
+            line.resize(tab);
         }
-        trimmed_query = trim(trimmed_query);
-        // Если оба числа — сравниваем как int, иначе как строки
-        if (is_integer_string(doc_value) && is_integer_string(trimmed_query))
+        string field = trim(line);
+        if (field.empty())
+            continue;
+        uint32_t id = field_names.intern(field);
+        if ((ordered ? ordered_indexes.count(id) : secondary_indexes.count(id)) == 0)
         {
-            try
-            {
-                int lhs = stoi(doc_value);
-                int rhs = stoi(trimmed_query);
-                return lhs == rhs;
-            }
-            catch (...)
-            {
-                return false;
-            }
+            build_index(id, ordered);
         }
-
-        return doc_value == trimmed_query;
     }
-    // сложный случай
-    auto extract_operator_value = [&](const string &op_key) -> string // лямда функция
+    if (!secondary_indexes.empty() || !ordered_indexes.empty())
     {
-        string op_search = "\"" + op_key + "\":";
-        size_t pos = trimmed_query.find(op_search); // поиск оператора
-        if (pos == string::npos)
-            return "";
+        cout << "INFO: Построено вторичных индексов: " << secondary_indexes.size()
+             << ", упорядоченных: " << ordered_indexes.size() << endl;
+    }
+}
 
-        size_t start_search = pos + op_search.length();
-        size_t start_val = trimmed_query.find_first_not_of(" \t\n\r", start_search);
-        if (start_val == string::npos)
-            return "";
+bool MiniDBMS::save_indexes() const
+{
+    string content;
+    for (uint32_t id = 0; id < field_names.size(); id++)
+    {
+        if (secondary_indexes.count(id))
+            content += field_names.name(id) + "\n";
+        if (ordered_indexes.count(id))
+            content += field_names.name(id) + "\tordered\n";
+    }
 
-        if (trimmed_query[start_val] == '"')
-        {
-            // строка
-            size_t start_content = start_val + 1;
-            size_t end_content = trimmed_query.find('"', start_content);
-            if (end_content == string::npos)
-                return "";
-            return trim(trimmed_query.substr(start_content, end_content - start_content));
-        }
-        else
+    AtomicFileWriter writer(get_indexes_path());
+    if (!writer.isOpen())
+        return false;
+    writer.write(content);
+    return writer.commit();
+}
+
+void MiniDBMS::load_views()
+{
+    ifstream in(get_views_path());
+    string line;
+    while (getline(in, line))
+    {
+        size_t tab = line.find('\t');
+        if (tab == string::npos)
+            continue;
+        size_t groups = 0;
+        string error;
+        if (!build_view(line.substr(0, tab), line.substr(tab + 1), groups, error))
         {
-            // число или сырой литерал
-            size_t end_val = trimmed_query.find_first_of(",}", start_val);
-            if (end_val == string::npos)
-                return "";
-            return trim(trimmed_query.substr(start_val, end_val - start_val));
+            cerr << "WARNING: представление из " << get_views_path() << " не построено: " << error << endl;
         }
+    }
+    if (!views.empty())
+    {
+        cout << "INFO: Построено представлений: " << views.size() << endl;
+    }
+}
+
+bool MiniDBMS::save_views() const
+{
+    // переводы строк и табуляции вне JSON-строк ничего не значат, а внутри строк их быть не может
+    auto one_line = [](string text)
+    {
+        replace_if(text.begin(), text.end(), [](char c)
+                   { return c == '\n' || c == '\r' || c == '\t'; }, ' ');
+        return text;
     };
+    string content;
+    for (const auto &view : views)
+    {
+        content += one_line(view->queryJson()) + "\t" + one_line(view->specJson()) + "\n";
+    }
+
+    AtomicFileWriter writer(get_views_path());
+    if (!writer.isOpen())
+        return false;
+    writer.write(content);
+    return writer.commit();
+}
+
+void MiniDBMS::load_retention()
+{
+    ifstream in(get_retention_path());
+    string key;
+    long long value = 0;
+    while (in >> key >> value)
+    {
+        if (key == "max_age_hours")
+            retention_hours = value;
+        else if (key == "max_mb")
+            retention_mb = value;
+    }
+    clamp_retention(retention_hours, retention_mb);
+}
+
+bool MiniDBMS::save_retention() const
+{
+    AtomicFileWriter writer(get_retention_path());
+    if (!writer.isOpen())
+        return false;
+    writer.write("max_age_hours " + to_string(retention_hours) + "\nmax_mb " + to_string(retention_mb) + "\n");
+    return writer.commit();
+}
+
+bool MiniDBMS::setRetention(long long max_age_hours, long long max_mb)
+{
+    clamp_retention(max_age_hours, max_mb);
+    retention_hours = max_age_hours;
+    retention_mb = max_mb;
+    if (!save_retention())
+    {
+        cerr << "WARNING: срок хранения " << db_name << " не сохранён, после перезапуска "
+             << "действуют значения по умолчанию" << endl;
+        return false;
+    }
+    return true;
+}
+
+long long MiniDBMS::retentionHours() const
+{
+    return retention_hours;
+}
+
+long long MiniDBMS::retentionMb() const
+{
+    return retention_mb;
+}
 
-    bool has_any_operator = false;
-    bool result = true;
+// секция уходит целиком: под блокировкой базы она только снимается с обхода секций,
+// документы из индексов и память убирает release_detached
+size_t MiniDBMS::drop_segment(const string &label)
+{
+    return segments.detach(label);
+}
 
-    // --- $eq (явное равенство) ---
-    string eq_val_str = extract_operator_value("$eq");
-    if (!eq_val_str.empty())
+// документы снятых секций уходят из индексов и освобождаются порциями по DROP_SLICE_DOCS,
+// между порциями блокировка базы отпускается - вставки не ждут всю секцию.
+// Пока порция не дошла до документа, он виден по _id и индексам, но не в полном обходе
+size_t MiniDBMS::release_detached()
+{
+    size_t released = 0;
+    vector<Document *> docs;
+    while (true)
     {
-        has_any_operator = true;
-        if (is_integer_string(doc_value) && is_integer_string(eq_val_str))
+        unique_lock<mutex> lock = lock_db();
+        if (!segments.takeDetached(DROP_SLICE_DOCS, docs))
+            break;
+        for (Document *doc : docs)
         {
-            try
+            data_store.remove(doc->_id);
+        }
+        for (auto &entry : secondary_indexes)
+        {
+            entry.second->removeBatch(docs, field_names);
+        }
+        for (auto &entry : ordered_indexes)
+        {
+            for (Document *doc : docs)
             {
-                int lhs = stoi(doc_value);
-                int rhs = stoi(eq_val_str);
-                result = result && (lhs == rhs);
+                entry.second->remove(doc, field_names);
             }
-            catch (...)
+        }
+        for (auto &view : views)
+        {
+            for (Document *doc : docs)
             {
-                return false;
+                view->remove(doc);
             }
         }
-        else
+        for (Document *doc : docs)
         {
-            result = result && (doc_value == eq_val_str);
+            release_document(doc);
         }
+        released += docs.size();
+    }
+    return released;
+}
+
+// фоновое удаление секций с истёкшим сроком: секция снимается за один короткий захват
+// блокировки с одной записью журнала вместо записи на документ, её документы
+// освобождаются порциями (release_detached)
+void MiniDBMS::apply_retention()
+{
+    vector<string> labels;
+    {
+        unique_lock<mutex> lock = lock_db();
+        if (retention_hours == 0 && retention_mb == 0)
+            return;
+        int64_t now_ms = chrono::duration_cast<chrono::milliseconds>(
+                             chrono::system_clock::now().time_since_epoch())
+                             .count();
+        segments.expiredSegments(now_ms, retention_hours * 3600000LL,
+                                 static_cast<size_t>(retention_mb) << 20, labels);
     }
 
-    // --- $gt ---
-    string gt_val_str = extract_operator_value("$gt");
-    if (!gt_val_str.empty())
+    bool snapshot = false; // без журнала файлы удаляет одна запись снимка в конце
+    for (const string &label : labels)
     {
-        has_any_operator = true;
-        if (is_integer_string(doc_value) && is_integer_string(gt_val_str))
+        size_t count = 0;
+        bool logged = false;
+        uint64_t lsn = 0;
         {
-            try
+            unique_lock<mutex> lock = lock_db();
+            count = drop_segment(label);
+            if (count == 0)
+                continue;
+            if (wal_enabled && wal.isOpen())
             {
-                int lhs = stoi(doc_value);
-                int rhs = stoi(gt_val_str);
-                result = result && (lhs > rhs);
+                wal.appendDropSegment(label);
+                logged = wal.flush();
+                lsn = wal.lsn();
             }
-            catch (...)
+            else
             {
-                return false;
+                snapshot = true;
             }
         }
-        else
+
+        // файл удаляем, только когда запись об удалении пережила fsync: иначе после сбоя
+        // старые вставки журнала вернули бы секцию частично. Если запись не удалась,
+        // файл удалит контрольная точка - она сначала дописывает журнал
+        if (logged && wal.waitDurable(lsn))
         {
-            result = result && (doc_value > gt_val_str);
+            unique_lock<mutex> lock = lock_db();
+            // идущая контрольная точка может переписать файл, а секция с той же меткой -
+            // появиться заново; тогда файл удалит следующая
+            if (!checkpoint_running && !segments.contains(label))
+                ::unlink(get_segment_path(label).c_str());
         }
+        release_detached();
+        cout << "INFO: Срок хранения " << db_name << ": удалена секция " << label
+             << ", документов " << count << endl;
+    }
+
+    if (snapshot)
+    {
+        unique_lock<mutex> lock = lock_db();
+        writeSnapshot();
+    }
+}
+
+bool MiniDBMS::createIndex(const string &field, bool ordered, size_t &indexed)
+{
+    indexed = 0;
+    string name = trim(field);
+    if (name == "_id")
+    {
+        indexed = data_store.getSize(); // уже есть первичный индекс
+        return false;
     }
 
-    // --- $lt ---
-    string lt_val_str = extract_operator_value("$lt");
-    if (!lt_val_str.empty())
+    // имя может ещё не встречаться: индекс начнёт заполняться с первой вставки
+    uint32_t id = field_names.intern(name);
+    if (ordered ? ordered_indexes.count(id) : secondary_indexes.count(id))
     {
-        has_any_operator = true;
-        if (is_integer_string(doc_value) && is_integer_string(lt_val_str))
+        indexed = ordered ? ordered_indexes[id]->size() : secondary_indexes[id]->size();
+        return false;
+    }
+
+    build_index(id, ordered);
+    indexed = ordered ? ordered_indexes[id]->size() : secondary_indexes[id]->size();
+    if (!save_indexes())
+    {
+        cerr << "WARNING: список индексов не сохранён, после перезапуска индекс на "
+             << name << " придётся создать заново" << endl;
+    }
+    cout << "INFO: Создан " << (ordered ? "упорядоченный " : "") << "индекс на поле "
+         << name << ", документов: " << indexed << endl;
+    return true;
+}
+
+void MiniDBMS::indexesToJson(string &out_array_json) const
+{
+    out_array_json = "[";
+    auto add = [&](uint32_t id, const char *type, size_t documents)
+    {
+        if (out_array_json.size() > 1)
         {
-            try
-            {
-                int lhs = stoi(doc_value);
-                int rhs = stoi(lt_val_str);
-                result = result && (lhs < rhs);
-            }
-            catch (...)
+            out_array_json.push_back(',');
+        }
+        out_array_json += "{\"field\":\"" + field_names.name(id) + "\"" +
+                          ",\"type\":\"" + type + "\"" +
+                          ",\"documents\":" + to_string(documents) + "}";
+    };
+    for (uint32_t id = 0; id < field_names.size(); id++)
+    {
+        auto hashed = secondary_indexes.find(id);
+        if (hashed != secondary_indexes.end())
+            add(id, "hash", hashed->second->size());
+        auto ordered = ordered_indexes.find(id);
+        if (ordered != ordered_indexes.end())
+            add(id, "ordered", ordered->second->size());
+    }
+    out_array_json.push_back(']');
+}
+
+size_t MiniDBMS::find_view(const string &name) const
+{
+    size_t i = 0;
+    while (i < views.size() && views[i]->name() != name)
+        i++;
+    return i;
+}
+
+// представление по всем документам базы; дальше его ведут index_document и удаления
+bool MiniDBMS::build_view(const string &query_json, const string &spec_json, size_t &groups, string &error)
+{
+    unique_ptr<MaterializedView> view(new MaterializedView(field_names));
+    if (!view->parse(query_json, spec_json, PARTITION_FIELD, error))
+        return false;
+    if (find_view(view->name()) != views.size())
+    {
+        error = "View already exists: " + view->name();
+        return false;
+    }
+
+    data_store.forEach([&](Document *doc)
+                       { view->add(doc); });
+    if (view->isOverflow())
+    {
+        error = "View " + view->name() + " has more than " + to_string(MaterializedView::MAX_GROUPS) +
+                " groups, use a wider bucket or fewer groupBy fields";
+        return false;
+    }
+    groups = view->groupCount();
+    views.push_back(move(view));
+    return true;
+}
+
+bool MiniDBMS::createView(const string &query_json, const string &spec_json, size_t &groups, string &error)
+{
+    groups = 0;
+    if (!build_view(query_json, spec_json, groups, error))
+        return false;
+    if (!save_views())
+    {
+        cerr << "WARNING: список представлений не сохранён, после перезапуска представление "
+             << views.back()->name() << " придётся создать заново" << endl;
+    }
+    cout << "INFO: Создано представление " << views.back()->name() << ", групп: " << groups << endl;
+    return true;
+}
+
+bool MiniDBMS::dropView(const string &name)
+{
+    size_t i = find_view(name);
+    if (i == views.size())
+        return false;
+    views.erase(views.begin() + i);
+    if (!save_views())
+    {
+        cerr << "WARNING: список представлений не сохранён, после перезапуска представление "
+             << name << " появится снова" << endl;
+    }
+    return true;
+}
+
+bool MiniDBMS::readView(const string &request_json, string &out_array_json, size_t &out_rows, string &error)
+{
+    vector<pair<string, string>> fields;
+    if (!splitJsonObject(request_json, fields))
+    {
+        error = "view requires data {\"name\": \"...\"}";
+        return false;
+    }
+    string name;
+    bool has_from = false, has_to = false;
+    int64_t from_ms = 0, to_ms = 0;
+    for (const auto &field : fields)
+    {
+        const string &key = field.first;
+        if (key == "name")
+        {
+            name = unquoteJsonValue(field.second);
+        }
+        else if (key == "from" || key == "to")
+        {
+            if (!OrderedIndex::parseIsoMillis(unquoteJsonValue(field.second), key == "from" ? from_ms : to_ms))
             {
+                error = "Option " + key + " must be a time like 2026-10-15T00:00:00.000Z";
                 return false;
             }
+            (key == "from" ? has_from : has_to) = true;
         }
         else
         {
-            result = result && (doc_value < lt_val_str);
+            error = "Unknown view option: " + key;
+            return false;
         }
     }
 
-    // --- $like ---
-    string like_val_str = extract_operator_value("$like");
-    if (!like_val_str.empty())
+    size_t i = find_view(name);
+    if (i == views.size())
+    {
+        error = "View not found: " + name;
+        return false;
+    }
+    if (views[i]->needsRebuild())
+    {
+        MaterializedView &view = *views[i];
+        view.clear();
+        data_store.forEach([&](Document *doc)
+                           { view.add(doc); });
+        cout << "INFO: Представление " << name << " пересчитано, групп: " << view.groupCount() << endl;
+    }
+    // без одной из границ - до начала или до конца времён
+    if (has_from || has_to)
+    {
+        if (!has_from)
+            from_ms = INT64_MIN;
+        if (!has_to)
+            to_ms = INT64_MAX;
+    }
+    return views[i]->toJson(has_from || has_to, from_ms, to_ms, out_array_json, out_rows, error);
+}
+
+void MiniDBMS::viewsToJson(string &out_array_json) const
+{
+    out_array_json = "[";
+    for (const auto &view : views)
+    {
+        if (out_array_json.size() > 1)
+            out_array_json.push_back(',');
+        out_array_json += "{\"name\":\"" + view->name() + "\"" +
+                          ",\"query\":" + view->queryJson() +
+                          ",\"spec\":" + view->specJson() +
+                          ",\"groups\":" + to_string(view->groupCount()) +
+                          (view->isOverflow() ? ",\"overflow\":true}" : "}");
+    }
+    out_array_json.push_back(']');
+}
+
+// удалённый документ нельзя освобождать, пока фоновый поток пишет снимок
+void MiniDBMS::release_document(Document *doc)
+{
+    if (!doc)
+        return;
+    if (checkpoint_running)
+    {
+        graveyard.push_back(doc);
+        return;
+    }
+    destroy_document(doc);
+}
+
+void MiniDBMS::flush_graveyard()
+{
+    if (checkpoint_running)
+        return;
+    for (Document *doc : graveyard)
     {
-        has_any_operator = true;
-        result = result && like_match(doc_value, like_val_str);
+        destroy_document(doc);
     }
+    graveyard.clear();
+}
+
+// коды словарей значений освобождаются вместе с документом
+void MiniDBMS::destroy_document(Document *doc)
+{
+    doc->releaseValues(field_names);
+    delete doc;
+}
 
-    // --- $in ---
-    string in_search = "\"$in\":";
-    size_t in_pos = trimmed_query.find(in_search);
-    if (in_pos != string::npos)
+unique_lock<mutex> MiniDBMS::lock_db()
+{
+    if (db_mutex)
     {
-        has_any_operator = true;
+        return unique_lock<mutex>(*db_mutex);
+    }
+    return unique_lock<mutex>();
+}
+
+// контрольная точка: под блокировкой базы только ротация журнала и сбор указателей
+// изменённых секций, их сериализация идёт без блокировки (документы после вставки
+// не меняются); секции без изменений остаются в своих файлах
+bool MiniDBMS::checkpoint()
+{
+    if (!wal_enabled)
+        return false;
 
-        size_t array_start = trimmed_query.find('[', in_pos + in_search.length());
-        if (array_start == string::npos)
+    string ckpt_path = get_checkpoint_wal_path();
+    SegmentStore::Flush flush;
+    bool drop_legacy = false;
+    long long snapshot_next_id = 1;
+    {
+        unique_lock<mutex> lock = lock_db();
+        if (!wal.flush())
             return false;
-        size_t array_end = trimmed_query.find(']', array_start);
-        if (array_end == string::npos)
+
+        // прошлая контрольная точка не дописала снимок - журнал не ротируем,
+        // старый .ckpt будет покрыт новым снимком
+        error_code ec;
+        bool retry = filesystem::exists(ckpt_path, ec);
+        if (!retry && wal.bytesWritten() == 0)
+            return true;
+
+        if (!retry && !wal.rotate(ckpt_path))
             return false;
+        segments.takeDirty(flush);
+        drop_legacy = legacy_snapshot;
+        snapshot_next_id = next_id;
+        checkpoint_running = true;
+    }
 
-        string array_content =
-            trimmed_query.substr(array_start + 1, array_end - array_start - 1);
+    bool ok = write_segments(flush, snapshot_next_id);
+    if (ok)
+    {
+        if (drop_legacy)
+            ::unlink(get_snapshot_path().c_str());
+        ::unlink(ckpt_path.c_str());
+    }
+
+    size_t written = 0;
+    for (const auto &entry : flush.write)
+    {
+        written += entry.second.size();
+    }
+
+    {
+        unique_lock<mutex> lock = lock_db();
+        checkpoint_running = false;
+        flush_graveyard();
+        if (!ok)
+            segments.restoreDirty(flush);
+        else if (drop_legacy)
+            legacy_snapshot = false;
+    }
+
+    if (ok)
+    {
+        cout << "INFO: Контрольная точка " << db_name << ": секций записано " << flush.write.size()
+             << ", документов " << written << endl;
+    }
+    return ok;
+}
+
+void MiniDBMS::setCheckpointPolicy(size_t wal_bytes, int interval_sec)
+{
+    checkpoint_wal_bytes = wal_bytes;
+    checkpoint_interval_sec = interval_sec;
+}
+
+void MiniDBMS::startMaintenance(mutex &owner_mutex)
+{
+    if (maintenance_thread.joinable())
+        return;
+    db_mutex = &owner_mutex;
+    maintenance_stop = false;
+    maintenance_thread = thread(&MiniDBMS::maintenance_loop, this);
+}
+
+void MiniDBMS::stopMaintenance()
+{
+    {
+        lock_guard<mutex> lock(maintenance_mtx);
+        maintenance_stop = true;
+    }
+    maintenance_cv.notify_all();
+    if (maintenance_thread.joinable())
+    {
+        maintenance_thread.join();
+    }
+}
 
-        stringstream ss(array_content);
-        string item;
-        bool in_result = false;
+// фоновый поток: срок хранения и контрольная точка по размеру журнала или по времени
+void MiniDBMS::maintenance_loop()
+{
+    auto last_checkpoint = chrono::steady_clock::now();
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(maintenance_mtx);
+            maintenance_cv.wait_for(lock, chrono::seconds(1), [this]
+                                    { return maintenance_stop; });
+            if (maintenance_stop)
+                return;
+        }
 
-        while (getline(ss, item, ','))
         {
-            string trimmed_item = trim(item);
+            unique_lock<mutex> lock = lock_db();
+            expire_cursors();
+        }
+        apply_retention();
+        if (!wal_enabled)
+            continue;
 
-            if (trimmed_item.length() >= 2 &&
-                trimmed_item.front() == '"' &&
-                trimmed_item.back() == '"')
-            {
-                trimmed_item =
-                    trimmed_item.substr(1, trimmed_item.length() - 2);
-                trimmed_item = trim(trimmed_item);
-            }
-            else
-            {
-                trimmed_item = trim(trimmed_item);
-            }
+        size_t wal_bytes = wal.bytesWritten();
+        bool by_size = checkpoint_wal_bytes > 0 && wal_bytes >= checkpoint_wal_bytes;
+        bool by_time = checkpoint_interval_sec > 0 && wal_bytes > 0 &&
+                       chrono::steady_clock::now() - last_checkpoint >= chrono::seconds(checkpoint_interval_sec);
+        if (!by_size && !by_time)
+            continue;
 
-            if (is_integer_string(doc_value) && is_integer_string(trimmed_item))
-            {
-                try
-                {
-                    int lhs = stoi(doc_value);
-                    int rhs = stoi(trimmed_item);
-                    if (lhs == rhs)
-                    {
-                        in_result = true;
-                        break;
-                    }
-                }
-                catch (...)
-                {
-                    // игнорируем и считаем неравными
-                }
-            }
-            else if (doc_value == trimmed_item)
+        checkpoint();
+        last_checkpoint = chrono::steady_clock::now();
+    }
+}
+
+// фиксация изменений запроса: в режиме журнала дописываем только новые записи,
+// иначе (старый режим) переписываем весь снимок
+bool MiniDBMS::commit()
+{
+    if (wal_enabled && wal.isOpen())
+        return wal.flush();
+    return writeSnapshot();
+}
+
+void MiniDBMS::setSyncPolicy(SyncPolicy policy, int batch_ms)
+{
+    wal.setSyncPolicy(policy, batch_ms);
+}
+
+uint64_t MiniDBMS::commitLsn() const
+{
+    return wal.lsn();
+}
+
+bool MiniDBMS::waitDurable(uint64_t lsn)
+{
+    if (!wal_enabled)
+        return true;
+    return wal.waitDurable(lsn);
+}
+
+// целое из литерала запроса; false - не число или не влезает в long long
+static bool parse_query_integer(const string &text, long long &out)
+{
+    try
+    {
+        size_t used = 0;
+        out = stoll(text, &used);
+        return used == text.size();
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+// кандидаты для корневого AND-запроса с условием на _id: точечный доступ или
+// диапазон по плотной части первичного индекса вместо полного прохода;
+// false - условия на _id нет, нужен полный проход.
+// Кандидаты - надмножество ответа, каждый потом проверяется запросом целиком
+bool MiniDBMS::plan_id_candidates(const CompiledQuery &query, vector<Document *> &out) const
+{
+    const ValueCondition *cond = query.idCondition();
+    if (!cond)
+        return false;
+    if (cond->never)
+        return true; // под условие не подходит ни один документ
+
+    // _id, равные value: числовое сравнение ловит и "007", "+7" из fallback
+    bool need_numeric_fallback = false;
+    auto add_equal = [&](const QueryLiteral &value)
+    {
+        long long id = 0;
+        if (value.is_int)
+        {
+            if (parse_query_integer(value.text, id) && id >= 0 &&
+                static_cast<unsigned long long>(id) < PrimaryIndex::DENSE_LIMIT)
             {
-                in_result = true;
-                break;
+                Document *doc = data_store.getDense(static_cast<uint64_t>(id));
+                if (doc)
+                    out.push_back(doc);
             }
+            need_numeric_fallback = true;
+        }
+        else
+        {
+            // нечисловой литерал сравнивается как строка - совпасть может только ключ fallback
+            Document *doc = data_store.get(value.text);
+            if (doc)
+                out.push_back(doc);
         }
+    };
 
-        result = result && in_result;
+    if (cond->has_eq)
+    {
+        add_equal(cond->eq);
     }
+    else if (cond->has_in)
+    {
+        for (const QueryLiteral &item : cond->in_items)
+        {
+            add_equal(item);
+        }
+        // одинаковые значения ("1", "01") дают один документ дважды
+        sort(out.begin(), out.end());
+        out.erase(unique(out.begin(), out.end()), out.end());
+    }
+    else if (cond->has_gt || cond->has_lt)
+    {
+        // строковая граница сравнивается лексикографически - порядок id не помогает
+        long long lo = 0, hi = 0;
+        if ((cond->has_gt && (!cond->gt.is_int || !parse_query_integer(cond->gt.text, lo))) ||
+            (cond->has_lt && (!cond->lt.is_int || !parse_query_integer(cond->lt.text, hi))))
+            return false;
 
-    if (!has_any_operator)
+        uint64_t from = !cond->has_gt || lo < 0 ? 0 : static_cast<uint64_t>(lo) + 1;
+        uint64_t to = PrimaryIndex::DENSE_LIMIT - 1;
+        if (cond->has_lt)
+        {
+            if (hi <= 0)
+                from = to + 1; // пустой диапазон
+            else if (static_cast<uint64_t>(hi) - 1 < to)
+                to = static_cast<uint64_t>(hi) - 1;
+        }
+        if (from <= to)
+        {
+            data_store.forEachDense(from, to, [&](Document *doc)
+                                    { out.push_back(doc); });
+        }
+        // ключи fallback сравниваются то как числа, то как строки - берём все
+        data_store.forEachFallback([&](Document *doc)
+                                   { out.push_back(doc); });
+    }
+    else
     {
-        // В объекте нет ни одного из известных операторов –
+        return false; // $like и прочее - полный проход
+    }
+
+    if (need_numeric_fallback && data_store.fallbackNumeric() > 0)
+    {
+        data_store.forEachFallback([&](Document *doc)
+                                   {
+            if (is_integer_string(doc->_id))
+                out.push_back(doc); });
+    }
+    return true;
+}
+
+// равенство или $in на поле со вторичным индексом: берём условие с самыми короткими
+// списками документов, если они короче limit; остальные условия запроса проверяются
+// на этих кандидатах (пересечение без построения промежуточных множеств)
+bool MiniDBMS::plan_index_lists(const CompiledQuery &query, size_t limit,
+                                vector<const SecondaryIndex::Postings *> &lists) const
+{
+    const vector<unique_ptr<QueryTerm>> *terms = query.rootTerms();
+    if (!terms || secondary_indexes.empty())
+        return false;
+
+    bool found = false;
+    size_t best = limit;
+    vector<const SecondaryIndex::Postings *> term_lists;
+    for (const auto &term : *terms)
+    {
+        if (term->is_id)
+            continue;
+        auto it = secondary_indexes.find(term->field_id);
+        if (it == secondary_indexes.end())
+            continue;
+
+        const ValueCondition &cond = term->condition;
+        term_lists.clear();
+        if (cond.never)
+        {
+            // ничему не равно - ответ пуст
+        }
+        else if (cond.has_eq)
+        {
+            const SecondaryIndex::Postings *list = it->second->lookup(cond.eq);
+            if (list && !list->empty())
+                term_lists.push_back(list);
+        }
+        else if (cond.has_in)
+        {
+            it->second->lookupIn(cond, term_lists);
+        }
+        else
+        {
+            continue; // диапазон и $like хеш-индекс не ускоряет
+        }
+
+        size_t total = 0;
+        for (const SecondaryIndex::Postings *list : term_lists)
+        {
+            total += list->size();
+        }
+        if (total < best || (!found && total == 0))
+        {
+            best = total;
+            lists = term_lists;
+            found = true;
+        }
+    }
+    return found;
+}
 
+// $gt/$lt на поле с упорядоченным индексом: спуск к границе и проход по диапазону
+// вместо проверки каждого документа; берётся самый короткий диапазон, если он короче limit
+bool MiniDBMS::plan_range_candidates(const CompiledQuery &query, size_t limit, vector<Document *> &out) const
+{
+    const vector<unique_ptr<QueryTerm>> *terms = query.rootTerms();
+    if (!terms || ordered_indexes.empty())
         return false;
+
+    bool found = false;
+    vector<Document *> range;
+    for (const auto &term : *terms)
+    {
+        if (term->is_id)
+            continue;
+        auto it = ordered_indexes.find(term->field_id);
+        const ValueCondition &cond = term->condition;
+        if (it == ordered_indexes.end() || cond.never || (!cond.has_gt && !cond.has_lt))
+            continue;
+
+        if (it->second->rangeCandidates(cond, limit, range) && (!found || range.size() < out.size()))
+        {
+            out.swap(range);
+            limit = out.size();
+            found = true;
+        }
+    }
+    return found;
+}
+
+const ValueCondition *MiniDBMS::partition_condition(const CompiledQuery &query) const
+{
+    const vector<unique_ptr<QueryTerm>> *terms = query.rootTerms();
+    if (!terms)
+        return nullptr;
+    for (const auto &term : *terms)
+    {
+        if (!term->is_id && term->field_id == segments.fieldId())
+            return &term->condition;
+    }
+    return nullptr;
+}
+
+// документы, подходящие под запрос: по кандидатам первичного или вторичного индекса
+// или полным проходом; запрос компилируется один раз, документы проверяются по
+// готовому дереву условий
+bool MiniDBMS::plan_candidates(const CompiledQuery &query, vector<Document *> &candidates) const
+{
+    bool planned = plan_id_candidates(query, candidates);
+    vector<const SecondaryIndex::Postings *> lists;
+    if (plan_index_lists(query, planned ? candidates.size() : data_store.getSize(), lists))
+    {
+        candidates.clear();
+        for (const SecondaryIndex::Postings *list : lists)
+        {
+            candidates.insert(candidates.end(), list->begin(), list->end());
+        }
+        planned = true;
+    }
+    vector<Document *> range;
+    if (plan_range_candidates(query, planned ? candidates.size() : data_store.getSize(), range))
+    {
+        candidates.swap(range);
+        planned = true;
+    }
+    return planned;
+}
+
+void MiniDBMS::for_each_match(const string &query_json, const function<bool(Document *)> &visit)
+{
+    CompiledQuery query(query_json, field_names);
+    if (query.matchesNone())
+        return;
+
+    vector<Document *> candidates;
+    if (plan_candidates(query, candidates))
+    {
+        for (Document *doc : candidates)
+        {
+            if (query.matches(doc) && !visit(doc))
+                return;
+        }
+        return;
+    }
+
+    // полный проход по секциям: зоны отсекают секции вне диапазона времени
+    bool all = query.matchesAll();
+    bool stopped = false;
+    segments.forEachSegment(partition_condition(query), [&](const Segment &segment)
+                            {
+        for (size_t i = 0; i < segment.docs.size() && !stopped; i++)
+        {
+            Document *doc = segment.docs[i];
+            if ((all || query.matches(doc)) && !visit(doc))
+                stopped = true;
+        } });
+}
+
+// те же документы и в том же порядке, что у for_each_match, но кусками по SCAN_CHUNK_DOCS
+void MiniDBMS::plan_scan(const string &query_json, ScanPlan &plan) const
+{
+    plan.query.reset(new CompiledQuery(query_json, field_names));
+    plan.all = plan.query->matchesAll();
+    plan.candidates.clear();
+    plan.chunks.clear();
+    if (plan.query->matchesNone())
+        return;
+
+    auto cut = [&](Document *const *docs, size_t count)
+    {
+        for (size_t from = 0; from < count; from += SCAN_CHUNK_DOCS)
+        {
+            plan.chunks.push_back(ScanChunk{docs + from, min(SCAN_CHUNK_DOCS, count - from)});
+        }
+    };
+    if (plan_candidates(*plan.query, plan.candidates))
+    {
+        plan.all = false;
+        cut(plan.candidates.data(), plan.candidates.size());
+        return;
+    }
+    segments.forEachSegment(partition_condition(*plan.query), [&](const Segment &segment)
+                            { cut(segment.docs.data(), segment.docs.size()); });
+}
+
+void MiniDBMS::run_scan(const ScanPlan &plan, const function<bool(size_t, size_t, Document *)> &visit) const
+{
+    atomic<bool> stopped(false);
+    ScanPool::shared().run(plan.chunks.size(), [&](size_t part, size_t worker)
+                           {
+        const ScanChunk &chunk = plan.chunks[part];
+        for (size_t i = 0; i < chunk.count && !stopped.load(memory_order_relaxed); i++)
+        {
+            Document *doc = chunk.docs[i];
+            if ((plan.all || plan.query->matches(doc)) && !visit(part, worker, doc))
+                stopped = true;
+        } });
+}
+
+void MiniDBMS::collect_matches(const string &query_json, vector<Document *> &out) const
+{
+    ScanPlan plan;
+    plan_scan(query_json, plan);
+    vector<vector<Document *>> parts(plan.chunks.size());
+    run_scan(plan, [&](size_t part, size_t, Document *doc)
+             {
+        parts[part].push_back(doc);
+        return true; });
+
+    size_t total = 0;
+    for (const auto &part : parts)
+    {
+        total += part.size();
+    }
+    out.reserve(out.size() + total);
+    for (const auto &part : parts)
+    {
+        out.insert(out.end(), part.begin(), part.end());
+    }
+}
+
+// JSON совпавших документов: каждый кусок пишется в свой буфер, буферы склеиваются по порядку
+void MiniDBMS::append_matches_json(const string &query_json, const Document::Projection *projection,
+                                   string &out_array_json, size_t &out_count) const
+{
+    ScanPlan plan;
+    plan_scan(query_json, plan);
+    vector<string> parts(plan.chunks.size());
+    vector<size_t> counts(plan.chunks.size(), 0);
+    run_scan(plan, [&](size_t part, size_t, Document *doc)
+             {
+        if (counts[part]++ > 0)
+            parts[part].push_back(',');
+        doc->appendJson(parts[part], field_names, projection);
+        return true; });
+
+    size_t total = out_array_json.size();
+    for (const string &part : parts)
+    {
+        total += part.size() + 1;
+    }
+    out_array_json.reserve(total + 1);
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        if (counts[i] == 0)
+            continue;
+        if (out_count > 0)
+            out_array_json.push_back(',');
+        out_array_json += parts[i];
+        out_count += counts[i];
+        string().swap(parts[i]); // память куска - сразу, ответ бывает в сотни МБ
+    }
+}
+
+// вставка нового документа
+void MiniDBMS::insertQuery(const string &query_json)
+{
+    string new_id = generate_id();
+
+    string trimmed = trim(query_json);
+    if (trimmed.empty())
+    {
+        cerr << "ERROR: пустая вставка" << endl;
+        return;
+    }
+    if (trimmed.front() != '{')
+    {
+        cerr << "ERROR: не правильнный ввод " << trimmed << endl;
+        return;
+    }
+
+    // убираем первую '{' и подставляем "_id" первым полем
+    string without_first_brace = trimmed.substr(1);
+    string full_json = "{\"_id\":\"" + new_id + "\"," + without_first_brace;
+
+    Document *new_doc = Document::deserialize(full_json, field_names);
+    if (!new_doc)
+    {
+        cerr << "ERROR: проблема с файлом." << endl;
+        return;
+    }
+
+    store_document(new_doc);
+    if (wal_enabled)
+    {
+        wal.appendInsert(new_doc->serialize(field_names));
+    }
+    cout << "SUCCESS: Document inserted. ID: " << new_id << endl;
+}
+
+void MiniDBMS::findQueryToStream(const string &query_json, ostream &out) // вывод в поток
+{
+    size_t found_count = 0;
+    out << "Результаты поиска:\n";
+
+    for_each_match(query_json, [&](Document *doc)
+                   {
+        out << doc->serialize(field_names) << "\n";
+        found_count++;
+        return true; });
+
+    out << "Найдено документов: " << found_count << "\n";
+}   
+
+void MiniDBMS::findQueryToJsonArray(const string& query_json, string& out_array_json, size_t& out_count) // вывод в JSON-массив
+{
+    std::string q = trim(query_json);
+    if (q.empty())
+    {
+        q = "{}";
     }
 
-    return result;
+    out_array_json.clear();
+    out_array_json.push_back('[');
+    out_count = 0U;
+    append_matches_json(q, nullptr, out_array_json, out_count);
+    out_array_json.push_back(']');
 }
 
-bool MiniDBMS::match_and_query(const Document *doc, const string &query_json)
+bool MiniDBMS::parseFindOptions(const string &options_json, const string &projection_json, FindOptions &out,
+                                string &error) const
 {
-    string query = trim(query_json);
-    if (query.empty() || query == "{}")
-        return true;
-
-    // ожидаем объект вида {...}
-    if (query.front() != '{' || query.back() != '}')
-        return false;
-
-    // убираем внешние скобки
-    string content = query.substr(1, query.length() - 2);
-    size_t current_pos = 0;
+    return FindOptions::parse(options_json, field_names, out, error) &&
+           FindOptions::parseProjection(projection_json, field_names, out.projection, error);
+}
 
-    while (current_pos < content.length())
+void MiniDBMS::findWithOptions(const string &query_json, const FindOptions &options,
+                               string &out_array_json, size_t &out_count, uint64_t &cursor_id)
+{
+    string q = trim(query_json);
+    if (q.empty())
     {
-        // пропускаем пробелы, табы и запятые
-        while (current_pos < content.size() &&
-        (content[current_pos] == ' ' ||
-        content[current_pos] == '\t' ||
-        content[current_pos] == '\n' ||
-        content[current_pos] == '\r' ||
-        content[current_pos] == ',')) {
-        ++current_pos;
-        }
-        if (current_pos >= content.length())
-            break;
-
-        // парсим имя поля value(city)
-        size_t start_key = content.find('"', current_pos);
-        if (start_key == string::npos)
-            break;
-
-        size_t end_key = content.find('"', start_key + 1);
-        if (end_key == string::npos)
-            return false; // кривой JSON "name":
-
-        string field_name = content.substr(start_key + 1, end_key - start_key - 1);
-
-        // ищем начало этого значения
-
-        size_t start_val_search = content.find(':', end_key);
-        if (start_val_search == string::npos)
-            return false;
-
-        size_t val_start_char = content.find_first_not_of(" \t", start_val_search + 1);
-        if (val_start_char == string::npos)
-            return false;
-
-        // определяем конец значения
-        size_t end_val = string::npos;
-        char first_char = content[val_start_char];
+        q = "{}";
+    }
 
-        if (first_char == '{' || first_char == '[')
+    out_array_json = "[";
+    out_count = 0;
+    cursor_id = 0;
+    size_t limit = options.limit;
+    size_t batch = options.batch_size;
+    size_t window = limit && options.skip <= SIZE_MAX - limit ? options.skip + limit : SIZE_MAX;
+    vector<Document *> rest; // не влезло в первую порцию - уйдёт в курсор
+    auto emit = [&](Document *doc)
+    {
+        if (batch && out_count >= batch)
         {
-            // объект или массив
-            char open_char = first_char;
-            char close_char = (open_char == '{') ? '}' : ']';
-
-            int bracket_count = 0;
-            end_val = val_start_char;
-            bool found_end = false;
-
-            while (end_val < content.length())
-            {
-                if (content[end_val] == open_char)
-                    bracket_count++;
-                if (content[end_val] == close_char)
-                {
-                    bracket_count--;
-                    if (bracket_count == 0)
-                    {
-                        found_end = true;
-                        break;
-                    }
-                }
-                end_val++;
-            }
-
-            if (!found_end)
-                return false;
+            rest.push_back(doc);
+            return;
         }
-        else if (first_char == '"')
+        if (out_count > 0)
         {
-            // строка
-            size_t end_quote = content.find('"', val_start_char + 1);
-            if (end_quote == string::npos)
-                return false;
-            end_val = end_quote;
+            out_array_json.push_back(',');
         }
-        else
-        {
-            // число или литерал
-            size_t separator_pos = content.find_first_of(",}", val_start_char);
-            size_t boundary = (separator_pos == string::npos)
-                                  ? content.length()
-                                  : separator_pos;
+        doc->appendJson(out_array_json, field_names, &options.projection);
+        out_count++;
+    };
 
-            end_val = boundary - 1;
-            while (end_val > val_start_char &&
-                   (content[end_val] == ' ' || content[end_val] == '\t'))
+    if (options.sort.empty() && window == SIZE_MAX && batch == 0 && options.skip == 0)
+    {
+        // весь ответ сразу: документы пишутся в JSON параллельно
+        append_matches_json(q, &options.projection, out_array_json, out_count);
+    }
+    else if (options.sort.empty() && window != SIZE_MAX)
+    {
+        // без сортировки - в порядке обхода, с остановкой на лимите
+        size_t seen = 0;
+        for_each_match(q, [&](Document *doc)
+                       {
+            seen++;
+            if (seen > options.skip)
+                emit(doc);
+            return seen < window; });
+    }
+    else if (options.sort.empty())
+    {
+        vector<Document *> matched;
+        collect_matches(q, matched);
+        for (size_t i = options.skip; i < matched.size(); i++)
+        {
+            emit(matched[i]);
+        }
+    }
+    else
+    {
+        // с лимитом - у каждого потока прохода куча из skip + limit лучших (в вершине - худший
+        // из них), кучи сливаются в конце; без лимита - все совпадения
+        DocumentOrder order(options.sort, field_names);
+        ScanPlan plan;
+        plan_scan(q, plan);
+        vector<vector<Document *>> heaps(ScanPool::shared().workers());
+        run_scan(plan, [&](size_t, size_t worker, Document *doc)
+                 {
+            vector<Document *> &heap = heaps[worker];
+            if (window == SIZE_MAX)
             {
-                end_val--;
+                heap.push_back(doc);
             }
-        }
-
-        if (end_val == string::npos || end_val < val_start_char)
-            return false;
-
-        // само значение условия
-        size_t length = end_val - val_start_char + 1;
-        string condition_value = content.substr(val_start_char, length);
+            else if (heap.size() < window)
+            {
+                heap.push_back(doc);
+                push_heap(heap.begin(), heap.end(), order);
+            }
+            else if (order(doc, heap.front()))
+            {
+                pop_heap(heap.begin(), heap.end(), order);
+                heap.back() = doc;
+                push_heap(heap.begin(), heap.end(), order);
+            }
+            return true; });
 
-        // ---- достаём значение поля из документа
-        string doc_value_raw;
-        if (field_name == "_id")
+        vector<Document *> sorted;
+        for (vector<Document *> &heap : heaps)
+        {
+            sorted.insert(sorted.end(), heap.begin(), heap.end());
+            vector<Document *>().swap(heap);
+        }
+        if (sorted.size() > window)
         {
-            doc_value_raw = doc->_id;
+            partial_sort(sorted.begin(), sorted.begin() + window, sorted.end(), order);
+            sorted.resize(window);
         }
         else
         {
-            if (!doc->getField(field_name, doc_value_raw))
-            {
-                // поля нет - документ не удовлетворяет AND
-                return false;
-            }
+            sort(sorted.begin(), sorted.end(), order);
         }
 
-        // ---- проверяем одно условие ----
-        if (!match_query_value(doc_value_raw, condition_value))
+        for (size_t i = options.skip; i < sorted.size(); i++)
         {
-            return false;
+            emit(sorted[i]);
         }
-
-        // двигаемся дальше
-        current_pos = end_val + 1;
     }
+    out_array_json.push_back(']');
 
-    return true;
+    if (!rest.empty())
+    {
+        cursor_id = open_cursor(rest, batch, options.projection);
+    }
 }
 
-// обработка $or: {"$or": [ { ... }, { ... }, ... ]}
-bool MiniDBMS::handle_or_query(const Document *doc, const string &query_json)
+uint64_t MiniDBMS::open_cursor(const vector<Document *> &docs, size_t batch_size, const Document::Projection &projection)
 {
-    string search_key = "\"$or\":";
-    size_t pos = query_json.find(search_key);
-    if (pos == string::npos)
-        return false;
-
-    // Находим границы массива условий
-    size_t array_start = query_json.find('[', pos + search_key.length());
-    if (array_start == string::npos)
-        return false;
-
-    size_t array_end = query_json.find_last_of(']');
-    if (array_end == string::npos || array_end < array_start)
-        return false;
-
-    string array_content = query_json.substr(array_start + 1, array_end - array_start - 1); // убираем скобки
-
-    size_t current_pos = 0;
-    bool has_any_condition = false;
-
-    while (current_pos < array_content.length())
+    expire_cursors();
+    if (cursors.size() >= MAX_CURSORS)
     {
-        // ищем начало объекта-условия
-        size_t start_cond = array_content.find('{', current_pos);
-        if (start_cond == string::npos)
-            break;
-
-        size_t end_cond = start_cond;
-        int bracket_count = 0;
-        bool found_end = false;
-
-        // ищем конец объекта с учётом вложенных { }
-        while (end_cond < array_content.length())
+        auto oldest = cursors.begin();
+        for (auto it = cursors.begin(); it != cursors.end(); ++it)
         {
-            if (array_content[end_cond] == '{')
-                bracket_count++;
-            if (array_content[end_cond] == '}')
-            {
-                bracket_count--;
-                if (bracket_count == 0)
-                {
-                    found_end = true;
-                    break;
-                }
-            }
-            end_cond++;
+            if (it->second.last_used < oldest->second.last_used)
+                oldest = it;
         }
+        cursors.erase(oldest);
+    }
 
-        if (!found_end)
-            return false;
-
-        string sub_query =
-            array_content.substr(start_cond, end_cond - start_cond + 1);
-        has_any_condition = true;
+    uint64_t id = next_cursor_id++;
+    Cursor &cursor = cursors[id];
+    cursor.ids.reserve(docs.size());
+    for (const Document *doc : docs)
+    {
+        cursor.ids.push_back(doc->_id);
+    }
+    cursor.batch_size = batch_size;
+    cursor.projection = projection;
+    cursor.last_used = chrono::steady_clock::now();
+    return id;
+}
 
-        // каждое подусловие — это полноценный подзапрос (там может быть и $and, и $or)
-        if (match_document(doc, trim(sub_query)))
+// порция курсора; удалённые после открытия документы пропускаются,
+// заменённые отдаются в текущем виде
+void MiniDBMS::append_batch(Cursor &cursor, size_t batch_size, string &out_array_json, size_t &out_count)
+{
+    out_array_json = "[";
+    out_count = 0;
+    while (cursor.pos < cursor.ids.size() && out_count < batch_size)
+    {
+        const Document *doc = data_store.get(cursor.ids[cursor.pos++]);
+        if (!doc)
+            continue;
+        if (out_count > 0)
         {
-            // для $or достаточно одного совпадения
-            return true;
+            out_array_json.push_back(',');
         }
-
-        current_pos = end_cond + 1;
+        doc->appendJson(out_array_json, field_names, &cursor.projection);
+        out_count++;
     }
+    out_array_json.push_back(']');
+}
 
-    if (!has_any_condition)
+bool MiniDBMS::getMore(uint64_t &cursor_id, size_t batch_size, string &out_array_json, size_t &out_count)
+{
+    out_array_json = "[]";
+    out_count = 0;
+    auto it = cursors.find(cursor_id);
+    if (it == cursors.end())
+    {
+        cursor_id = 0;
         return false;
+    }
 
-    // ни одно условие не совпало
-    return false;
+    Cursor &cursor = it->second;
+    append_batch(cursor, batch_size ? batch_size : cursor.batch_size, out_array_json, out_count);
+    cursor.last_used = chrono::steady_clock::now();
+    if (cursor.pos >= cursor.ids.size())
+    {
+        cursors.erase(it);
+        cursor_id = 0;
+    }
+    return true;
 }
 
-// обработка $and: {"$and": [ { ... }, { ... }, ... ]}
-bool MiniDBMS::handle_and_query(const Document *doc, const string &query_json)
+bool MiniDBMS::killCursor(uint64_t cursor_id)
 {
-    string search_key = "\"$and\":";
-    size_t pos = query_json.find(search_key);
-    if (pos == string::npos)
-        return false;
+    return cursors.erase(cursor_id) > 0;
+}
 
-    // Находим границы массива условий
-    size_t array_start = query_json.find('[', pos + search_key.length());
-    if (array_start == string::npos)
+bool MiniDBMS::aggregate(const string &query_json, const string &spec_json, string &out_array_json,
+                         size_t &out_groups, string &error)
+{
+    out_array_json = "[]";
+    out_groups = 0;
+    Aggregation aggregation(field_names);
+    if (!aggregation.parse(spec_json, error))
         return false;
 
-    size_t array_end = query_json.find_last_of(']');
-    if (array_end == string::npos || array_end < array_start)
+    string q = trim(query_json);
+    if (q.empty())
+    {
+        q = "{}";
+    }
+    // у каждого потока прохода своя агрегация, в конце они сливаются в первую
+    vector<unique_ptr<Aggregation>> partial(ScanPool::shared().workers());
+    for (auto &part : partial)
+    {
+        part.reset(new Aggregation(field_names));
+        part->parse(spec_json, error);
+    }
+    ScanPlan plan;
+    plan_scan(q, plan);
+    atomic<bool> ok(true);
+    run_scan(plan, [&](size_t, size_t worker, Document *doc)
+             {
+        if (partial[worker]->add(doc))
+            return true;
+        ok = false;
+        return false; });
+    for (size_t i = 0; i < partial.size() && ok; i++)
+    {
+        ok = aggregation.merge(*partial[i]);
+    }
+    if (!ok)
+    {
+        error = "Too many groups (more than " + to_string(Aggregation::MAX_GROUPS) + ")";
         return false;
+    }
 
-    string array_content = query_json.substr(array_start + 1, array_end - array_start - 1); // чистим скобки
-
-    size_t current_pos = 0;
-    bool has_any_condition = false;
+    aggregation.toJson(out_array_json);
+    out_groups = aggregation.groupCount();
+    return true;
+}
 
-    while (current_pos < array_content.length())
+// фильтр find + диапазон [from, to) по полю времени, чтобы сработали индекс и зоны секций:
+// для канонического времени строковый порядок совпадает с временным, поэтому
+// >= from - это $gt на миллисекунду раньше. "" - фильтр так не дополнить
+static string with_time_range(const string &filter, const string &field, int64_t from_ms, int64_t to_ms)
+{
+    vector<pair<string, string>> fields;
+    if (!splitJsonObject(filter, fields))
+        return "";
+    for (const auto &f : fields)
     {
-        size_t start_cond = array_content.find('{', current_pos);
-        if (start_cond == string::npos)
-            break;
+        if (f.first == field || f.first.empty() || f.first[0] == '$')
+            return "";
+    }
 
-        size_t end_cond = start_cond;
-        int bracket_count = 0;
-        bool found_end = false;
+    char from_buf[24], to_buf[24];
+    OrderedIndex::formatIsoMillis(from_ms - 1, from_buf);
+    OrderedIndex::formatIsoMillis(to_ms, to_buf);
+    string body = trim(filter);
+    body = trim(body.substr(1, body.size() - 2));
+    string q = "{\"" + field + "\":{\"$gt\":\"" + string(from_buf, 24) + "\",\"$lt\":\"" + string(to_buf, 24) + "\"}";
+    if (!body.empty())
+        q += "," + body;
+    q += "}";
+    return q;
+}
+
+bool MiniDBMS::histogram(const string &query_json, const string &spec_json, string &out_array_json,
+                         size_t &out_buckets, string &error)
+{
+    out_array_json = "[]";
+    out_buckets = 0;
+    TimeHistogram hist(field_names);
+    if (!hist.parse(spec_json, PARTITION_FIELD, error))
+        return false;
+
+    string q = trim(query_json);
+    if (q.empty())
+    {
+        q = "{}";
+    }
+    bool all = CompiledQuery(q, field_names).matchesAll();
 
-        while (end_cond < array_content.length())
+    if (all && !hist.hasSplit() && hist.fieldId() != FieldDictionary::NO_FIELD)
+    {
+        auto ordered = ordered_indexes.find(hist.fieldId());
+        if (ordered != ordered_indexes.end())
         {
-            if (array_content[end_cond] == '{')
-                bracket_count++;
-            if (array_content[end_cond] == '}')
-            {
-                bracket_count--;
-                if (bracket_count == 0)
+            // только ключи индекса, документы не читаются
+            ordered->second->forEachTime(hist.fromMs(), hist.toMs(), [&](int64_t ms)
+                                         { hist.addTime(ms); });
+        }
+        else if (hist.fieldId() == segments.fieldId())
+        {
+            // секция, зона которой целиком в одном интервале, считается без чтения документов
+            segments.forEachSegment(nullptr, [&](const Segment &segment)
+                                    {
+                if (!segment.timed || segment.max_ms < hist.fromMs() || segment.min_ms >= hist.toMs())
+                    return;
+                bool inside = segment.min_ms >= hist.fromMs() && segment.max_ms < hist.toMs() &&
+                              (segment.min_ms - hist.fromMs()) / hist.bucketMs() ==
+                                  (segment.max_ms - hist.fromMs()) / hist.bucketMs();
+                if (inside)
                 {
-                    found_end = true;
-                    break;
+                    hist.addTime(segment.min_ms, segment.docs.size());
+                    return;
                 }
-            }
-            end_cond++;
+                for (Document *doc : segment.docs)
+                {
+                    hist.add(doc);
+                } });
         }
-
-        if (!found_end)
-            return false;
-
-        string sub_query = array_content.substr(start_cond, end_cond - start_cond + 1);
-        has_any_condition = true;
-
-        // КАЖДОЕ подусловие было true
-        if (!match_document(doc, trim(sub_query)))
+        else
+        {
+            for_each_match(q, [&](Document *doc)
+                           { return hist.add(doc); });
+        }
+    }
+    else
+    {
+        string ranged = with_time_range(q, hist.fieldName(), hist.fromMs(), hist.toMs());
+        bool ok = true;
+        for_each_match(ranged.empty() ? q : ranged, [&](Document *doc)
+                       {
+            ok = hist.add(doc);
+            return ok; });
+        if (!ok)
         {
+            error = "Too many splitBy values (more than " + to_string(TimeHistogram::MAX_SPLIT_CELLS) + " bucket/value pairs)";
             return false;
         }
-
-        current_pos = end_cond + 1;
     }
 
-    // Если не было считаем что документ не подходит
-    if (!has_any_condition)
-        return false;
-
+    hist.toJson(out_array_json);
+    out_buckets = hist.bucketCount();
     return true;
 }
 
-// решает как вывести
-bool MiniDBMS::match_document(const Document *doc, const string &query_json)
+bool MiniDBMS::topk(const string &query_json, const string &spec_json, string &out_array_json,
+                    size_t &out_rows, bool &exact, string &error)
 {
-    string query = trim(query_json);
-    if (query.empty() || query == "{}")
-        return true;
+    out_array_json = "[]";
+    out_rows = 0;
+    exact = true;
+    TopK top(field_names);
+    if (!top.parse(spec_json, error))
+        return false;
 
-    // если это объект смотрим на первый ключ
-    if (!query.empty() && query.front() == '{')
+    string q = trim(query_json);
+    if (q.empty())
     {
-        size_t first_quote = query.find('"');
-        if (first_quote != string::npos)
-        {
-            size_t second_quote = query.find('"', first_quote + 1);
-            if (second_quote != string::npos)
-            {
-                string first_key = query.substr(first_quote + 1, second_quote - first_quote - 1);
-
-                if (first_key == "$or")
-                {
-                    return handle_or_query(doc, query);
-                }
-                if (first_key == "$and")
-                {
-                    return handle_and_query(doc, query);
-                }
-            }
-        }
+        q = "{}";
+    }
+    bool ok = true;
+    for_each_match(q, [&](Document *doc)
+                   {
+        ok = top.add(doc);
+        return ok; });
+    if (!ok)
+    {
+        error = "Too many distinct values for exact topk (more than " + to_string(TopK::EXACT_LIMIT) +
+                "), use mode auto or sketch";
+        return false;
     }
 
-    // по умолчанию — неявный AND
-    return match_and_query(doc, query);
+    top.toJson(out_array_json, out_rows);
+    exact = top.isExact();
+    return true;
 }
 
-// вставка нового документа
-void MiniDBMS::insertQuery(const string &query_json)
+void MiniDBMS::approxDistinct(const DistinctSpec &spec, string &out_array_json, size_t &out_rows,
+                              vector<HyperLogLog> &merged) const
 {
-    string new_id = generate_id();
-
-    string trimmed = trim(query_json);
-    if (trimmed.empty())
-    {
-        cerr << "ERROR: пустая вставка" << endl;
-        return;
-    }
-    if (trimmed.front() != '{')
+    out_array_json = "[";
+    out_rows = 0;
+    merged.resize(spec.fields.size());
+    vector<uint32_t> ids;
+    for (const string &name : spec.fields)
     {
-        cerr << "ERROR: не правильнный ввод " << trimmed << endl;
-        return;
+        ids.push_back(field_names.lookup(name));
     }
 
-    // убираем первую '{' и подставляем "_id" первым полем
-    string without_first_brace = trimmed.substr(1);
-    string full_json = "{\"_id\":\"" + new_id + "\"," + without_first_brace;
+    const HyperLogLog empty;
+    vector<HyperLogLog> own(spec.by_segment ? spec.fields.size() : 0);
+    segments.forEachSegment(nullptr, [&](const Segment &segment)
+                            {
+        if (spec.has_range && (!segment.timed || segment.max_ms < spec.from_ms || segment.min_ms >= spec.to_ms))
+            return;
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            auto it = segment.distinct.find(ids[i]);
+            const HyperLogLog &sketch = it == segment.distinct.end() ? empty : it->second;
+            merged[i].merge(sketch);
+            if (spec.by_segment)
+                own[i] = sketch;
+        }
+        if (spec.by_segment)
+        {
+            if (out_rows > 0)
+                out_array_json.push_back(',');
+            spec.appendRow(own, &segment.label, out_array_json);
+            out_rows++;
+        } });
 
-    Document *new_doc = Document::deserialize(full_json);
-    if (!new_doc)
+    if (!spec.by_segment)
     {
-        cerr << "ERROR: проблема с файлом." << endl;
-        return;
+        spec.appendRow(merged, nullptr, out_array_json);
+        out_rows = 1;
     }
-
-    data_store.put(new_doc->_id, new_doc);
-    cout << "SUCCESS: Document inserted. ID: " << new_id << endl;
+    out_array_json.push_back(']');
 }
 
-void MiniDBMS::findQueryToStream(const string &query_json, ostream &out) // вывод в поток
+// под блокировкой базы: курсоры, которые давно не читали
+void MiniDBMS::expire_cursors()
 {
-    size_t found_count = 0;
-    out << "Результаты поиска:\n";
-
-    // проход по все бакетам
-    for (size_t i = 0; i < data_store.getCapacity(); ++i)
+    auto deadline = chrono::steady_clock::now() - chrono::seconds(CURSOR_IDLE_SEC);
+    for (auto it = cursors.begin(); it != cursors.end();)
     {
-        ListNode *current = data_store.getBucketHead(i);
-        while (current)
-        {
-            Document *doc = current->value;
-            if (match_document(doc, query_json))
-            {
-                out << doc->serialize() << "\n";
-                found_count++;
-            }
-            current = current->next;
-        }
+        if (it->second.last_used < deadline)
+            it = cursors.erase(it);
+        else
+            ++it;
     }
+}
 
-    out << "Найдено документов: " << found_count << "\n";
-}   
-
-void MiniDBMS::findQueryToJsonArray(const string& query_json, string& out_array_json, size_t& out_count) // вывод в JSON-массив
+// статистика словарей значений: по полю - число разных значений, сколько значений
+// документов закодировано (попадания) и сколько хранится как есть
+void MiniDBMS::dictionaryStatsToJson(string &out_array_json, size_t &out_fields, double &hit_rate) const
 {
-    std::string q = trim(query_json);
-    if (q.empty())
+    out_array_json = "[";
+    out_fields = field_names.size();
+    size_t total_lookups = 0;
+    size_t total_hits = 0;
+    for (uint32_t id = 0; id < out_fields; id++)
     {
-        q = "{}";
-    }
-
-    out_array_json.clear();
-    out_array_json.push_back('[');
+        const ValueDictionary &values = field_names.values(id);
+        total_lookups += values.lookupCount();
+        total_hits += values.hitCount();
 
-    bool first = true;
-    out_count = 0U;
-
-    const std::size_t cap = data_store.getCapacity();
-    for (std::size_t i = 0; i < cap; ++i)
-    {
-        ListNode* node = data_store.getBucketHead(i); // проход по цепочке
-        while (node != nullptr)
+        char rate[32];
+        snprintf(rate, sizeof(rate), "%.4f", values.hitRate());
+        if (id > 0)
         {
-            Document* doc = node->value;
-            if (doc != nullptr && match_document(doc, q))
-            {
-                if (!first)
-                {
-                    out_array_json.push_back(',');
-                }
-                out_array_json += doc->serialize();
-                first = false;
-                ++out_count;
-            }
-            node = node->next;
+            out_array_json.push_back(',');
         }
+        out_array_json += "{\"field\":\"" + field_names.name(id) + "\"" +
+                          ",\"distinct\":" + to_string(values.distinctCount()) +
+                          ",\"encoded\":" + to_string(values.encodedValues()) +
+                          ",\"inline\":" + to_string(values.inlineValues()) +
+                          ",\"hit_rate\":" + rate +
+                          ",\"high_cardinality\":" + (values.isHighCardinality() ? "true" : "false") +
+                          ",\"pool_bytes\":" + to_string(values.poolBytes()) + "}";
     }
+    out_array_json.push_back(']');
+    // доля значений, для которых код уже был в словаре
+    hit_rate = total_lookups ? double(total_hits) / double(total_lookups) : 0.0;
+}
+
+size_t MiniDBMS::segmentCount() const
+{
+    return segments.segmentCount();
+}
 
+void MiniDBMS::segmentsToJson(string &out_array_json) const
+{
+    out_array_json = "[";
+    segments.forEachSegment(nullptr, [&](const Segment &segment)
+                            {
+        if (out_array_json.size() > 1)
+        {
+            out_array_json.push_back(',');
+        }
+        out_array_json += "{\"segment\":\"" + segment.label + "\"" +
+                          ",\"documents\":" + to_string(segment.docs.size());
+        if (segment.timed)
+        {
+            char lo[24], hi[24];
+            OrderedIndex::formatIsoMillis(segment.min_ms, lo);
+            OrderedIndex::formatIsoMillis(segment.max_ms, hi);
+            out_array_json += ",\"min\":\"" + string(lo, 24) + "\",\"max\":\"" + string(hi, 24) + "\"";
+        }
+        out_array_json.push_back('}'); });
     out_array_json.push_back(']');
 }
 
@@ -887,33 +2103,56 @@ size_t MiniDBMS::deleteQuery(const std::string &query_json){
 
     myarray ids_to_delete;
 
-    // сначала собираем id всех подходящих документов
-    for (size_t i = 0; i < data_store.getCapacity(); ++i)
+    // сначала собираем id всех подходящих документов (условие проверяется параллельно)
+    vector<Document *> matched;
+    collect_matches(query_json, matched);
+    for (Document *doc : matched)
     {
-        ListNode *current = data_store.getBucketHead(i);
-        while (current)
-        {
-            Document *doc = current->value;
-            if (match_document(doc, query_json))
-            {
-                ids_to_delete.push(current->key); // ключ = _id
-            }
-            current = current->next;
-        }
+        ids_to_delete.push(doc->_id);
     }
 
     // потом удаляем их по одному
+    vector<Document *> removed_docs;
     for (size_t i = 0; i < ids_to_delete.getSize(); ++i)
     {
         string id = ids_to_delete[i];
         Document *removed_doc = data_store.remove(id);
         if (removed_doc)
         {
-            delete removed_doc;
+            if (wal_enabled)
+            {
+                wal.appendDelete(id);
+            }
+            removed_docs.push_back(removed_doc);
             deleted_count++;
         }
     }
 
+    // из секций и вторичных индексов - пачкой, каждый список чистится один раз
+    segments.removeBatch(removed_docs, field_names);
+    for (auto &entry : secondary_indexes)
+    {
+        entry.second->removeBatch(removed_docs, field_names);
+    }
+    for (auto &entry : ordered_indexes)
+    {
+        for (Document *doc : removed_docs)
+        {
+            entry.second->remove(doc, field_names);
+        }
+    }
+    for (auto &view : views)
+    {
+        for (Document *doc : removed_docs)
+        {
+            view->remove(doc);
+        }
+    }
+    for (Document *doc : removed_docs)
+    {
+        release_document(doc);
+    }
+
     return deleted_count;
 }
 // удаление документов по условию
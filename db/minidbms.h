@@ -2,44 +2,243 @@
 
 #include <string>
 #include <iosfwd>
-#include "custom_hashmap.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include "primary_index.h"
 #include "document.h"
+#include "field_dictionary.h"
+#include "query.h"
+#include "secondary_index.h"
+#include "ordered_index.h"
+#include "segment.h"
+#include "cursor.h"
+#include "aggregate.h"
+#include "myarray.h"
 #include "utills.h"
+#include "wal.h"
+#include "scan_pool.h"
 
 class MiniDBMS
 {
 private:
+    // кусок прохода: подряд идущие документы секции или кандидатов плана
+    struct ScanChunk
+    {
+        Document *const *docs;
+        std::size_t count;
+    };
+
+    // проход, нарезанный для пула сканирования; указатели живут, пока держится блокировка базы
+    struct ScanPlan
+    {
+        std::unique_ptr<CompiledQuery> query;
+        bool all = false; // подходит всё - без проверки документов
+        std::vector<Document *> candidates; // кандидаты плана по индексам
+        std::vector<ScanChunk> chunks;      // в порядке обхода for_each_match
+    };
+
     std::string db_name;      // название файла
     std::string db_folder;    // название папки
-    CustomHashMap data_store; // memory память
+    PrimaryIndex data_store;  // memory память, ключ - _id
+    FieldDictionary field_names; // имена полей документов этой базы
+    // вторичные индексы: номер поля -> индекс; список полей - в <db>.indexes
+    std::unordered_map<std::uint32_t, std::unique_ptr<SecondaryIndex>> secondary_indexes; // хеш
+    std::unordered_map<std::uint32_t, std::unique_ptr<OrderedIndex>> ordered_indexes;     // $gt/$lt
+    // непрерывные агрегаты в порядке создания; описания - в <db>.views
+    std::vector<std::unique_ptr<MaterializedView>> views;
+    // временные секции по PARTITION_FIELD, у каждой свой файл в <db>.segments/
+    SegmentStore segments;
+    bool legacy_snapshot; // загружен единый <db>.snap: удалить после записи всех секций
+    // срок хранения (0 - без ограничения): лишние секции удаляет фоновый поток целиком;
+    // задаётся флагами сервера, для базы переопределяется в <db>.retention
+    long long retention_hours;
+    long long retention_mb;
     long long next_id;        // счетчик для айди
+    bool wal_enabled;         // режим журнала вместо перезаписи файла
+    WriteAheadLog wal;
+
+    // фоновые контрольные точки
+    std::mutex *db_mutex; // мьютекс владельца базы (DbEntry::mtx)
+    std::thread maintenance_thread;
+    std::mutex maintenance_mtx;
+    std::condition_variable maintenance_cv;
+    bool maintenance_stop;
+    std::size_t checkpoint_wal_bytes; // порог размера журнала (0 - выкл.)
+    int checkpoint_interval_sec;      // порог времени (0 - выкл.)
+    bool checkpoint_running;          // под db_mutex
+    std::vector<Document *> graveyard; // удалены во время контрольной точки
+
+    // курсоры find (id -> остаток ответа), под db_mutex
+    std::unordered_map<std::uint64_t, Cursor> cursors;
+    std::uint64_t next_cursor_id;
 
     std::string generate_id();
-    std::string get_collection_path() const;
+    std::string get_collection_path() const; // JSON (экспорт и старый формат)
+    std::string get_snapshot_path() const;   // единый бинарный снимок (старый формат)
+    std::string get_segments_dir() const;
+    std::string get_segment_path(const std::string &label) const;
+    std::string get_wal_path() const;
+    std::string get_checkpoint_wal_path() const;
+    std::string get_indexes_path() const;
+    std::string get_retention_path() const;
+    std::string get_views_path() const;
 
-    bool is_integer_string(const std::string &s);
-    bool like_match(const std::string &value, const std::string &pattern);
-    bool match_query_value(const std::string &doc_value_raw, const std::string &query_value_obj);
+    void track_max_id(const std::string &id, long long &max_id);
+    void load_json_snapshot(long long &max_id);
+    bool load_segment_files(long long &max_id, long long &snapshot_next_id);
+    bool write_segments(const SegmentStore::Flush &flush, long long snapshot_next_id);
+    std::size_t replay_wal(const std::string &path, long long &max_id);
+    void collect_documents(std::vector<Document *> &out) const;
+    void store_document(Document *doc);
+    void release_document(Document *doc);
+    void destroy_document(Document *doc);
+    void flush_graveyard();
+    void append_batch(Cursor &cursor, std::size_t batch_size, std::string &out_array_json, std::size_t &out_count);
+    std::uint64_t open_cursor(const std::vector<Document *> &docs, std::size_t batch_size,
+                              const Document::Projection &projection);
+    void expire_cursors();
+    void index_document(Document *doc);
+    void unindex_document(Document *doc);
+    void build_index(std::uint32_t field_id, bool ordered);
+    void load_indexes();
+    bool save_indexes() const;
+    void load_retention();
+    bool save_retention() const;
+    void load_views();
+    bool save_views() const;
+    std::size_t find_view(const std::string &name) const; // views.size() - нет такого
+    bool build_view(const std::string &query_json, const std::string &spec_json, std::size_t &groups,
+                    std::string &error);
+    std::size_t drop_segment(const std::string &label);
+    std::size_t release_detached();
+    void apply_retention();
+    std::unique_lock<std::mutex> lock_db();
+    void maintenance_loop();
 
-    bool handle_or_query(const Document *doc, const std::string &query_json);
-    bool match_and_query(const Document *doc, const std::string &query_json);
-    bool handle_and_query(const Document *doc, const std::string &query_json);
-    bool match_document(const Document *doc, const std::string &query_json);
+    // быстрый путь по первичному индексу: кандидаты для условия на _id
+    bool plan_id_candidates(const CompiledQuery &query, std::vector<Document *> &out) const;
+    // по вторичному индексу: списки документов самого избирательного условия
+    bool plan_index_lists(const CompiledQuery &query, std::size_t limit,
+                          std::vector<const SecondaryIndex::Postings *> &lists) const;
+    bool plan_range_candidates(const CompiledQuery &query, std::size_t limit, std::vector<Document *> &out) const;
+    // условие корня запроса на поле секций (nullptr - нет): отсекает секции при полном проходе
+    const ValueCondition *partition_condition(const CompiledQuery &query) const;
+    // кандидаты по первичному, вторичным или ordered-индексам; false - нужен полный проход
+    bool plan_candidates(const CompiledQuery &query, std::vector<Document *> &candidates) const;
+    // visit возвращает false, чтобы остановить обход (лимит набран)
+    void for_each_match(const std::string &query_json, const std::function<bool(Document *)> &visit);
+    // параллельный for_each_match: куски плана разбирают потоки ScanPool::shared(),
+    // visit(кусок, поток, документ) зовётся из них одновременно - буферы по номеру куска
+    // (сохраняет порядок обхода) или потока; false из visit останавливает весь проход
+    void plan_scan(const std::string &query_json, ScanPlan &plan) const;
+    void run_scan(const ScanPlan &plan,
+                  const std::function<bool(std::size_t part, std::size_t worker, Document *doc)> &visit) const;
+    // все совпавшие документы в порядке for_each_match
+    void collect_matches(const std::string &query_json, std::vector<Document *> &out) const;
+    // совпавшие документы через запятую в конец out_array_json (без скобок), out_count - сколько всего
+    void append_matches_json(const std::string &query_json, const Document::Projection *projection,
+                             std::string &out_array_json, std::size_t &out_count) const;
 
     void handle_find(const std::string &query_json);
     void handle_delete(const std::string &query_json);
 
 public:
+    static const std::size_t DEFAULT_CHECKPOINT_WAL_BYTES = 64u << 20;
+    static const int DEFAULT_CHECKPOINT_INTERVAL_SEC = 300;
+    static const char PARTITION_FIELD[]; // поле времени события
+    static const std::size_t MAX_CURSORS = 64;  // на базу; сверх - закрывается давно не читанный
+    static const int CURSOR_IDLE_SEC = 600;     // курсор без getMore дольше - закрывается
+    static const std::size_t SCAN_CHUNK_DOCS = 8192; // документов в задаче параллельного прохода
+    static const std::size_t DROP_SLICE_DOCS = 4096; // документов снятой секции за один захват блокировки
+
     MiniDBMS(const std::string &db_name, const std::string &db_folder = "mydb");
+    // есть ли у базы файлы на диске (коллекция, снимок, секции или журнал) - без загрузки
+    static bool existsOnDisk(const std::string &db_name, const std::string &db_folder = "mydb");
     ~MiniDBMS();
 
+    void setWalEnabled(bool enabled); // вызывать до loadFromDisk
+    bool isWalEnabled() const;
+    void setPartitionUnit(PartitionUnit unit); // вызывать до loadFromDisk
+    void setDefaultRetention(long long max_age_hours, long long max_mb); // вызывать до loadFromDisk
+
     void loadFromDisk();
-    void saveToDisk();
+    void saveToDisk();     // экспорт в JSON
+    bool writeSnapshot();  // изменённые секции на диск (без фоновых потоков)
+    bool commit(); // сохранить изменения последнего запроса; false - журнал или снимок не записан
+
+    // политика fsync журнала; commit() только пишет в файл,
+    // подтверждать клиенту можно после waitDurable(commitLsn()); false - fsync журнала не удался
+    void setSyncPolicy(SyncPolicy policy, int batch_ms = 0);
+    std::uint64_t commitLsn() const;
+    bool waitDurable(std::uint64_t lsn);
+
+    // изменённые секции + усечение журнала; в фоне вызывается сам по порогам
+    bool checkpoint();
+    void setCheckpointPolicy(std::size_t wal_bytes, int interval_sec);
+    void startMaintenance(std::mutex &owner_mutex); // owner_mutex охраняет все запросы к базе
+    void stopMaintenance();
+
+    // срок хранения базы (сохраняется в <db>.retention), применяется фоновым потоком
+    bool setRetention(long long max_age_hours, long long max_mb);
+    long long retentionHours() const;
+    long long retentionMb() const;
 
     void insertQuery(const std::string &query_json);
     void findQueryToStream(const std::string &query_json, std::ostream &out);
     std::size_t deleteQuery(const std::string &query_json);
     void findQueryToJsonArray(const std::string& query_json, std::string& out_array_json, std::size_t& out_count);
+    // параметры find ({"skip", "limit", "sort", "batchSize"}) и проекция с полями этой базы
+    bool parseFindOptions(const std::string &options_json, const std::string &projection_json, FindOptions &out,
+                          std::string &error) const;
+    // find с skip/limit/sort: с лимитом сортировка держит только skip + limit документов
+    // (куча top-N); если ответ длиннее batch_size, остаток уходит в курсор (cursor_id != 0);
+    // проекция ограничивает выдаваемые поля и сохраняется в курсоре
+    void findWithOptions(const std::string &query_json, const FindOptions &options,
+                         std::string &out_array_json, std::size_t &out_count, std::uint64_t &cursor_id);
+    // следующая порция курсора (batch_size 0 - как при открытии); cursor_id обнуляется,
+    // когда курсор выбран до конца; false - курсора нет (закрыт или истёк)
+    bool getMore(std::uint64_t &cursor_id, std::size_t batch_size, std::string &out_array_json, std::size_t &out_count);
+    bool killCursor(std::uint64_t cursor_id);
+    // группы и накопители по совпавшим документам за один проход (отбор - теми же индексами,
+    // что и find); false - кривая спецификация или групп больше Aggregation::MAX_GROUPS
+    bool aggregate(const std::string &query_json, const std::string &spec_json, std::string &out_array_json,
+                   std::size_t &out_groups, std::string &error);
+    // счётчики событий по интервалам времени (см. TimeHistogram); без фильтра и splitBy
+    // считается по ordered-индексу поля времени или целыми секциями, иначе - один проход find
+    bool histogram(const std::string &query_json, const std::string &spec_json, std::string &out_array_json,
+                   std::size_t &out_buckets, std::string &error);
+    // самые частые значения поля среди совпавших документов (см. TopK); exact - подсчёт точный
+    bool topk(const std::string &query_json, const std::string &spec_json, std::string &out_array_json,
+              std::size_t &out_rows, bool &exact, std::string &error);
+    // оценка числа различных значений по HyperLogLog секций (см. DistinctSpec), без чтения документов:
+    // [{"поле": n, ...}] или по строке на секцию; merged - слияние по всем секциям (для других баз)
+    void approxDistinct(const DistinctSpec &spec, std::string &out_array_json, std::size_t &out_rows,
+                        std::vector<HyperLogLog> &merged) const;
+    // индекс по полю (хеш - для равенства и $in, ordered - для $gt/$lt): строится сразу,
+    // дальше поддерживается вставками и удалениями;
+    // false - индекс уже есть (для _id - первичный индекс), indexed - документов в индексе
+    bool createIndex(const std::string &field, bool ordered, std::size_t &indexed);
+    void indexesToJson(std::string &out_array_json) const; // [{"field", "type", "documents"}]
+    // непрерывный агрегат по документам query_json (см. MaterializedView): строится сразу,
+    // дальше его ведут вставки и удаления; false - кривое описание, имя занято или групп слишком много
+    bool createView(const std::string &query_json, const std::string &spec_json, std::size_t &groups,
+                    std::string &error);
+    bool dropView(const std::string &name);
+    // готовая таблица представления: {"name": "...", "from": время, "to": время};
+    // представление, которое удаления сделали неточным, сначала пересчитывается по базе
+    bool readView(const std::string &request_json, std::string &out_array_json, std::size_t &out_rows,
+                  std::string &error);
+    void viewsToJson(std::string &out_array_json) const; // [{"name", "query", "spec", "groups"}]
+    // по объекту на поле: distinct, encoded, inline, hit_rate, high_cardinality, pool_bytes;
+    // hit_rate - доля обращений к словарю, нашедших готовый код (по полю и по всем полям)
+    void dictionaryStatsToJson(std::string &out_array_json, std::size_t &out_fields, double &hit_rate) const;
+    void segmentsToJson(std::string &out_array_json) const; // [{"segment", "documents", "min", "max"}]
+    std::size_t segmentCount() const;
 
     void run(const std::string &command, const std::string &query_json);
 };
\ No newline at end of file
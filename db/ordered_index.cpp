@@ -0,0 +1,291 @@
+#include "ordered_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+static bool entry_less(const KeyTree::Entry &a, const KeyTree::Entry &b)
+{
+    return a.key < b.key || (a.key == b.key && a.doc < b.doc);
+}
+
+KeyTree::KeyTree() : count(0) {}
+
+// лист, в который попадает запись: последний, чья первая запись не больше e
+size_t KeyTree::leaf_for(const Entry &e) const
+{
+    size_t i = upper_bound(firsts.begin(), firsts.end(), e, entry_less) - firsts.begin();
+    return i > 0 ? i - 1 : 0;
+}
+
+void KeyTree::insert(int64_t key, Document *doc)
+{
+    Entry e{key, doc};
+    if (leaves.empty())
+    {
+        leaves.emplace_back();
+        leaves.back().reserve(LEAF_SIZE);
+        firsts.push_back(e);
+    }
+
+    size_t i = leaf_for(e);
+    vector<Entry> &leaf = leaves[i];
+    // события приходят почти по времени - обычно это дописывание в конец
+    if (leaf.empty() || !entry_less(e, leaf.back()))
+        leaf.push_back(e);
+    else
+        leaf.insert(upper_bound(leaf.begin(), leaf.end(), e, entry_less), e);
+    firsts[i] = leaf.front();
+    count++;
+
+    if (leaf.size() > LEAF_SIZE)
+    {
+        // делим пополам; у последнего листа оставляем полный левый -
+        // при дописывании в конец листы заполнены целиком
+        size_t keep = i + 1 == leaves.size() && !entry_less(e, leaf[leaf.size() - 2]) ? LEAF_SIZE : LEAF_SIZE / 2;
+        vector<Entry> right(leaf.begin() + keep, leaf.end());
+        right.reserve(LEAF_SIZE);
+        leaf.resize(keep);
+        firsts.insert(firsts.begin() + i + 1, right.front());
+        leaves.insert(leaves.begin() + i + 1, move(right));
+    }
+}
+
+bool KeyTree::remove(int64_t key, Document *doc)
+{
+    if (leaves.empty())
+        return false;
+    Entry e{key, doc};
+    size_t i = leaf_for(e);
+    vector<Entry> &leaf = leaves[i];
+    auto it = lower_bound(leaf.begin(), leaf.end(), e, entry_less);
+    if (it == leaf.end() || it->key != key || it->doc != doc)
+        return false;
+    leaf.erase(it);
+    count--;
+
+    if (leaf.empty())
+    {
+        leaves.erase(leaves.begin() + i);
+        firsts.erase(firsts.begin() + i);
+    }
+    else
+    {
+        firsts[i] = leaf.front();
+    }
+    return true;
+}
+
+size_t KeyTree::size() const
+{
+    return count;
+}
+
+// дни от 1970-01-01 для даты григорианского календаря
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+static void civil_from_days(int64_t z, int64_t &y, unsigned &m, unsigned &d)
+{
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+bool OrderedIndex::parseIsoMillis(string_view s, int64_t &ms)
+{
+    static const char layout[] = "dddd-dd-ddTdd:dd:dd.dddZ";
+    if (s.size() != 24)
+        return false;
+    for (size_t i = 0; i < 24; i++)
+    {
+        if (layout[i] == 'd' ? (s[i] < '0' || s[i] > '9') : s[i] != layout[i])
+            return false;
+    }
+    auto num = [&](size_t pos, size_t len)
+    {
+        int v = 0;
+        for (size_t i = pos; i < pos + len; i++)
+            v = v * 10 + (s[i] - '0');
+        return v;
+    };
+    int y = num(0, 4), mo = num(5, 2), d = num(8, 2);
+    int h = num(11, 2), mi = num(14, 2), sec = num(17, 2), milli = num(20, 3);
+
+    // только настоящие даты: иначе порядок чисел разойдётся со строковым
+    static const int month_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (mo < 1 || mo > 12 || h > 23 || mi > 59 || sec > 59)
+        return false;
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    int max_day = month_days[mo - 1] + (mo == 2 && leap ? 1 : 0);
+    if (d < 1 || d > max_day)
+        return false;
+
+    int64_t days = days_from_civil(y, static_cast<unsigned>(mo), static_cast<unsigned>(d));
+    ms = ((days * 24 + h) * 60 + mi) * 60 + sec;
+    ms = ms * 1000 + milli;
+    return true;
+}
+
+void OrderedIndex::formatIsoMillis(int64_t ms, char out[24])
+{
+    int64_t days = ms >= 0 ? ms / 86400000 : -((-ms + 86399999) / 86400000);
+    int64_t rest = ms - days * 86400000;
+    int64_t y = 0;
+    unsigned m = 0, d = 0;
+    civil_from_days(days, y, m, d);
+
+    unsigned h = static_cast<unsigned>(rest / 3600000);
+    unsigned mi = static_cast<unsigned>(rest / 60000 % 60);
+    unsigned sec = static_cast<unsigned>(rest / 1000 % 60);
+    unsigned milli = static_cast<unsigned>(rest % 1000);
+    auto put = [&](size_t pos, size_t len, unsigned v)
+    {
+        for (size_t i = pos + len; i-- > pos;)
+        {
+            out[i] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        }
+    };
+    memcpy(out, "0000-00-00T00:00:00.000Z", 24);
+    put(0, 4, static_cast<unsigned>(y));
+    put(5, 2, m);
+    put(8, 2, d);
+    put(11, 2, h);
+    put(14, 2, mi);
+    put(17, 2, sec);
+    put(20, 3, milli);
+}
+
+OrderedIndex::OrderedIndex(uint32_t field_id) : field_id(field_id) {}
+
+uint32_t OrderedIndex::fieldId() const
+{
+    return field_id;
+}
+
+size_t OrderedIndex::size() const
+{
+    return times.size() + ints.size() + others.size();
+}
+
+OrderedIndex::KeyKind OrderedIndex::key_of(const Document *doc, const FieldDictionary &dict, int64_t &key) const
+{
+    string_view value;
+    if (!doc->getField(field_id, value, dict))
+        return KeyKind::None;
+    value = trim_view(value);
+    if (parseIsoMillis(value, key))
+        return KeyKind::Time;
+    int num = 0;
+    if (is_integer_string(value) && parse_int(value, num))
+    {
+        key = num;
+        return KeyKind::Int;
+    }
+    return KeyKind::Other;
+}
+
+void OrderedIndex::add(Document *doc, const FieldDictionary &dict)
+{
+    int64_t key = 0;
+    switch (key_of(doc, dict, key))
+    {
+    case KeyKind::Time:
+        times.insert(key, doc);
+        break;
+    case KeyKind::Int:
+        ints.insert(key, doc);
+        break;
+    case KeyKind::Other:
+        others.push_back(doc);
+        break;
+    default:
+        break;
+    }
+}
+
+void OrderedIndex::remove(Document *doc, const FieldDictionary &dict)
+{
+    int64_t key = 0;
+    switch (key_of(doc, dict, key))
+    {
+    case KeyKind::Time:
+        times.remove(key, doc);
+        break;
+    case KeyKind::Int:
+        ints.remove(key, doc);
+        break;
+    case KeyKind::Other:
+        for (size_t i = others.size(); i-- > 0;)
+        {
+            if (others[i] == doc)
+            {
+                others[i] = others.back();
+                others.pop_back();
+                break;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+bool OrderedIndex::rangeCandidates(const ValueCondition &cond, size_t limit, vector<Document *> &out) const
+{
+    out.clear();
+    if (others.size() > limit)
+        return false;
+
+    // время - всегда нецелая строка: сравнение с любой границей строковое,
+    // порядок ключей совпадает с порядком строк
+    size_t budget = limit - others.size();
+    auto compare_time = [](int64_t key, const string &bound)
+    {
+        char buf[24];
+        formatIsoMillis(key, buf);
+        return string_view(buf, 24).compare(bound);
+    };
+    bool ok = times.collect([&](int64_t key)
+                            { return cond.has_gt && compare_time(key, cond.gt.text) <= 0; },
+                            [&](int64_t key)
+                            { return cond.has_lt && compare_time(key, cond.lt.text) >= 0; },
+                            budget, out);
+    if (!ok)
+        return false;
+
+    // целые: с целой границей - как числа, с нецелой - как строки (порядок не помогает);
+    // целая граница вне int ни с одним целым не сравнима
+    bool ints_empty = (cond.has_gt && cond.gt.is_int && !cond.gt.int_ok) ||
+                      (cond.has_lt && cond.lt.is_int && !cond.lt.int_ok);
+    if (!ints_empty)
+    {
+        bool by_gt = cond.has_gt && cond.gt.is_int;
+        bool by_lt = cond.has_lt && cond.lt.is_int;
+        ok = ints.collect([&](int64_t key)
+                          { return by_gt && key <= cond.gt.value; },
+                          [&](int64_t key)
+                          { return by_lt && key >= cond.lt.value; },
+                          budget - out.size(), out);
+        if (!ok)
+            return false;
+    }
+
+    out.insert(out.end(), others.begin(), others.end());
+    return true;
+}
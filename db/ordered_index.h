@@ -0,0 +1,161 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "document.h"
+#include "field_dictionary.h"
+#include "query.h"
+
+// упорядоченные пары (ключ, документ): двухуровневое B+-дерево -
+// каталог первых записей листов + листы до LEAF_SIZE записей;
+// одинаковые ключи различаются указателем документа
+class KeyTree
+{
+public:
+    struct Entry
+    {
+        std::int64_t key;
+        Document *doc;
+    };
+
+private:
+    static const std::size_t LEAF_SIZE = 256;
+    std::vector<std::vector<Entry>> leaves;
+    std::vector<Entry> firsts; // firsts[i] - первая запись leaves[i]
+    std::size_t count;
+
+    std::size_t leaf_for(const Entry &e) const;
+
+public:
+    KeyTree();
+
+    void insert(std::int64_t key, Document *doc);
+    bool remove(std::int64_t key, Document *doc);
+    std::size_t size() const;
+
+    // обход записей по возрастанию ключа от первой, для которой before(key) ложно
+    // (before монотонна); visit(entry) возвращает false, чтобы остановиться
+    template <typename Before, typename Visit>
+    void scan(Before before, Visit visit) const
+    {
+        if (leaves.empty())
+            return;
+
+        // последний лист, первая запись которого ещё до диапазона
+        std::size_t lo = 0, hi = firsts.size();
+        while (lo < hi)
+        {
+            std::size_t mid = (lo + hi) / 2;
+            if (before(firsts[mid].key))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        std::size_t leaf = lo > 0 ? lo - 1 : 0;
+
+        const std::vector<Entry> *entries = &leaves[leaf];
+        std::size_t pos = 0, end = entries->size();
+        while (pos < end)
+        {
+            std::size_t mid = (pos + end) / 2;
+            if (before((*entries)[mid].key))
+                pos = mid + 1;
+            else
+                end = mid;
+        }
+
+        while (leaf < leaves.size())
+        {
+            entries = &leaves[leaf];
+            for (; pos < entries->size(); pos++)
+            {
+                if (!visit((*entries)[pos]))
+                    return;
+            }
+            leaf++;
+            pos = 0;
+        }
+    }
+
+    // записи от первой, для которой before(key) ложно, до первой, для которой
+    // after(key) истинно (обе функции монотонны); false - записей больше limit, out тогда неполон
+    template <typename Before, typename After>
+    bool collect(Before before, After after, std::size_t limit, std::vector<Document *> &out) const
+    {
+        bool ok = true;
+        std::size_t taken = 0;
+        scan(before, [&](const Entry &e)
+             {
+            if (after(e.key))
+                return false;
+            if (++taken > limit)
+            {
+                ok = false;
+                return false;
+            }
+            out.push_back(e.doc);
+            return true; });
+        return ok;
+    }
+};
+
+// упорядоченный индекс по значению одного поля для $gt/$lt.
+// Ключи повторяют правила сравнения запросов:
+//   время ISO-8601 UTC вида "2026-10-10T01:13:00.000Z" (как пишет агент) хранится
+//   миллисекундами от эпохи - для таких строк порядок чисел совпадает со строковым,
+//   поэтому строковая граница ищется двоичным поиском по отформатированным ключам;
+//   целые в пределах int сравниваются с целой границей как числа;
+//   прочие значения попадают в кандидаты любого диапазона и проверяются запросом
+class OrderedIndex
+{
+private:
+    std::uint32_t field_id;
+    KeyTree times;
+    KeyTree ints;
+    std::vector<Document *> others;
+
+    enum class KeyKind
+    {
+        Time,
+        Int,
+        Other,
+        None // поля нет
+    };
+    KeyKind key_of(const Document *doc, const FieldDictionary &dict, std::int64_t &key) const;
+
+public:
+    explicit OrderedIndex(std::uint32_t field_id);
+    OrderedIndex(const OrderedIndex &) = delete;
+    OrderedIndex &operator=(const OrderedIndex &) = delete;
+
+    std::uint32_t fieldId() const;
+    std::size_t size() const;
+
+    void add(Document *doc, const FieldDictionary &dict);
+    void remove(Document *doc, const FieldDictionary &dict);
+
+    // кандидаты для условия с $gt/$lt (надмножество ответа);
+    // false - кандидатов больше limit, выгоднее другой план
+    bool rangeCandidates(const ValueCondition &cond, std::size_t limit, std::vector<Document *> &out) const;
+
+    // время документов (в миллисекундах) из [from_ms, to_ms) по возрастанию, без чтения документов
+    template <typename F>
+    void forEachTime(std::int64_t from_ms, std::int64_t to_ms, F &&visit) const
+    {
+        times.scan([&](std::int64_t key)
+                   { return key < from_ms; },
+                   [&](const KeyTree::Entry &e)
+                   {
+                       if (e.key >= to_ms)
+                           return false;
+                       visit(e.key);
+                       return true;
+                   });
+    }
+
+    // "YYYY-MM-DDTHH:MM:SS.mmmZ" <-> миллисекунды от эпохи (только корректные даты)
+    static bool parseIsoMillis(std::string_view s, std::int64_t &ms);
+    static void formatIsoMillis(std::int64_t ms, char out[24]);
+};
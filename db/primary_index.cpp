@@ -0,0 +1,194 @@
+#include "primary_index.h"
+#include "utills.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// целое со знаком или без - такие _id запросы сравнивают как числа
+static bool looks_integer(const string &key)
+{
+    size_t i = (!key.empty() && (key[0] == '+' || key[0] == '-')) ? 1 : 0;
+    if (i == key.size())
+        return false;
+    for (; i < key.size(); i++)
+    {
+        if (key[i] < '0' || key[i] > '9')
+            return false;
+    }
+    return true;
+}
+
+PrimaryIndex::PrimaryIndex() : dense_size(0), fallback_numeric(0) {}
+
+PrimaryIndex::~PrimaryIndex()
+{
+    for (Page *page : pages)
+    {
+        if (!page)
+            continue;
+        for (size_t i = 0; i < PAGE_SIZE; i++)
+        {
+            delete page->docs[i];
+        }
+        free(page);
+    }
+}
+
+bool PrimaryIndex::parseDenseId(const string &key, uint64_t &id)
+{
+    // 2^32 - 10 цифр
+    if (key.empty() || key.size() > 10 || (key[0] == '0' && key.size() > 1))
+        return false;
+    uint64_t v = 0;
+    for (char c : key)
+    {
+        if (c < '0' || c > '9')
+            return false;
+        v = v * 10 + static_cast<uint64_t>(c - '0');
+    }
+    if (v >= DENSE_LIMIT)
+        return false;
+    id = v;
+    return true;
+}
+
+Document *PrimaryIndex::put_dense(uint64_t id, Document *value, bool delete_on_update)
+{
+    size_t p = static_cast<size_t>(id >> PAGE_BITS);
+    if (p >= pages.size())
+    {
+        pages.resize(p + 1, nullptr);
+    }
+    if (!pages[p])
+    {
+        // calloc: пустая страница - нулевые указатели
+        pages[p] = static_cast<Page *>(calloc(1, sizeof(Page)));
+        if (!pages[p])
+            throw bad_alloc();
+    }
+
+    Page *page = pages[p];
+    Document *&cell = page->docs[id & (PAGE_SIZE - 1)];
+    Document *prev = cell;
+    if (!prev)
+    {
+        page->count++;
+        dense_size++;
+    }
+    else if (delete_on_update && prev != value)
+    {
+        delete prev;
+    }
+    cell = value;
+    return prev;
+}
+
+Document *PrimaryIndex::remove_dense(uint64_t id)
+{
+    size_t p = static_cast<size_t>(id >> PAGE_BITS);
+    if (p >= pages.size() || !pages[p])
+        return nullptr;
+
+    Page *page = pages[p];
+    Document *&cell = page->docs[id & (PAGE_SIZE - 1)];
+    Document *removed = cell;
+    if (!removed)
+        return nullptr;
+
+    cell = nullptr;
+    dense_size--;
+    if (--page->count == 0)
+    {
+        free(page);
+        pages[p] = nullptr;
+    }
+    return removed;
+}
+
+void PrimaryIndex::put(const string &key, Document *value, bool delete_on_update)
+{
+    if (needs_trim(key))
+    {
+        put(trim(key), value, delete_on_update);
+        return;
+    }
+
+    uint64_t id = 0;
+    if (parseDenseId(key, id))
+    {
+        put_dense(id, value, delete_on_update);
+        return;
+    }
+
+    bool is_new = fallback.get(key) == nullptr;
+    fallback.put(key, value, delete_on_update);
+    if (is_new && looks_integer(key))
+    {
+        fallback_numeric++;
+    }
+}
+
+Document *PrimaryIndex::get(const string &key) const
+{
+    if (needs_trim(key))
+    {
+        return get(trim(key));
+    }
+    uint64_t id = 0;
+    if (parseDenseId(key, id))
+    {
+        return getDense(id);
+    }
+    return fallback.get(key);
+}
+
+Document *PrimaryIndex::getDense(uint64_t id) const
+{
+    size_t p = static_cast<size_t>(id >> PAGE_BITS);
+    if (p >= pages.size() || !pages[p])
+        return nullptr;
+    return pages[p]->docs[id & (PAGE_SIZE - 1)];
+}
+
+Document *PrimaryIndex::remove(const string &key)
+{
+    if (needs_trim(key))
+    {
+        return remove(trim(key));
+    }
+    uint64_t id = 0;
+    if (parseDenseId(key, id))
+    {
+        return remove_dense(id);
+    }
+
+    Document *removed = fallback.remove(key);
+    if (removed && looks_integer(key))
+    {
+        fallback_numeric--;
+    }
+    return removed;
+}
+
+// автоматические _id идут подряд с 1 - хватает каталога на expected_size страниц
+void PrimaryIndex::reserve(size_t expected_size)
+{
+    pages.reserve((expected_size >> PAGE_BITS) + 1);
+}
+
+size_t PrimaryIndex::getSize() const
+{
+    return dense_size + fallback.getSize();
+}
+
+size_t PrimaryIndex::fallbackSize() const
+{
+    return fallback.getSize();
+}
+
+size_t PrimaryIndex::fallbackNumeric() const
+{
+    return fallback_numeric;
+}
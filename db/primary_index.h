@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "custom_hashmap.h"
+#include "document.h"
+
+// первичный индекс по _id
+//   канонические числовые _id ("1", "42": только цифры, без ведущих нулей, < 2^32)
+//   лежат в двухуровневом массиве: каталог страниц + страницы по PAGE_SIZE указателей,
+//   страница выделяется при первой вставке и освобождается, когда пустеет;
+//   остальные _id (строки, "007", большие числа из старых файлов) - в CustomHashMap
+class PrimaryIndex
+{
+private:
+    static const unsigned PAGE_BITS = 12;
+    static const std::size_t PAGE_SIZE = std::size_t(1) << PAGE_BITS;
+
+    struct Page
+    {
+        Document *docs[PAGE_SIZE];
+        std::size_t count;
+    };
+
+    std::vector<Page *> pages; // индекс в каталоге = id >> PAGE_BITS
+    std::size_t dense_size;
+    CustomHashMap fallback;
+    std::size_t fallback_numeric; // ключей fallback, которые сравниваются как целые ("007", "-1")
+
+    Document *put_dense(std::uint64_t id, Document *value, bool delete_on_update);
+    Document *remove_dense(std::uint64_t id);
+
+public:
+    static const std::uint64_t DENSE_LIMIT = std::uint64_t(1) << 32;
+
+    PrimaryIndex();
+    ~PrimaryIndex();
+    PrimaryIndex(const PrimaryIndex &) = delete;
+    PrimaryIndex &operator=(const PrimaryIndex &) = delete;
+
+    // true, если key - канонический числовой _id плотной части
+    static bool parseDenseId(const std::string &key, std::uint64_t &id);
+
+    void put(const std::string &key, Document *value, bool delete_on_update = true);
+    Document *get(const std::string &key) const;
+    Document *getDense(std::uint64_t id) const;
+    Document *remove(const std::string &key);
+    void reserve(std::size_t expected_size);
+
+    std::size_t getSize() const;
+    std::size_t fallbackSize() const;
+    std::size_t fallbackNumeric() const;
+
+    // обход плотной части в порядке возрастания id, границы включительно
+    template <typename F>
+    void forEachDense(std::uint64_t lo, std::uint64_t hi, F &&visit) const
+    {
+        for (std::size_t p = lo >> PAGE_BITS; p < pages.size() && p <= (hi >> PAGE_BITS); p++)
+        {
+            const Page *page = pages[p];
+            if (!page)
+                continue;
+            std::size_t from = (p == (lo >> PAGE_BITS)) ? (lo & (PAGE_SIZE - 1)) : 0;
+            std::size_t to = (p == (hi >> PAGE_BITS)) ? (hi & (PAGE_SIZE - 1)) : PAGE_SIZE - 1;
+            for (std::size_t i = from; i <= to; i++)
+            {
+                if (page->docs[i])
+                    visit(page->docs[i]);
+            }
+        }
+    }
+
+    template <typename F>
+    void forEachFallback(F &&visit) const
+    {
+        for (std::size_t i = 0; fallback.getSize() > 0 && i < fallback.getCapacity(); i++)
+        {
+            const HashSlot *slot = fallback.getSlot(i);
+            if (slot && slot->value)
+                visit(slot->value);
+        }
+    }
+
+    template <typename F>
+    void forEach(F &&visit) const
+    {
+        forEachDense(0, DENSE_LIMIT - 1, visit);
+        forEachFallback(visit);
+    }
+};
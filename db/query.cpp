@@ -0,0 +1,688 @@
+#include "query.h"
+
+#include <sstream>
+#include <cstring>
+
+using namespace std;
+
+void QueryLiteral::set(string s)
+{
+    text = move(s);
+    is_int = is_integer_string(text);
+    int_ok = is_int && parse_int(text, value);
+}
+
+// сравнение значения документа с литералом: оба целые - как int, иначе как строки;
+// false - целое не влезает в int, такое сравнение ложно при любом операторе
+static bool compare_literal(string_view doc_value, const QueryLiteral &literal, int &cmp)
+{
+    if (literal.is_int && is_integer_string(doc_value))
+    {
+        int lhs = 0;
+        if (!literal.int_ok || !parse_int(doc_value, lhs))
+            return false;
+        cmp = lhs < literal.value ? -1 : (lhs > literal.value ? 1 : 0);
+        return true;
+    }
+    cmp = doc_value.compare(literal.text);
+    return true;
+}
+
+void LikePattern::compile(const string &p)
+{
+    segments.clear();
+    segments.push_back(Segment{"", false});
+    has_percent = false;
+    min_length = 0;
+    for (char c : p)
+    {
+        if (c == '%')
+        {
+            has_percent = true;
+            segments.push_back(Segment{"", false});
+            continue;
+        }
+        segments.back().text.push_back(c);
+        segments.back().has_any |= c == '_';
+        min_length++;
+    }
+}
+
+// кусок лежит в value с позиции pos (вызывающий проверил, что влезает)
+bool LikePattern::match_at(string_view value, size_t pos, const Segment &seg)
+{
+    if (!seg.has_any)
+        return memcmp(value.data() + pos, seg.text.data(), seg.text.size()) == 0;
+    for (size_t i = 0; i < seg.text.size(); i++)
+    {
+        if (seg.text[i] != '_' && seg.text[i] != value[pos + i])
+            return false;
+    }
+    return true;
+}
+
+// самое левое вхождение куска в value[from, to); npos - нет
+size_t LikePattern::find(string_view value, size_t from, size_t to, const Segment &seg)
+{
+    size_t len = seg.text.size();
+    if (to < from || to - from < len)
+        return string_view::npos;
+    if (!seg.has_any)
+    {
+        const void *hit = memmem(value.data() + from, to - from, seg.text.data(), len);
+        return hit ? static_cast<const char *>(hit) - value.data() : string_view::npos;
+    }
+    for (size_t pos = from; pos + len <= to; pos++)
+    {
+        if (match_at(value, pos, seg))
+            return pos;
+    }
+    return string_view::npos;
+}
+
+bool LikePattern::match(string_view value) const
+{
+    if (!has_percent)
+        return value.size() == min_length && match_at(value, 0, segments[0]);
+    if (value.size() < min_length)
+        return false;
+
+    const Segment &first = segments.front();
+    const Segment &last = segments.back();
+    size_t end = value.size() - last.text.size();
+    if (!match_at(value, 0, first) || !match_at(value, end, last))
+        return false;
+
+    // жадно: самое левое вхождение каждого куска оставляет остальным больше места
+    size_t pos = first.text.size();
+    for (size_t i = 1; i + 1 < segments.size(); i++)
+    {
+        const Segment &seg = segments[i];
+        if (seg.text.empty())
+            continue;
+        size_t found = find(value, pos, end, seg);
+        if (found == string_view::npos)
+            return false;
+        pos = found + seg.text.size();
+    }
+    return true;
+}
+
+bool ValueCondition::matches(string_view doc_value_raw) const
+{
+    if (never)
+        return false;
+
+    string_view doc_value = trim_view(doc_value_raw);
+    int cmp = 0;
+    if (has_eq && (!compare_literal(doc_value, eq, cmp) || cmp != 0))
+        return false;
+    if (has_gt && (!compare_literal(doc_value, gt, cmp) || cmp <= 0))
+        return false;
+    if (has_lt && (!compare_literal(doc_value, lt, cmp) || cmp >= 0))
+        return false;
+    if (has_like && !like.match(doc_value))
+        return false;
+    if (has_in)
+    {
+        // целое значение сравнивается с целыми элементами как число,
+        // со строковыми совпасть не может (равные строки обе были бы целыми)
+        if (is_integer_string(doc_value))
+        {
+            int v = 0;
+            if (in_ints.empty() || !parse_int(doc_value, v) || in_ints.count(v) == 0)
+                return false;
+        }
+        else if (in_strings.count(doc_value) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// значение оператора из объекта условия {"$gt": 5, ...}; "" - оператора нет
+static string extract_operator_value(const string &condition, const string &op_key)
+{
+    string op_search = "\"" + op_key + "\":";
+    size_t pos = condition.find(op_search); // поиск оператора
+    if (pos == string::npos)
+        return "";
+
+    size_t start_search = pos + op_search.length();
+    size_t start_val = condition.find_first_not_of(" \t\n\r", start_search);
+    if (start_val == string::npos)
+        return "";
+
+    if (condition[start_val] == '"')
+    {
+        // строка
+        size_t start_content = start_val + 1;
+        size_t end_content = condition.find('"', start_content);
+        if (end_content == string::npos)
+            return "";
+        return trim(condition.substr(start_content, end_content - start_content));
+    }
+    else
+    {
+        // число или сырой литерал
+        size_t end_val = condition.find_first_of(",}", start_val);
+        if (end_val == string::npos)
+            return "";
+        return trim(condition.substr(start_val, end_val - start_val));
+    }
+}
+
+// элементы массива $in (in_pos - позиция "$in":) без кавычек; false - массив кривой
+static bool extract_in_items(const string &condition, size_t in_pos, vector<string> &items)
+{
+    size_t array_start = condition.find('[', in_pos);
+    if (array_start == string::npos)
+        return false;
+    size_t array_end = condition.find(']', array_start);
+    if (array_end == string::npos)
+        return false;
+
+    string array_content = condition.substr(array_start + 1, array_end - array_start - 1);
+    stringstream ss(array_content);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        string trimmed_item = trim(item);
+        if (trimmed_item.length() >= 2 &&
+            trimmed_item.front() == '"' &&
+            trimmed_item.back() == '"')
+        {
+            trimmed_item = trimmed_item.substr(1, trimmed_item.length() - 2);
+        }
+        items.push_back(trim(trimmed_item));
+    }
+    return true;
+}
+
+// литерал условия без кавычек: 5, "5", " abc "
+static string unquote_literal(const string &raw)
+{
+    string value = trim(raw);
+    if (value.length() >= 2 && value.front() == '"' && value.back() == '"')
+    {
+        value = value.substr(1, value.length() - 2);
+    }
+    return trim(value);
+}
+
+// очередная пара "поле": условие из тела запроса без внешних скобок
+enum class QueryField
+{
+    Ok,
+    End,
+    Error // кривой JSON
+};
+
+static QueryField next_query_field(const string &content, size_t &pos,
+                                   string &field_name, string &condition_value)
+{
+    // пропускаем пробелы, табы и запятые
+    while (pos < content.size() &&
+           (content[pos] == ' ' ||
+            content[pos] == '\t' ||
+            content[pos] == '\n' ||
+            content[pos] == '\r' ||
+            content[pos] == ','))
+    {
+        ++pos;
+    }
+    if (pos >= content.length())
+        return QueryField::End;
+
+    // парсим имя поля value(city)
+    size_t start_key = content.find('"', pos);
+    if (start_key == string::npos)
+        return QueryField::End;
+
+    size_t end_key = content.find('"', start_key + 1);
+    if (end_key == string::npos)
+        return QueryField::Error; // кривой JSON "name":
+
+    field_name = content.substr(start_key + 1, end_key - start_key - 1);
+
+    // ищем начало этого значения
+
+    size_t start_val_search = content.find(':', end_key);
+    if (start_val_search == string::npos)
+        return QueryField::Error;
+
+    size_t val_start_char = content.find_first_not_of(" \t", start_val_search + 1);
+    if (val_start_char == string::npos)
+        return QueryField::Error;
+
+    // определяем конец значения
+    size_t end_val = string::npos;
+    char first_char = content[val_start_char];
+
+    if (first_char == '{' || first_char == '[')
+    {
+        // объект или массив
+        char open_char = first_char;
+        char close_char = (open_char == '{') ? '}' : ']';
+
+        int bracket_count = 0;
+        end_val = val_start_char;
+        bool found_end = false;
+
+        while (end_val < content.length())
+        {
+            if (content[end_val] == open_char)
+                bracket_count++;
+            if (content[end_val] == close_char)
+            {
+                bracket_count--;
+                if (bracket_count == 0)
+                {
+                    found_end = true;
+                    break;
+                }
+            }
+            end_val++;
+        }
+
+        if (!found_end)
+            return QueryField::Error;
+    }
+    else if (first_char == '"')
+    {
+        // строка
+        size_t end_quote = content.find('"', val_start_char + 1);
+        if (end_quote == string::npos)
+            return QueryField::Error;
+        end_val = end_quote;
+    }
+    else
+    {
+        // число или литерал
+        size_t separator_pos = content.find_first_of(",}", val_start_char);
+        size_t boundary = (separator_pos == string::npos)
+                              ? content.length()
+                              : separator_pos;
+
+        end_val = boundary - 1;
+        while (end_val > val_start_char &&
+               (content[end_val] == ' ' || content[end_val] == '\t'))
+        {
+            end_val--;
+        }
+    }
+
+    if (end_val == string::npos || end_val < val_start_char)
+        return QueryField::Error;
+
+    // само значение условия
+    size_t length = end_val - val_start_char + 1;
+    condition_value = content.substr(val_start_char, length);
+
+    // двигаемся дальше
+    pos = end_val + 1;
+    return QueryField::Ok;
+}
+
+// первый ключ объекта запроса ("" - не объект или ключей нет)
+static string first_query_key(const string &query)
+{
+    if (query.empty() || query.front() != '{')
+        return "";
+    size_t first_quote = query.find('"');
+    if (first_quote == string::npos)
+        return "";
+    size_t second_quote = query.find('"', first_quote + 1);
+    if (second_quote == string::npos)
+        return "";
+    return query.substr(first_quote + 1, second_quote - first_quote - 1);
+}
+
+CompiledQuery::CompiledQuery(const string &query_json, const FieldDictionary &field_dict, bool match_by_code)
+    : dict(field_dict), match_by_code(match_by_code)
+{
+    root = compile_node(query_json);
+}
+
+// решает как разбирать: пустой запрос, $or, $and или неявный AND
+unique_ptr<QueryNode> CompiledQuery::compile_node(const string &query_json) const
+{
+    string query = trim(query_json);
+    if (query.empty() || query == "{}")
+    {
+        unique_ptr<QueryNode> node(new QueryNode);
+        node->kind = QueryNode::Kind::All;
+        return node;
+    }
+
+    // если это объект смотрим на первый ключ
+    string first_key = first_query_key(query);
+    if (first_key == "$or" || first_key == "$and")
+    {
+        return compile_list(query, first_key);
+    }
+
+    // по умолчанию — неявный AND
+    return compile_fields(query);
+}
+
+// {"$or": [ { ... }, { ... }, ... ]} и {"$and": [...]}; каждое подусловие - полноценный
+// подзапрос (там может быть и $and, и $or)
+unique_ptr<QueryNode> CompiledQuery::compile_list(const string &query, const string &key) const
+{
+    unique_ptr<QueryNode> node(new QueryNode);
+    bool is_or = key == "$or";
+
+    string search_key = "\"" + key + "\":";
+    size_t pos = query.find(search_key);
+    if (pos == string::npos)
+        return node;
+
+    // Находим границы массива условий
+    size_t array_start = query.find('[', pos + search_key.length());
+    if (array_start == string::npos)
+        return node;
+
+    size_t array_end = query.find_last_of(']');
+    if (array_end == string::npos || array_end < array_start)
+        return node;
+
+    string array_content = query.substr(array_start + 1, array_end - array_start - 1); // убираем скобки
+
+    size_t current_pos = 0;
+    while (current_pos < array_content.length())
+    {
+        // ищем начало объекта-условия
+        size_t start_cond = array_content.find('{', current_pos);
+        if (start_cond == string::npos)
+            break;
+
+        size_t end_cond = start_cond;
+        int bracket_count = 0;
+        bool found_end = false;
+
+        // ищем конец объекта с учётом вложенных { }
+        while (end_cond < array_content.length())
+        {
+            if (array_content[end_cond] == '{')
+                bracket_count++;
+            if (array_content[end_cond] == '}')
+            {
+                bracket_count--;
+                if (bracket_count == 0)
+                {
+                    found_end = true;
+                    break;
+                }
+            }
+            end_cond++;
+        }
+
+        if (!found_end)
+        {
+            // $or успевает совпасть по подусловиям до кривого, $and - уже нет
+            if (!is_or)
+                node->children.clear();
+            break;
+        }
+
+        string sub_query = array_content.substr(start_cond, end_cond - start_cond + 1);
+        node->children.push_back(compile_node(sub_query));
+        current_pos = end_cond + 1;
+    }
+
+    // Если подусловий не было считаем что документ не подходит
+    if (!node->children.empty())
+        node->kind = is_or ? QueryNode::Kind::Or : QueryNode::Kind::And;
+    return node;
+}
+
+// неявный AND: {"поле": условие, ...}
+unique_ptr<QueryNode> CompiledQuery::compile_fields(const string &query) const
+{
+    unique_ptr<QueryNode> node(new QueryNode);
+
+    // ожидаем объект вида {...}
+    if (query.front() != '{' || query.back() != '}')
+        return node;
+
+    // убираем внешние скобки
+    string content = query.substr(1, query.length() - 2);
+    size_t current_pos = 0;
+    string field_name;
+    string condition_value;
+
+    while (true)
+    {
+        QueryField parsed = next_query_field(content, current_pos, field_name, condition_value);
+        if (parsed == QueryField::End)
+            break;
+        if (parsed == QueryField::Error)
+        {
+            node->terms.clear();
+            return node;
+        }
+
+        unique_ptr<QueryTerm> term(new QueryTerm);
+        term->is_id = field_name == "_id";
+        if (!term->is_id)
+            term->field_id = dict.lookup(field_name);
+        compile_condition(condition_value, *term);
+        node->terms.push_back(move(term));
+    }
+    node->kind = QueryNode::Kind::Fields;
+    return node;
+}
+
+void CompiledQuery::compile_condition(const string &condition, QueryTerm &term) const
+{
+    ValueCondition &c = term.condition;
+    string trimmed = trim(condition);
+
+    // постой случай
+    if (trimmed.empty())
+    {
+        c.never = true;
+        return;
+    }
+
+    if (trimmed.front() != '{')
+    {
+        // неявное равенство
+        c.has_eq = true;
+        c.eq.set(unquote_literal(trimmed));
+    }
+    else
+    {
+        // объект операторов; пустое значение оператора - оператора нет
+        string value = extract_operator_value(trimmed, "$eq");
+        if (!value.empty())
+        {
+            c.has_eq = true;
+            c.eq.set(move(value));
+        }
+        value = extract_operator_value(trimmed, "$gt");
+        if (!value.empty())
+        {
+            c.has_gt = true;
+            c.gt.set(move(value));
+        }
+        value = extract_operator_value(trimmed, "$lt");
+        if (!value.empty())
+        {
+            c.has_lt = true;
+            c.lt.set(move(value));
+        }
+        value = extract_operator_value(trimmed, "$like");
+        if (!value.empty())
+        {
+            c.has_like = true;
+            c.like.compile(value);
+        }
+
+        size_t in_pos = trimmed.find("\"$in\":");
+        if (in_pos != string::npos)
+        {
+            c.has_in = true;
+            vector<string> items;
+            if (!extract_in_items(trimmed, in_pos, items))
+            {
+                c.never = true;
+                return;
+            }
+            c.in_items.resize(items.size());
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                c.in_items[i].set(move(items[i]));
+            }
+            // множества строятся после заполнения вектора: строки больше не переезжают
+            for (const QueryLiteral &item : c.in_items)
+            {
+                if (!item.is_int)
+                    c.in_strings.insert(item.text);
+                else if (item.int_ok)
+                    c.in_ints.insert(item.value);
+            }
+        }
+
+        // В объекте нет ни одного из известных операторов
+        if (!c.has_eq && !c.has_gt && !c.has_lt && !c.has_like && !c.has_in)
+            c.never = true;
+    }
+
+    // равенство нечисловому литералу сравнивает строки целиком: в словаре
+    // значения без пробелов по краям, так что совпадение строк = совпадение кодов
+    if (match_by_code && c.has_eq && !c.eq.is_int && !term.is_id && term.field_id != FieldDictionary::NO_FIELD)
+    {
+        c.eq_by_code = true;
+        c.eq_code_known = dict.values(term.field_id).lookup(c.eq.text, c.eq_code);
+    }
+}
+
+bool CompiledQuery::match_term(const QueryTerm &term, const Document *doc) const
+{
+    const ValueCondition &c = term.condition;
+    if (term.is_id)
+        return c.matches(doc->_id);
+
+    Document::FieldRef ref;
+    if (term.field_id == FieldDictionary::NO_FIELD || !doc->getFieldRef(term.field_id, ref))
+    {
+        // поля нет - документ не удовлетворяет AND
+        return false;
+    }
+    if (!ref.encoded)
+        return c.matches(ref.raw);
+
+    if (c.eq_by_code)
+    {
+        // закодированные значения совпадают со строкой только по коду
+        if (!c.eq_code_known || ref.code != c.eq_code)
+            return false;
+        if (!c.never && !c.has_gt && !c.has_lt && !c.has_like && !c.has_in)
+            return true;
+    }
+    return c.matches(dict.values(term.field_id).decode(ref.code));
+}
+
+bool CompiledQuery::match_node(const QueryNode &node, const Document *doc) const
+{
+    switch (node.kind)
+    {
+    case QueryNode::Kind::All:
+        return true;
+    case QueryNode::Kind::None:
+        return false;
+    case QueryNode::Kind::Fields:
+        for (const auto &term : node.terms)
+        {
+            if (!match_term(*term, doc))
+                return false;
+        }
+        return true;
+    case QueryNode::Kind::And:
+        for (const auto &child : node.children)
+        {
+            if (!match_node(*child, doc))
+                return false;
+        }
+        return true;
+    case QueryNode::Kind::Or:
+        for (const auto &child : node.children)
+        {
+            if (match_node(*child, doc))
+                return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+bool CompiledQuery::matches(const Document *doc) const
+{
+    return match_node(*root, doc);
+}
+
+bool CompiledQuery::matchesAll() const
+{
+    return root->kind == QueryNode::Kind::All;
+}
+
+bool CompiledQuery::matchesNone() const
+{
+    return root->kind == QueryNode::Kind::None;
+}
+
+const ValueCondition *CompiledQuery::idCondition() const
+{
+    if (root->kind != QueryNode::Kind::Fields)
+        return nullptr;
+    for (const auto &term : root->terms)
+    {
+        if (term->is_id)
+            return &term->condition;
+    }
+    return nullptr;
+}
+
+const vector<unique_ptr<QueryTerm>> *CompiledQuery::rootTerms() const
+{
+    return root->kind == QueryNode::Kind::Fields ? &root->terms : nullptr;
+}
+
+bool splitJsonObject(const string &object_json, vector<pair<string, string>> &out)
+{
+    out.clear();
+    string object = trim(object_json);
+    if (object.size() < 2 || object.front() != '{' || object.back() != '}')
+        return false;
+
+    string content = object.substr(1, object.size() - 2);
+    size_t pos = 0;
+    string key;
+    string value;
+    while (true)
+    {
+        QueryField parsed = next_query_field(content, pos, key, value);
+        if (parsed == QueryField::End)
+            return true;
+        if (parsed == QueryField::Error)
+            return false;
+        out.emplace_back(key, value);
+    }
+}
+
+bool splitJsonArray(const string &array_json, vector<string> &out)
+{
+    out.clear();
+    string array = trim(array_json);
+    if (array.size() < 2 || array.front() != '[' || array.back() != ']')
+        return false;
+    return extract_in_items(array, 0, out);
+}
+
+string unquoteJsonValue(const string &raw)
+{
+    return unquote_literal(raw);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <cstdint>
+#include "document.h"
+#include "field_dictionary.h"
+
+// литерал условия; целое разобрано заранее, чтобы не звать stoi на каждый документ
+struct QueryLiteral
+{
+    std::string text;    // без кавычек и пробелов по краям
+    bool is_int = false; // записан как целое: сравнение с целым значением идёт как int
+    bool int_ok = false; // и помещается в int (иначе такое сравнение всегда ложно)
+    int value = 0;
+
+    void set(std::string s);
+};
+
+// шаблон $like: '%' - любая последовательность, '_' - ровно один символ.
+// Компилируется один раз на запрос: режется по '%' на куски фиксированной длины,
+// первый кусок привязан к началу значения, последний - к концу, средние ищутся
+// по порядку самым левым вхождением. Проверка линейна по длине значения
+// (без перебора с возвратами), кусок без '_' ищется через memmem - так
+// '%подстрока%' сводится к одному поиску подстроки
+class LikePattern
+{
+private:
+    struct Segment
+    {
+        std::string text;
+        bool has_any; // есть '_'
+    };
+    std::vector<Segment> segments; // без '%' - ровно один кусок на всё значение
+    bool has_percent = false;
+    std::size_t min_length = 0; // сумма длин кусков
+
+    static bool match_at(std::string_view value, std::size_t pos, const Segment &seg);
+    static std::size_t find(std::string_view value, std::size_t from, std::size_t to, const Segment &seg);
+
+public:
+    void compile(const std::string &p);
+    bool match(std::string_view value) const;
+};
+
+// скомпилированное условие на значение одного поля:
+// литерал (неявное равенство) или объект операторов, все операторы объединяются по AND
+struct ValueCondition
+{
+    bool never = false; // условие, под которое не подходит ни одно значение
+    bool has_eq = false, has_gt = false, has_lt = false, has_like = false, has_in = false;
+    QueryLiteral eq, gt, lt;
+    LikePattern like;
+
+    // $in: целые элементы - множеством чисел, остальные - множеством строк
+    std::vector<QueryLiteral> in_items;
+    std::unordered_set<int> in_ints;
+    std::unordered_set<std::string_view> in_strings; // смотрят в in_items
+
+    // равенство нечисловой строке: закодированное значение сравнивается по коду словаря
+    bool eq_by_code = false;
+    bool eq_code_known = false; // литерал есть в словаре (иначе закодированные не подходят)
+    std::uint16_t eq_code = 0;
+
+    ValueCondition() = default;
+    ValueCondition(const ValueCondition &) = delete;
+    ValueCondition &operator=(const ValueCondition &) = delete;
+
+    bool matches(std::string_view doc_value_raw) const;
+};
+
+// условие на одно поле; имя уже переведено в номер словаря
+struct QueryTerm
+{
+    bool is_id = false;
+    std::uint32_t field_id = FieldDictionary::NO_FIELD; // NO_FIELD - поля нет ни в одном документе
+    ValueCondition condition;
+};
+
+// узел дерева запроса
+struct QueryNode
+{
+    enum class Kind
+    {
+        All,    // {} - подходит всё
+        None,   // кривой запрос - не подходит ничего
+        Fields, // неявный AND условий на поля
+        And,    // {"$and": [...]}
+        Or      // {"$or": [...]}
+    };
+
+    Kind kind = Kind::None;
+    std::vector<std::unique_ptr<QueryTerm>> terms;     // Fields
+    std::vector<std::unique_ptr<QueryNode>> children;  // And, Or
+};
+
+// запрос, разобранный один раз: дальше документы проверяются без разбора JSON
+class CompiledQuery
+{
+private:
+    std::unique_ptr<QueryNode> root;
+    const FieldDictionary &dict;
+    bool match_by_code; // равенство строке - по коду словаря значений
+
+    std::unique_ptr<QueryNode> compile_node(const std::string &query_json) const;
+    std::unique_ptr<QueryNode> compile_list(const std::string &query, const std::string &key) const;
+    std::unique_ptr<QueryNode> compile_fields(const std::string &query) const;
+    void compile_condition(const std::string &condition, QueryTerm &term) const;
+
+    bool match_node(const QueryNode &node, const Document *doc) const;
+    bool match_term(const QueryTerm &term, const Document *doc) const;
+
+public:
+    // dict должен жить дольше запроса; имена, которых нет в словаре, ничему не равны.
+    // match_by_code = false - для запроса, который живёт дольше одной операции (представления):
+    // освобождённые коды словаря значений выдаются заново, поэтому сравнение идёт по строкам
+    CompiledQuery(const std::string &query_json, const FieldDictionary &dict, bool match_by_code = true);
+    CompiledQuery(const CompiledQuery &) = delete;
+    CompiledQuery &operator=(const CompiledQuery &) = delete;
+
+    bool matches(const Document *doc) const;
+    bool matchesAll() const;  // пустой запрос
+    bool matchesNone() const; // кривой запрос
+    // условие на _id корневого AND-запроса (nullptr - нет)
+    const ValueCondition *idCondition() const;
+    // условия корневого AND-запроса (nullptr - корень не AND по полям)
+    const std::vector<std::unique_ptr<QueryTerm>> *rootTerms() const;
+};
+
+// пары "ключ": значение объекта {...} тем же разбором, что и запросы
+// (значение - текст как есть: "abc", 5, {...}); false - не объект или кривой JSON
+bool splitJsonObject(const std::string &object_json, std::vector<std::pair<std::string, std::string>> &out);
+// элементы массива [...] без кавычек (как у $in): ["a", "b"] -> a, b
+bool splitJsonArray(const std::string &array_json, std::vector<std::string> &out);
+// значение без кавычек и пробелов по краям: 5, "5", " abc "
+std::string unquoteJsonValue(const std::string &raw);
@@ -0,0 +1,124 @@
+#include "scan_pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static size_t g_shared_workers = 0;
+
+ScanPool::ScanPool(size_t workers)
+    : job(nullptr), task_count(0), next_task(0), finished(0), generation(0), stop(false), failed(false)
+{
+    // вызывающий поток - последний номер, потоки пула - с 0
+    for (size_t w = 0; w + 1 < max<size_t>(1, workers); w++)
+    {
+        threads.emplace_back(&ScanPool::worker_loop, this, w);
+    }
+}
+
+ScanPool::~ScanPool()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        stop = true;
+    }
+    work_cv.notify_all();
+    for (thread &t : threads)
+    {
+        t.join();
+    }
+}
+
+size_t ScanPool::workers() const
+{
+    return threads.size() + 1;
+}
+
+void ScanPool::drain(size_t worker)
+{
+    while (!failed.load(memory_order_relaxed))
+    {
+        size_t task = next_task.fetch_add(1);
+        if (task >= task_count)
+            return;
+        try
+        {
+            (*job)(task, worker);
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(mtx);
+            if (!error)
+                error = current_exception();
+            failed = true;
+        }
+    }
+}
+
+void ScanPool::worker_loop(size_t worker)
+{
+    uint64_t seen = 0;
+    unique_lock<mutex> lock(mtx);
+    while (true)
+    {
+        work_cv.wait(lock, [&]
+                     { return stop || generation != seen; });
+        if (stop)
+            return;
+        seen = generation;
+        lock.unlock();
+        drain(worker);
+        lock.lock();
+        if (++finished == threads.size())
+            done_cv.notify_all();
+    }
+}
+
+void ScanPool::run(size_t tasks, const function<void(size_t task, size_t worker)> &task)
+{
+    // одна задача или пул занят другим проходом - без переключения потоков
+    unique_lock<mutex> run_lock(run_mtx, defer_lock);
+    if (tasks <= 1 || threads.empty() || !run_lock.try_lock())
+    {
+        for (size_t i = 0; i < tasks; i++)
+        {
+            task(i, threads.size());
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(mtx);
+        job = &task;
+        task_count = tasks;
+        next_task = 0;
+        finished = 0;
+        error = nullptr;
+        failed = false;
+        generation++;
+    }
+    work_cv.notify_all();
+    drain(threads.size());
+
+    // задачи розданы; ждём все потоки, чтобы ни один не остался со ссылкой на task
+    unique_lock<mutex> lock(mtx);
+    done_cv.wait(lock, [&]
+                 { return finished == threads.size(); });
+    job = nullptr;
+    exception_ptr failure = error;
+    error = nullptr;
+    if (failure)
+        rethrow_exception(failure); // блокировки снимутся при раскрутке
+}
+
+void ScanPool::setSharedWorkers(size_t workers)
+{
+    g_shared_workers = workers;
+}
+
+ScanPool &ScanPool::shared()
+{
+    static ScanPool pool(g_shared_workers > 0 ? g_shared_workers
+                                              : max<size_t>(1, thread::hardware_concurrency()));
+    return pool;
+}
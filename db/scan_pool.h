@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// пул потоков для полных проходов по базе: проход режется на куски (задачи),
+// потоки разбирают их по одному через общий счётчик, вызывающий поток работает вместе с ними.
+// Один проход за раз на весь процесс: если пул занят проходом другой базы,
+// run выполняет задачи сам в вызывающем потоке, а не ждёт
+class ScanPool
+{
+private:
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::mutex run_mtx; // занят на время прохода
+
+    // текущий проход (под mtx, кроме счётчика задач)
+    const std::function<void(std::size_t, std::size_t)> *job;
+    std::size_t task_count;
+    std::atomic<std::size_t> next_task;
+    std::size_t finished;        // потоков пула, закончивших текущий проход
+    std::uint64_t generation;    // номер прохода: каждый поток участвует в каждом проходе один раз
+    bool stop;
+    std::exception_ptr error; // первое исключение задачи прохода (под mtx)
+    std::atomic<bool> failed;  // после него оставшиеся задачи не запускаются
+
+    void worker_loop(std::size_t worker);
+    void drain(std::size_t worker); // разбирать задачи, пока они есть
+
+public:
+    // workers - степень параллелизма вместе с вызывающим потоком (1 - без потоков)
+    explicit ScanPool(std::size_t workers);
+    ~ScanPool();
+    ScanPool(const ScanPool &) = delete;
+    ScanPool &operator=(const ScanPool &) = delete;
+
+    std::size_t workers() const;
+    // task(номер задачи, номер потока < workers()) для всех задач [0, tasks); возвращается,
+    // когда выполнены все. Номер потока - для буферов без блокировок: у одного номера задачи
+    // выполняются по очереди. Исключение задачи (bad_alloc буфера и т.п.) останавливает проход
+    // и пробрасывается из run в вызывающем потоке, а не роняет процесс из потока пула
+    void run(std::size_t tasks, const std::function<void(std::size_t task, std::size_t worker)> &task);
+
+    // общий пул процесса; степень задаётся до первого обращения (0 - по числу ядер)
+    static void setSharedWorkers(std::size_t workers);
+    static ScanPool &shared();
+};
@@ -0,0 +1,154 @@
+#include "secondary_index.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+
+SecondaryIndex::SecondaryIndex(uint32_t field_id) : field_id(field_id) {}
+
+uint32_t SecondaryIndex::fieldId() const
+{
+    return field_id;
+}
+
+size_t SecondaryIndex::size() const
+{
+    return positions.size();
+}
+
+SecondaryIndex::KeyKind SecondaryIndex::key_of(const Document *doc, const FieldDictionary &dict,
+                                               string_view &str, int &num) const
+{
+    if (!doc->getField(field_id, str, dict))
+        return KeyKind::None;
+    str = trim_view(str);
+    if (!is_integer_string(str))
+        return KeyKind::String;
+
+    // целое: ключ - число, как в сравнении запроса
+    return parse_int(str, num) ? KeyKind::Int : KeyKind::None;
+}
+
+SecondaryIndex::Postings *SecondaryIndex::postings_of(const Document *doc, const FieldDictionary &dict)
+{
+    string_view str;
+    int num = 0;
+    switch (key_of(doc, dict, str, num))
+    {
+    case KeyKind::String:
+    {
+        auto it = by_string.find(string(str));
+        return it == by_string.end() ? nullptr : &it->second;
+    }
+    case KeyKind::Int:
+    {
+        auto it = by_int.find(num);
+        return it == by_int.end() ? nullptr : &it->second;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+void SecondaryIndex::append(Postings &list, Document *doc)
+{
+    positions[doc] = list.size();
+    list.push_back(doc);
+}
+
+void SecondaryIndex::add(Document *doc, const FieldDictionary &dict)
+{
+    string_view str;
+    int num = 0;
+    switch (key_of(doc, dict, str, num))
+    {
+    case KeyKind::String:
+        append(by_string[string(str)], doc);
+        break;
+    case KeyKind::Int:
+        append(by_int[num], doc);
+        break;
+    default:
+        break;
+    }
+}
+
+void SecondaryIndex::remove(Document *doc, const FieldDictionary &dict)
+{
+    auto it = positions.find(doc);
+    if (it == positions.end())
+        return;
+    size_t pos = it->second;
+    Postings *list = postings_of(doc, dict);
+    if (!list || pos >= list->size() || (*list)[pos] != doc)
+        return;
+
+    // на место удалённого встаёт последний документ списка
+    Document *last = list->back();
+    (*list)[pos] = last;
+    positions[last] = pos;
+    list->pop_back();
+    positions.erase(doc);
+    // пустые списки оставляем: значение скорее всего ещё встретится
+}
+
+void SecondaryIndex::removeBatch(const vector<Document *> &docs, const FieldDictionary &dict)
+{
+    if (docs.size() < 4)
+    {
+        for (Document *doc : docs)
+            remove(doc, dict);
+        return;
+    }
+
+    unordered_set<const Document *> gone(docs.begin(), docs.end());
+    unordered_set<Postings *> touched;
+    for (Document *doc : docs)
+    {
+        Postings *list = postings_of(doc, dict);
+        if (list)
+            touched.insert(list);
+    }
+    for (Postings *list : touched)
+    {
+        list->erase(remove_if(list->begin(), list->end(), [&](const Document *doc)
+                              { return gone.count(doc) != 0; }),
+                    list->end());
+        // после уплотнения оставшиеся документы сдвинулись
+        for (size_t i = 0; i < list->size(); i++)
+            positions[(*list)[i]] = i;
+    }
+    for (const Document *doc : gone)
+        positions.erase(doc);
+}
+
+const SecondaryIndex::Postings *SecondaryIndex::lookup(const QueryLiteral &literal) const
+{
+    if (literal.is_int)
+    {
+        if (!literal.int_ok)
+            return nullptr;
+        auto it = by_int.find(literal.value);
+        return it == by_int.end() ? nullptr : &it->second;
+    }
+    auto it = by_string.find(literal.text);
+    return it == by_string.end() ? nullptr : &it->second;
+}
+
+void SecondaryIndex::lookupIn(const ValueCondition &cond, vector<const Postings *> &out) const
+{
+    // разные ключи - непересекающиеся списки: у документа одно значение поля
+    for (int num : cond.in_ints)
+    {
+        auto it = by_int.find(num);
+        if (it != by_int.end() && !it->second.empty())
+            out.push_back(&it->second);
+    }
+    for (string_view str : cond.in_strings)
+    {
+        auto it = by_string.find(string(str));
+        if (it != by_string.end() && !it->second.empty())
+            out.push_back(&it->second);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "document.h"
+#include "field_dictionary.h"
+#include "query.h"
+
+// хеш-индекс по значению одного поля: значение -> документы с этим значением.
+// Ключи повторяют правила равенства запросов: целые значения (в пределах int)
+// сравниваются как числа ("007" и "7" - один ключ), остальные - как строки без
+// пробелов по краям. Целые вне int ни с чем не равны и в индекс не попадают.
+// Обновляется вставками и удалениями под блокировкой базы
+class SecondaryIndex
+{
+public:
+    using Postings = std::vector<Document *>; // порядок не важен, удаление - обменом с последним
+
+private:
+    std::uint32_t field_id;
+    std::unordered_map<std::string, Postings> by_string;
+    std::unordered_map<int, Postings> by_int;
+    // место документа в его списке: удаление одного документа - O(1), а не проход
+    // по списку значения, в котором бывают миллионы документов
+    std::unordered_map<const Document *, std::size_t> positions;
+
+    enum class KeyKind
+    {
+        String,
+        Int,
+        None // поля нет или ключ не индексируется
+    };
+    KeyKind key_of(const Document *doc, const FieldDictionary &dict, std::string_view &str, int &num) const;
+    Postings *postings_of(const Document *doc, const FieldDictionary &dict);
+    void append(Postings &list, Document *doc);
+
+public:
+    explicit SecondaryIndex(std::uint32_t field_id);
+    SecondaryIndex(const SecondaryIndex &) = delete;
+    SecondaryIndex &operator=(const SecondaryIndex &) = delete;
+
+    std::uint32_t fieldId() const;
+    std::size_t size() const; // документов в индексе
+
+    void add(Document *doc, const FieldDictionary &dict);
+    void remove(Document *doc, const FieldDictionary &dict);
+    // удаление многих документов: каждый список ключа чистится одним проходом
+    void removeBatch(const std::vector<Document *> &docs, const FieldDictionary &dict);
+
+    // документы, у которых поле равно литералу / одному из элементов $in
+    // (nullptr или пусто - таких нет); сумма размеров - оценка для планировщика
+    const Postings *lookup(const QueryLiteral &literal) const;
+    void lookupIn(const ValueCondition &cond, std::vector<const Postings *> &out) const;
+};
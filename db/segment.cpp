@@ -0,0 +1,374 @@
+#include "segment.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "ordered_index.h"
+
+using namespace std;
+
+const char SegmentStore::UNTIMED[] = "untimed";
+
+static int64_t unit_millis(PartitionUnit unit)
+{
+    return unit == PartitionUnit::Hour ? 3600000 : 86400000;
+}
+
+// начало секции, в которую попадает момент ms (деление вниз и для времени до 1970)
+static int64_t segment_start(int64_t ms, PartitionUnit unit)
+{
+    int64_t size = unit_millis(unit);
+    int64_t start = ms / size * size;
+    return start > ms ? start - size : start;
+}
+
+static string segment_label(int64_t start, PartitionUnit unit)
+{
+    char buf[24];
+    OrderedIndex::formatIsoMillis(start, buf);
+    return string(buf, unit == PartitionUnit::Hour ? 13 : 10);
+}
+
+// на место документа встаёт последний; место ищется по positions, а не проходом по секции
+static bool remove_from(Segment &segment, Document *doc)
+{
+    auto it = segment.positions.find(doc);
+    if (it == segment.positions.end())
+        return false;
+    size_t pos = it->second;
+    segment.positions.erase(it);
+    Document *last = segment.docs.back();
+    segment.docs[pos] = last;
+    segment.docs.pop_back();
+    if (last != doc)
+        segment.positions[last] = pos;
+    return true;
+}
+
+SegmentStore::SegmentStore(uint32_t field_id, PartitionUnit unit) : field_id(field_id), unit(unit), total_bytes(0)
+{
+    untimed.label = UNTIMED;
+    untimed.timed = false;
+    untimed.min_ms = 0;
+    untimed.max_ms = 0;
+    untimed.bytes = 0;
+    untimed.dirty = false;
+}
+
+void SegmentStore::setUnit(PartitionUnit new_unit)
+{
+    if (timed.empty() && untimed.docs.empty())
+        unit = new_unit;
+}
+
+PartitionUnit SegmentStore::getUnit() const
+{
+    return unit;
+}
+
+uint32_t SegmentStore::fieldId() const
+{
+    return field_id;
+}
+
+size_t SegmentStore::segmentCount() const
+{
+    return timed.size() + (untimed.docs.empty() ? 0 : 1);
+}
+
+size_t SegmentStore::bytes() const
+{
+    return total_bytes;
+}
+
+string SegmentStore::labelOf(const Document *doc, const FieldDictionary &dict) const
+{
+    string_view value;
+    int64_t ms = 0;
+    if (!doc->getField(field_id, value, dict) || !OrderedIndex::parseIsoMillis(trim_view(value), ms))
+        return UNTIMED;
+    return segment_label(segment_start(ms, unit), unit);
+}
+
+// секция документа (nullptr - секции ещё нет); ms - время документа
+Segment *SegmentStore::segment_of(const Document *doc, const FieldDictionary &dict, int64_t &ms)
+{
+    string_view value;
+    if (!doc->getField(field_id, value, dict) || !OrderedIndex::parseIsoMillis(trim_view(value), ms))
+        return &untimed;
+    auto it = timed.find(segment_start(ms, unit));
+    return it == timed.end() ? nullptr : it->second.get();
+}
+
+Segment *SegmentStore::find_label(const string &label)
+{
+    if (label == UNTIMED)
+        return &untimed;
+    for (auto &entry : timed)
+    {
+        if (entry.second->label == label)
+            return entry.second.get();
+    }
+    return nullptr;
+}
+
+// пустая секция уходит из памяти, её файл удаляется при следующей записи
+void SegmentStore::drop_if_empty(Segment *segment)
+{
+    if (!segment->docs.empty())
+        return;
+    dropped.push_back(segment->label);
+    if (!segment->timed)
+    {
+        segment->dirty = false;
+        segment->positions.clear();
+        segment->distinct.clear();
+        return;
+    }
+    int64_t start = segment_start(segment->min_ms, unit);
+    timed.erase(start);
+}
+
+void SegmentStore::add(Document *doc, const FieldDictionary &dict)
+{
+    int64_t ms = 0;
+    Segment *segment = segment_of(doc, dict, ms);
+    if (!segment)
+    {
+        int64_t start = segment_start(ms, unit);
+        unique_ptr<Segment> created(new Segment);
+        created->label = segment_label(start, unit);
+        created->timed = true;
+        created->min_ms = ms;
+        created->max_ms = ms;
+        created->bytes = 0;
+        created->dirty = true;
+        segment = created.get();
+        timed[start] = move(created);
+    }
+    if (segment->timed)
+    {
+        segment->min_ms = min(segment->min_ms, ms);
+        segment->max_ms = max(segment->max_ms, ms);
+    }
+    segment->positions[doc] = segment->docs.size();
+    segment->docs.push_back(doc);
+    size_t size = doc->memoryBytes();
+    segment->bytes += size;
+    total_bytes += size;
+    segment->dirty = true;
+
+    for (size_t i = 0; i < doc->fieldCount(); i++)
+    {
+        segment->distinct[doc->fieldId(i)].add(sketchHash(trim_view(doc->fieldValue(i, dict))));
+    }
+}
+
+// документ снятой секции, до которого ещё не дошла takeDetached
+bool SegmentStore::remove_detached(Document *doc)
+{
+    for (auto &segment : detached)
+    {
+        if (remove_from(*segment, doc))
+        {
+            segment->bytes -= doc->memoryBytes();
+            return true;
+        }
+    }
+    return false;
+}
+
+void SegmentStore::remove(Document *doc, const FieldDictionary &dict)
+{
+    int64_t ms = 0;
+    Segment *segment = segment_of(doc, dict, ms);
+    if (!segment || !remove_from(*segment, doc))
+    {
+        remove_detached(doc);
+        return;
+    }
+    size_t size = doc->memoryBytes();
+    segment->bytes -= size;
+    total_bytes -= size;
+    segment->dirty = true;
+    drop_if_empty(segment);
+}
+
+void SegmentStore::removeBatch(const vector<Document *> &docs, const FieldDictionary &dict)
+{
+    if (docs.size() < 4)
+    {
+        for (Document *doc : docs)
+            remove(doc, dict);
+        return;
+    }
+
+    unordered_set<const Document *> gone(docs.begin(), docs.end());
+    unordered_set<Segment *> touched;
+    for (Document *doc : docs)
+    {
+        int64_t ms = 0;
+        Segment *segment = segment_of(doc, dict, ms);
+        if (segment && segment->positions.count(doc))
+            touched.insert(segment);
+        else
+            remove_detached(doc);
+    }
+    for (Segment *segment : touched)
+    {
+        segment->docs.erase(remove_if(segment->docs.begin(), segment->docs.end(), [&](const Document *doc)
+                                      {
+            if (gone.count(doc) == 0)
+                return false;
+            size_t size = doc->memoryBytes();
+            segment->bytes -= size;
+            total_bytes -= size;
+            segment->positions.erase(doc);
+            return true; }),
+                            segment->docs.end());
+        // после уплотнения оставшиеся документы сдвинулись
+        for (size_t i = 0; i < segment->docs.size(); i++)
+            segment->positions[segment->docs[i]] = i;
+        segment->dirty = true;
+        drop_if_empty(segment);
+    }
+}
+
+void SegmentStore::expiredSegments(int64_t now_ms, int64_t max_age_ms, size_t max_bytes,
+                                   vector<string> &labels) const
+{
+    labels.clear();
+    size_t left = total_bytes;
+    size_t remaining = timed.size();
+    for (const auto &entry : timed)
+    {
+        const Segment &segment = *entry.second;
+        bool by_age = max_age_ms > 0 && entry.first + unit_millis(unit) <= now_ms - max_age_ms;
+        bool by_size = max_bytes > 0 && left > max_bytes && remaining > 1;
+        if (!by_age && !by_size)
+            break; // дальше секции новее
+        labels.push_back(segment.label);
+        left -= segment.bytes;
+        remaining--;
+    }
+}
+
+size_t SegmentStore::detach(const string &label)
+{
+    for (auto it = timed.begin(); it != timed.end(); ++it)
+    {
+        if (it->second->label != label)
+            continue;
+        size_t count = it->second->docs.size();
+        total_bytes -= it->second->bytes;
+        dropped.push_back(label);
+        detached.push_back(move(it->second));
+        timed.erase(it);
+        return count;
+    }
+    return 0;
+}
+
+bool SegmentStore::takeDetached(size_t max_docs, vector<Document *> &docs)
+{
+    docs.clear();
+    while (!detached.empty() && docs.size() < max_docs)
+    {
+        Segment &segment = *detached.back();
+        while (!segment.docs.empty() && docs.size() < max_docs)
+        {
+            Document *doc = segment.docs.back();
+            segment.docs.pop_back();
+            segment.positions.erase(doc);
+            docs.push_back(doc);
+        }
+        if (segment.docs.empty())
+            detached.pop_back();
+    }
+    return !docs.empty();
+}
+
+bool SegmentStore::contains(const string &label) const
+{
+    if (label == UNTIMED)
+        return !untimed.docs.empty();
+    for (const auto &entry : timed)
+    {
+        if (entry.second->label == label)
+            return true;
+    }
+    return false;
+}
+
+void SegmentStore::markClean(const string &label)
+{
+    Segment *segment = find_label(label);
+    if (segment)
+        segment->dirty = false;
+}
+
+void SegmentStore::dropFile(const string &label)
+{
+    dropped.push_back(label);
+}
+
+void SegmentStore::takeDirty(Flush &out)
+{
+    out.write.clear();
+    out.remove.clear();
+    auto take = [&](Segment &segment)
+    {
+        if (segment.dirty && !segment.docs.empty())
+            out.write.emplace_back(segment.label, segment.docs);
+        segment.dirty = false;
+    };
+    for (auto &entry : timed)
+    {
+        take(*entry.second);
+    }
+    take(untimed);
+
+    // метка могла снова появиться после удаления секции - тогда файл перезаписывается
+    sort(dropped.begin(), dropped.end());
+    dropped.erase(unique(dropped.begin(), dropped.end()), dropped.end());
+    for (const string &label : dropped)
+    {
+        Segment *segment = find_label(label);
+        if (!segment || segment->docs.empty())
+            out.remove.push_back(label);
+    }
+    dropped.clear();
+}
+
+void SegmentStore::restoreDirty(const Flush &flush)
+{
+    for (const auto &entry : flush.write)
+    {
+        Segment *segment = find_label(entry.first);
+        if (segment && !segment->docs.empty())
+            segment->dirty = true;
+        else
+            dropped.push_back(entry.first);
+    }
+    dropped.insert(dropped.end(), flush.remove.begin(), flush.remove.end());
+}
+
+bool SegmentStore::mayMatch(const Segment &segment, const ValueCondition &cond)
+{
+    if (cond.never)
+        return false;
+    if (!segment.timed)
+        return true;
+
+    char lo_buf[24], hi_buf[24];
+    OrderedIndex::formatIsoMillis(segment.min_ms, lo_buf);
+    OrderedIndex::formatIsoMillis(segment.max_ms, hi_buf);
+    string_view lo(lo_buf, 24), hi(hi_buf, 24);
+    if (cond.has_gt && hi.compare(cond.gt.text) <= 0)
+        return false;
+    if (cond.has_lt && lo.compare(cond.lt.text) >= 0)
+        return false;
+    if (cond.has_eq && (lo.compare(cond.eq.text) > 0 || hi.compare(cond.eq.text) < 0))
+        return false;
+    return true;
+}
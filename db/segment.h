@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include "document.h"
+#include "field_dictionary.h"
+#include "query.h"
+#include "sketch.h"
+
+// размер временной секции
+enum class PartitionUnit
+{
+    Hour,
+    Day
+};
+
+// секция коллекции: документы одного часа или дня по полю времени, свой файл снимка.
+// Зона min/max времени документов позволяет пропустить секцию целиком;
+// после удалений границы не сужаются - остаются верной, хоть и грубой оценкой
+struct Segment
+{
+    std::string label;  // "2026-10-15" или "2026-10-15T13"; SegmentStore::UNTIMED - без времени
+    bool timed;
+    std::int64_t min_ms; // зона, только у timed
+    std::int64_t max_ms;
+    std::vector<Document *> docs; // порядок вставки, удаление - обменом с последним
+    std::unordered_map<const Document *, std::size_t> positions; // место документа в docs
+    std::size_t bytes;            // сумма Document::memoryBytes
+    bool dirty;                   // изменена после последней записи файла
+    // различные значения полей (номер имени -> HyperLogLog), ведутся при вставке;
+    // удаления не вычитаются - оценка уменьшается, только когда секция уходит целиком
+    std::unordered_map<std::uint32_t, HyperLogLog> distinct;
+};
+
+// документы базы, разложенные по временным секциям; время - значение поля
+// в каноническом виде "YYYY-MM-DDTHH:MM:SS.mmmZ" (как пишет агент), документы
+// без него - в отдельной секции. Ведётся вместе с индексами под блокировкой базы
+class SegmentStore
+{
+public:
+    static const char UNTIMED[]; // метка секции документов без времени
+
+    // что записать на диск: копии списков изменённых секций + метки файлов к удалению
+    struct Flush
+    {
+        std::vector<std::pair<std::string, std::vector<Document *>>> write;
+        std::vector<std::string> remove;
+    };
+
+private:
+    std::uint32_t field_id;
+    PartitionUnit unit;
+    std::map<std::int64_t, std::unique_ptr<Segment>> timed; // по началу секции
+    Segment untimed;
+    // снятые секции: их документы ещё в базе и уходят порциями (takeDetached);
+    // удаление документа отсюда тоже работает, в объём базы они уже не входят
+    std::vector<std::unique_ptr<Segment>> detached;
+    std::size_t total_bytes;
+    std::vector<std::string> dropped; // опустевшие секции и чужие файлы: удалить при записи
+
+    Segment *segment_of(const Document *doc, const FieldDictionary &dict, std::int64_t &ms);
+    Segment *find_label(const std::string &label);
+    void drop_if_empty(Segment *segment);
+    bool remove_detached(Document *doc);
+
+public:
+    SegmentStore(std::uint32_t field_id, PartitionUnit unit);
+    SegmentStore(const SegmentStore &) = delete;
+    SegmentStore &operator=(const SegmentStore &) = delete;
+
+    void setUnit(PartitionUnit unit); // только пока секции пусты
+    PartitionUnit getUnit() const;
+    std::uint32_t fieldId() const;
+    std::size_t segmentCount() const;
+    std::size_t bytes() const; // примерный объём документов всех секций
+    std::string labelOf(const Document *doc, const FieldDictionary &dict) const;
+
+    void add(Document *doc, const FieldDictionary &dict);
+    void remove(Document *doc, const FieldDictionary &dict);
+    // удаление многих документов: каждая затронутая секция чистится одним проходом
+    void removeBatch(const std::vector<Document *> &docs, const FieldDictionary &dict);
+
+    // секции с истёкшим сроком хранения, от старых к новым: конец секции старше
+    // now_ms - max_age_ms и/или самые старые, пока объём больше max_bytes
+    // (у самой новой не трогаем); 0 - правило выключено, секция без времени не удаляется
+    void expiredSegments(std::int64_t now_ms, std::int64_t max_age_ms, std::size_t max_bytes,
+                         std::vector<std::string> &labels) const;
+    // снять секцию целиком (O(1)): из обхода и объёма она уходит сразу, файл удаляется
+    // при следующей записи; возвращает число документов (0 - такой секции нет)
+    std::size_t detach(const std::string &label);
+    // следующие не больше max_docs документов снятых секций; false - снятых не осталось
+    bool takeDetached(std::size_t max_docs, std::vector<Document *> &docs);
+    bool contains(const std::string &label) const; // есть непустая секция с такой меткой
+
+    // после загрузки: файл секции совпадает с памятью / файл лишний
+    void markClean(const std::string &label);
+    void dropFile(const std::string &label);
+    // забрать изменённые секции (флаг снимается); при неудачной записи - вернуть
+    void takeDirty(Flush &out);
+    void restoreDirty(const Flush &flush);
+
+    // обход секций по времени (секция без времени - последней); условие на поле времени
+    // (может быть nullptr) отсекает секции, зона которых не может дать совпадения
+    template <typename F>
+    void forEachSegment(const ValueCondition *cond, F &&visit) const
+    {
+        for (const auto &entry : timed)
+        {
+            if (!cond || mayMatch(*entry.second, *cond))
+                visit(*entry.second);
+        }
+        if (!untimed.docs.empty())
+            visit(untimed);
+    }
+
+    // значения секции - не целые строки, их сравнение с любым литералом строковое
+    static bool mayMatch(const Segment &segment, const ValueCondition &cond);
+};
@@ -0,0 +1,185 @@
+#include "sketch.h"
+
+#include <cmath>
+#include <functional>
+#include <utility>
+
+using namespace std;
+
+uint64_t sketchHash(string_view value)
+{
+    // перемешивание splitmix64 поверх std::hash: младшие и старшие биты одинаково случайны
+    uint64_t h = hash<string_view>()(value);
+    h += 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : width(width), depth(depth), cells(width * depth, 0) {}
+
+// строки - двойным хешированием h1 + i * h2 из одного 64-битного хеша
+void CountMinSketch::add(uint64_t hash, uint32_t n)
+{
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    for (size_t i = 0; i < depth; i++)
+    {
+        uint32_t &cell = cells[i * width + ((h1 + i * h2) & (width - 1))];
+        cell = cell > UINT32_MAX - n ? UINT32_MAX : cell + n;
+    }
+}
+
+uint64_t CountMinSketch::estimate(uint64_t hash) const
+{
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    uint64_t best = UINT64_MAX;
+    for (size_t i = 0; i < depth; i++)
+    {
+        uint64_t cell = cells[i * width + ((h1 + i * h2) & (width - 1))];
+        if (cell < best)
+            best = cell;
+    }
+    return best;
+}
+
+SpaceSaving::SpaceSaving(size_t capacity) : capacity(capacity)
+{
+    heap.reserve(capacity);
+    positions.reserve(capacity);
+}
+
+void SpaceSaving::swap_items(size_t a, size_t b)
+{
+    swap(heap[a], heap[b]);
+    positions[heap[a].value] = a;
+    positions[heap[b].value] = b;
+}
+
+void SpaceSaving::sift_down(size_t i)
+{
+    while (true)
+    {
+        size_t smallest = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+        if (left < heap.size() && heap[left].count < heap[smallest].count)
+            smallest = left;
+        if (right < heap.size() && heap[right].count < heap[smallest].count)
+            smallest = right;
+        if (smallest == i)
+            return;
+        swap_items(i, smallest);
+        i = smallest;
+    }
+}
+
+void SpaceSaving::sift_up(size_t i)
+{
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap[parent].count <= heap[i].count)
+            return;
+        swap_items(i, parent);
+        i = parent;
+    }
+}
+
+void SpaceSaving::add(const string &value, uint64_t count, uint64_t error)
+{
+    auto it = positions.find(value);
+    if (it != positions.end())
+    {
+        size_t i = it->second;
+        heap[i].count += count;
+        sift_down(i);
+        return;
+    }
+
+    if (heap.size() < capacity)
+    {
+        heap.push_back(Item{value, count, error});
+        positions.emplace(value, heap.size() - 1);
+        sift_up(heap.size() - 1);
+        return;
+    }
+
+    // вытесняем самое редкое: новое значение могло встречаться до min раз незамеченным
+    Item &root = heap[0];
+    uint64_t min_count = root.count;
+    positions.erase(root.value);
+    root.value = value;
+    root.count = min_count + count;
+    root.error = min_count + error;
+    positions.emplace(value, 0);
+    sift_down(0);
+}
+
+size_t SpaceSaving::size() const
+{
+    return heap.size();
+}
+
+const vector<SpaceSaving::Item> &SpaceSaving::items() const
+{
+    return heap;
+}
+
+const unsigned HyperLogLog::PRECISION;
+const size_t HyperLogLog::REGISTERS;
+
+// старшие PRECISION бит хеша - номер регистра, в регистре - максимальный ранг
+// (позиция первой единицы) остальных бит
+void HyperLogLog::add(uint64_t hash)
+{
+    if (registers.empty())
+        registers.assign(REGISTERS, 0);
+    size_t index = static_cast<size_t>(hash >> (64 - PRECISION));
+    uint64_t rest = (hash << PRECISION) | (uint64_t(1) << (PRECISION - 1)); // ранг не больше 64 - PRECISION + 1
+    uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    if (rank > registers[index])
+        registers[index] = rank;
+}
+
+void HyperLogLog::merge(const HyperLogLog &other)
+{
+    if (other.registers.empty())
+        return;
+    if (registers.empty())
+    {
+        registers = other.registers;
+        return;
+    }
+    for (size_t i = 0; i < REGISTERS; i++)
+    {
+        if (other.registers[i] > registers[i])
+            registers[i] = other.registers[i];
+    }
+}
+
+uint64_t HyperLogLog::estimate() const
+{
+    if (registers.empty())
+        return 0;
+    const double m = static_cast<double>(REGISTERS);
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t r : registers)
+    {
+        sum += ldexp(1.0, -static_cast<int>(r));
+        zeros += r == 0;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    // на малых числах точнее линейный подсчёт по пустым регистрам
+    if (e <= 2.5 * m && zeros > 0)
+        e = m * log(m / static_cast<double>(zeros));
+    return static_cast<uint64_t>(llround(e));
+}
+
+bool HyperLogLog::empty() const
+{
+    return registers.empty();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Count-Min: depth строк по width счётчиков; оценка частоты - минимум по строкам,
+// никогда не меньше настоящей и больше неё не более чем на 2N/width с вероятностью 1 - 2^-depth
+class CountMinSketch
+{
+private:
+    std::size_t width; // степень двойки
+    std::size_t depth;
+    std::vector<std::uint32_t> cells; // depth * width
+
+public:
+    CountMinSketch(std::size_t width, std::size_t depth);
+
+    void add(std::uint64_t hash, std::uint32_t n = 1);
+    std::uint64_t estimate(std::uint64_t hash) const;
+};
+
+// Space-Saving: не больше capacity значений-кандидатов в памяти. Новое значение при
+// полном наборе вытесняет самое редкое и наследует его счётчик (он же - ошибка), поэтому
+// счётчик - оценка сверху, count - error - снизу, и каждое значение с частотой выше
+// N/capacity гарантированно в наборе. Минимум ищется кучей с позициями - O(log capacity)
+class SpaceSaving
+{
+public:
+    struct Item
+    {
+        std::string value;
+        std::uint64_t count;
+        std::uint64_t error;
+    };
+
+private:
+    std::size_t capacity;
+    std::vector<Item> heap;                                  // куча по count, в вершине - минимум
+    std::unordered_map<std::string, std::size_t> positions; // значение -> индекс в heap
+
+    void sift_down(std::size_t i);
+    void sift_up(std::size_t i);
+    void swap_items(std::size_t a, std::size_t b);
+
+public:
+    explicit SpaceSaving(std::size_t capacity);
+
+    // value - ключ как есть; count/error - для начальной загрузки из точного подсчёта
+    void add(const std::string &value, std::uint64_t count = 1, std::uint64_t error = 0);
+    std::size_t size() const;
+    const std::vector<Item> &items() const; // без порядка
+};
+
+// HyperLogLog: число различных значений по 2^PRECISION регистрам (4 КБ),
+// стандартная ошибка ~1.04 / sqrt(4096) = 1.6%; скетчи сливаются без потерь (максимум регистров),
+// поэтому оценку по нескольким секциям или базам даёт слияние их скетчей. Удалений не бывает
+class HyperLogLog
+{
+public:
+    static const unsigned PRECISION = 12;
+    static const std::size_t REGISTERS = std::size_t(1) << PRECISION;
+
+private:
+    std::vector<std::uint8_t> registers; // пусто - значений ещё не было
+
+public:
+    void add(std::uint64_t hash);
+    void merge(const HyperLogLog &other);
+    std::uint64_t estimate() const;
+    bool empty() const;
+};
+
+// хеш значения для скетчей
+std::uint64_t sketchHash(std::string_view value);
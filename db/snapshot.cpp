@@ -0,0 +1,341 @@
+#include "snapshot.h"
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+AtomicFileWriter::AtomicFileWriter(const string &target_path)
+    : path(target_path), tmp_path(target_path + ".tmp"), fd(-1), ok(true)
+{
+    error_code ec;
+    filesystem::path parent = filesystem::path(path).parent_path();
+    if (!parent.empty())
+        filesystem::create_directories(parent, ec);
+
+    fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        cerr << "Ошибка открытия файла " << tmp_path << ": " << strerror(errno) << endl;
+        ok = false;
+    }
+    chunk.reserve(1 << 20);
+}
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        ::unlink(tmp_path.c_str());
+    }
+}
+
+bool AtomicFileWriter::isOpen() const
+{
+    return fd >= 0;
+}
+
+void AtomicFileWriter::write_chunk()
+{
+    const char *p = chunk.data();
+    size_t left = chunk.size();
+    while (ok && left > 0)
+    {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ok = false;
+            break;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    chunk.clear();
+}
+
+void AtomicFileWriter::write(const char *data, size_t len)
+{
+    if (!ok)
+        return;
+    chunk.append(data, len);
+    if (chunk.size() >= (1 << 20))
+    {
+        write_chunk();
+    }
+}
+
+void AtomicFileWriter::write(const string &data)
+{
+    write(data.data(), data.size());
+}
+
+bool AtomicFileWriter::commit()
+{
+    if (fd < 0)
+        return false;
+
+    write_chunk();
+    if (ok && ::fsync(fd) != 0)
+    {
+        ok = false;
+    }
+    ::close(fd);
+    fd = -1;
+
+    if (!ok || ::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        cerr << "ERROR: не удалось записать снимок " << path << ": " << strerror(errno) << endl;
+        ::unlink(tmp_path.c_str());
+        return false;
+    }
+
+    // fsync каталога, чтобы rename пережил падение
+    string dir = filesystem::path(path).parent_path().string();
+    int dir_fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0)
+    {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    return true;
+}
+
+MappedFile::MappedFile() : map(nullptr), length(0) {}
+
+MappedFile::~MappedFile()
+{
+    if (map)
+    {
+        ::munmap(map, length);
+    }
+}
+
+bool MappedFile::open(const string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(st.st_size);
+    void *m = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+    {
+        cerr << "ERROR: mmap " << path << ": " << strerror(errno) << endl;
+        length = 0;
+        return false;
+    }
+    map = m;
+    ::madvise(map, length, MADV_SEQUENTIAL);
+    return true;
+}
+
+const char *MappedFile::data() const
+{
+    return static_cast<const char *>(map);
+}
+
+size_t MappedFile::size() const
+{
+    return length;
+}
+
+static const size_t HEADER_SIZE = 28;     // магия, версия, число документов, next_id
+static const size_t MIN_RECORD_SIZE = 12; // длина записи, длина _id, число полей
+
+static void put_u32(string &out, uint32_t v)
+{
+    char b[4];
+    memcpy(b, &v, 4);
+    out.append(b, 4);
+}
+
+static void put_str(string &out, string_view s)
+{
+    put_u32(out, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+bool writeBinarySnapshot(const string &path, const vector<Document *> &docs, long long next_id,
+                         const FieldDictionary &dict)
+{
+    AtomicFileWriter writer(path);
+    if (!writer.isOpen())
+        return false;
+
+    string header(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    put_u32(header, SNAPSHOT_VERSION);
+    uint64_t count = docs.size();
+    int64_t nid = next_id;
+    header.append(reinterpret_cast<const char *>(&count), 8);
+    header.append(reinterpret_cast<const char *>(&nid), 8);
+    writer.write(header);
+
+    string rec;
+    for (const Document *doc : docs)
+    {
+        rec.clear();
+        put_u32(rec, 0); // длина, заполняется ниже
+        put_str(rec, doc->_id);
+        put_u32(rec, static_cast<uint32_t>(doc->fieldCount()));
+        for (size_t i = 0; i < doc->fieldCount(); i++)
+        {
+            put_str(rec, doc->fieldKey(i, dict));
+            put_str(rec, doc->fieldValue(i, dict));
+        }
+        uint32_t body_len = static_cast<uint32_t>(rec.size() - 4);
+        memcpy(&rec[0], &body_len, 4);
+        writer.write(rec);
+    }
+    return writer.commit();
+}
+
+SnapshotLoad loadBinarySnapshot(const string &path, vector<Document *> &out, long long &next_id,
+                                FieldDictionary &dict)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return SnapshotLoad::Failed;
+    if (file.size() < HEADER_SIZE)
+    {
+        cerr << "ERROR: снимок " << path << " повреждён (короткий файл)" << endl;
+        return SnapshotLoad::Corrupt;
+    }
+    size_t size = file.size();
+
+    const char *base = file.data();
+    const char *end = base + size;
+    const char *p = base;
+
+    uint32_t version = 0;
+    uint64_t count = 0;
+    int64_t nid = 1;
+    bool ok = memcmp(p, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0;
+    p += sizeof(SNAPSHOT_MAGIC);
+    memcpy(&version, p, 4);
+    memcpy(&count, p + 4, 8);
+    memcpy(&nid, p + 12, 8);
+    p += 20;
+    if (!ok || version != SNAPSHOT_VERSION)
+    {
+        cerr << "ERROR: " << path << " не является снимком версии " << SNAPSHOT_VERSION << endl;
+        return SnapshotLoad::Failed;
+    }
+
+    // читатель с проверкой границ: битая запись обрывает загрузку
+    auto read_u32 = [&](const char *&q, const char *limit, uint32_t &v) -> bool
+    {
+        if (limit - q < 4)
+            return false;
+        memcpy(&v, q, 4);
+        q += 4;
+        return true;
+    };
+    auto read_str = [&](const char *&q, const char *limit, const char *&s, uint32_t &len) -> bool
+    {
+        if (!read_u32(q, limit, len) || static_cast<size_t>(limit - q) < len)
+            return false;
+        s = q;
+        q += len;
+        return true;
+    };
+
+    // число из заголовка может быть испорчено: резерв не больше, чем записей влезает в файл
+    out.reserve(out.size() + min<uint64_t>(count, (size - HEADER_SIZE) / MIN_RECORD_SIZE));
+    Document::FieldIdList fields;
+    // имена полей повторяются в каждой записи: номер ищем в словаре один раз на имя,
+    // ключи кэша указывают в отображённый файл
+    unordered_map<string_view, uint32_t> field_ids;
+    uint64_t loaded = 0;
+    while (loaded < count)
+    {
+        uint32_t body_len = 0;
+        if (!read_u32(p, end, body_len) || static_cast<size_t>(end - p) < body_len)
+        {
+            ok = false;
+            break;
+        }
+        const char *rec_end = p + body_len;
+
+        const char *id = nullptr;
+        uint32_t id_len = 0;
+        uint32_t nfields = 0;
+        if (!read_str(p, rec_end, id, id_len) || !read_u32(p, rec_end, nfields))
+        {
+            ok = false;
+            break;
+        }
+
+        fields.clear();
+        for (uint32_t f = 0; f < nfields && ok; f++)
+        {
+            const char *k = nullptr, *v = nullptr;
+            uint32_t klen = 0, vlen = 0;
+            if (!read_str(p, rec_end, k, klen) || !read_str(p, rec_end, v, vlen))
+            {
+                ok = false;
+                break;
+            }
+            string_view key(k, klen);
+            auto it = field_ids.find(key);
+            if (it == field_ids.end())
+                it = field_ids.emplace(key, dict.intern(key)).first;
+            fields.emplace_back(it->second, string_view(v, vlen));
+        }
+        if (!ok)
+            break;
+
+        Document *doc = new Document(string(id, id_len));
+        doc->setFieldIds(fields, dict);
+        out.push_back(doc);
+        p = rec_end;
+        loaded++;
+    }
+
+    next_id = nid;
+    if (!ok)
+    {
+        cerr << "ERROR: снимок " << path << " повреждён, загружено документов: "
+             << loaded << " из " << count << endl;
+        return SnapshotLoad::Corrupt;
+    }
+    return SnapshotLoad::Loaded;
+}
+
+bool writeJsonSnapshot(const string &path, const vector<Document *> &docs,
+                       const FieldDictionary &dict)
+{
+    AtomicFileWriter writer(path);
+    if (!writer.isOpen())
+        return false;
+
+    writer.write("[\n", 2);
+    for (size_t i = 0; i < docs.size(); i++)
+    {
+        if (i > 0)
+        {
+            writer.write(",\n", 2);
+        }
+        writer.write(docs[i]->serialize(dict));
+    }
+    writer.write("\n]\n", 3);
+    return writer.commit();
+}
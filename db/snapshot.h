@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "document.h"
+
+// атомарная запись файла: пишем во временный, fsync, rename поверх цели
+class AtomicFileWriter
+{
+private:
+    std::string path;
+    std::string tmp_path;
+    int fd;
+    bool ok;
+    std::string chunk; // буфер, сбрасывается кусками по ~1 МБ
+
+    void write_chunk();
+
+public:
+    explicit AtomicFileWriter(const std::string &target_path);
+    ~AtomicFileWriter(); // без commit() временный файл удаляется
+    AtomicFileWriter(const AtomicFileWriter &) = delete;
+    AtomicFileWriter &operator=(const AtomicFileWriter &) = delete;
+
+    bool isOpen() const;
+    void write(const char *data, std::size_t len);
+    void write(const std::string &data);
+    bool commit();
+};
+
+// файл, отображённый в память только для чтения
+class MappedFile
+{
+private:
+    void *map;
+    std::size_t length;
+
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path); // false - файла нет или он пуст
+    const char *data() const;
+    std::size_t size() const;
+};
+
+// бинарный снимок коллекции (все числа little-endian)
+//   заголовок: "MDBSNAP1" | u32 версия | u64 число документов | i64 next_id
+//   документ:  u32 длина остатка записи | u32 len, _id | u32 число полей
+//              | поля: u32 len, ключ | u32 len, значение
+static const char SNAPSHOT_MAGIC[8] = {'M', 'D', 'B', 'S', 'N', 'A', 'P', '1'};
+static const std::uint32_t SNAPSHOT_VERSION = 1;
+
+bool writeBinarySnapshot(const std::string &path, const std::vector<Document *> &docs, long long next_id,
+                         const FieldDictionary &dict);
+
+// итог загрузки снимка
+enum class SnapshotLoad
+{
+    Failed,  // файла нет, он пуст или это не снимок - документы не добавлены
+    Loaded,
+    Corrupt  // файл оборван или испорчен: добавлены только документы до битой записи
+};
+
+// файл отображается через mmap и разбирается без промежуточных копий;
+// документы добавляются в out, next_id берётся из заголовка, имена полей - в dict
+SnapshotLoad loadBinarySnapshot(const std::string &path, std::vector<Document *> &out, long long &next_id,
+                                FieldDictionary &dict);
+
+// JSON-массив документов - формат экспорта
+bool writeJsonSnapshot(const std::string &path, const std::vector<Document *> &docs,
+                       const FieldDictionary &dict);
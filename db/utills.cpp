@@ -1,4 +1,5 @@
 #include "utills.h"
+#include <climits>
 using namespace std;
 
 // функция для очитки строки от лишних символов
@@ -12,3 +13,69 @@ string trim(const string &str)
     size_t last = str.find_last_not_of(" \t\n\r");
     return str.substr(first, last - first + 1);
 }
+
+bool needs_trim(string_view str)
+{
+    if (str.empty())
+        return false;
+    auto is_space = [](char c)
+    { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    return is_space(str.front()) || is_space(str.back());
+}
+
+string_view trim_view(string_view str)
+{
+    size_t first = str.find_first_not_of(" \t\n\r");
+    if (first == string_view::npos)
+    {
+        return string_view();
+    }
+    size_t last = str.find_last_not_of(" \t\n\r");
+    return str.substr(first, last - first + 1);
+}
+
+bool is_integer_string(string_view str)
+{
+    string_view t = trim_view(str);
+    if (t.empty())
+        return false;
+    size_t i = 0;
+    if (t[0] == '+' || t[0] == '-')
+    {
+        if (t.size() == 1)
+            return false;
+        i = 1;
+    }
+    for (; i < t.size(); i++)
+    {
+        if (t[i] < '0' || t[i] > '9')
+            return false;
+    }
+    return true;
+}
+
+// stoi для строки, уже проверенной is_integer_string; false - не влезает в int
+bool parse_int(string_view s, int &out)
+{
+    s = trim_view(s);
+    size_t i = 0;
+    bool negative = false;
+    if (s[0] == '+' || s[0] == '-')
+    {
+        negative = s[0] == '-';
+        i = 1;
+    }
+    long long v = 0;
+    for (; i < s.size(); i++)
+    {
+        v = v * 10 + (s[i] - '0');
+        if (v > static_cast<long long>(INT_MAX) + 1)
+            return false;
+    }
+    if (negative)
+        v = -v;
+    if (v > INT_MAX || v < INT_MIN)
+        return false;
+    out = static_cast<int>(v);
+    return true;
+}
@@ -1,4 +1,17 @@
 #pragma once
 #include <string>
+#include <string_view>
 
-std::string trim(const std::string &str);
\ No newline at end of file
+std::string trim(const std::string &str);
+
+// есть ли что обрезать по краям (без копирования строки)
+bool needs_trim(std::string_view str);
+
+// то же без копирования: вид на строку без пробелов по краям
+std::string_view trim_view(std::string_view str);
+
+// целое со знаком: [+-]цифры (пробелы по краям допускаются)
+bool is_integer_string(std::string_view str);
+
+// stoi для строки, уже проверенной is_integer_string; false - не влезает в int
+bool parse_int(std::string_view str, int &out);
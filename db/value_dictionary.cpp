@@ -0,0 +1,164 @@
+#include "value_dictionary.h"
+#include "utills.h"
+
+#include <mutex>
+
+using namespace std;
+
+const size_t ValueDictionary::PROBE_VALUES;
+const size_t ValueDictionary::HIGH_CARDINALITY_RATIO;
+
+ValueDictionary::ValueDictionary()
+    : next_code(0), pool_bytes(0), inline_values(0), lookups(0), hits(0), new_codes(0), high_cardinality(false) {}
+
+bool ValueDictionary::store(string_view value, uint16_t &code)
+{
+    if (value.empty() || value.size() > MAX_VALUE_LEN || needs_trim(value) ||
+        high_cardinality.load(memory_order_relaxed))
+    {
+        inline_values.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    size_t seen = lookups.fetch_add(1, memory_order_relaxed) + 1;
+
+    // частый случай - значение уже есть; счётчик ссылок растёт под общей блокировкой,
+    // освобождение кода идёт только под исключительной
+    {
+        shared_lock<shared_mutex> lock(mtx);
+        auto it = codes.find(value);
+        if (it != codes.end())
+        {
+            entries[it->second].refs.fetch_add(1, memory_order_relaxed);
+            hits.fetch_add(1, memory_order_relaxed);
+            code = it->second;
+            return true;
+        }
+    }
+
+    unique_lock<shared_mutex> lock(mtx);
+    auto it = codes.find(value);
+    if (it != codes.end())
+    {
+        hits.fetch_add(1, memory_order_relaxed);
+    }
+    else
+    {
+        // новое значение: если такие идут почти всегда, поле не кодируем
+        if (seen >= PROBE_VALUES && new_codes.load(memory_order_relaxed) * HIGH_CARDINALITY_RATIO > seen)
+        {
+            high_cardinality.store(true, memory_order_relaxed);
+            inline_values.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        uint16_t new_code = 0;
+        if (!free_codes.empty())
+        {
+            new_code = free_codes.back();
+            free_codes.pop_back();
+        }
+        else if (next_code < MAX_CODES)
+        {
+            new_code = static_cast<uint16_t>(next_code++);
+        }
+        else
+        {
+            // коды кончились: поле с большим числом разных значений
+            inline_values.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+
+        new_codes.fetch_add(1, memory_order_relaxed);
+        Entry &entry = entries.slot(new_code);
+        entry.value.assign(value.data(), value.size());
+        pool_bytes += entry.value.size();
+        it = codes.emplace(string_view(entry.value), new_code).first;
+    }
+    entries[it->second].refs.fetch_add(1, memory_order_relaxed);
+    code = it->second;
+    return true;
+}
+
+void ValueDictionary::drop(bool encoded, uint16_t code)
+{
+    if (!encoded)
+    {
+        inline_values.fetch_sub(1, memory_order_relaxed);
+        return;
+    }
+
+    unique_lock<shared_mutex> lock(mtx);
+    Entry &entry = entries[code];
+    if (entry.refs.fetch_sub(1, memory_order_relaxed) == 1)
+    {
+        codes.erase(string_view(entry.value));
+        pool_bytes -= entry.value.size();
+        entry.value.clear();
+        free_codes.push_back(code);
+    }
+}
+
+// код взят из живого документа - запись не освобождена и не меняется
+const string &ValueDictionary::decode(uint16_t code) const
+{
+    return entries[code].value;
+}
+
+bool ValueDictionary::lookup(string_view value, uint16_t &code) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+    auto it = codes.find(value);
+    if (it == codes.end())
+        return false;
+    code = it->second;
+    return true;
+}
+
+size_t ValueDictionary::distinctCount() const
+{
+    shared_lock<shared_mutex> lock(mtx);
+    return codes.size();
+}
+
+// каждое закодированное значение держит одну ссылку на свой код
+size_t ValueDictionary::encodedValues() const
+{
+    shared_lock<shared_mutex> lock(mtx);
+    size_t total = 0;
+    for (const auto &item : codes)
+    {
+        total += entries[item.second].refs.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t ValueDictionary::inlineValues() const
+{
+    return inline_values.load(memory_order_relaxed);
+}
+
+size_t ValueDictionary::poolBytes() const
+{
+    shared_lock<shared_mutex> lock(mtx);
+    return pool_bytes;
+}
+
+double ValueDictionary::hitRate() const
+{
+    size_t total = lookups.load(memory_order_relaxed);
+    return total ? double(hits.load(memory_order_relaxed)) / double(total) : 0.0;
+}
+
+size_t ValueDictionary::lookupCount() const
+{
+    return lookups.load(memory_order_relaxed);
+}
+
+size_t ValueDictionary::hitCount() const
+{
+    return hits.load(memory_order_relaxed);
+}
+
+bool ValueDictionary::isHighCardinality() const
+{
+    return high_cardinality.load(memory_order_relaxed);
+}
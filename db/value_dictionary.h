@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+#include "chunked_array.h"
+
+// словарь значений одного поля: повторяющиеся короткие значения (hostname, severity, ...)
+// хранятся один раз, документ держит 2-байтовый код; у кода счётчик ссылок,
+// код без ссылок освобождается и выдаётся заново
+//   в словарь не попадают пустые, длинные и обрамлённые пробелами значения,
+//   а когда коды кончились - новые значения хранятся в документе как есть
+class ValueDictionary
+{
+private:
+    struct Entry
+    {
+        std::string value;
+        std::atomic<std::uint32_t> refs{0};
+    };
+
+    ChunkedArray<Entry> entries;
+    std::uint32_t next_code;                              // коды выше не выдавались
+    std::vector<std::uint16_t> free_codes;                // освобождённые коды
+    std::unordered_map<std::string_view, std::uint16_t> codes; // ключи смотрят в entries
+    std::size_t pool_bytes;
+    mutable std::shared_mutex mtx;
+
+    std::atomic<std::size_t> inline_values; // значения документов, хранящиеся как есть
+
+    // статистика store(): обращений и найденных готовых кодов (попаданий)
+    std::atomic<std::size_t> lookups;
+    std::atomic<std::size_t> hits;
+    std::atomic<std::size_t> new_codes; // выдано кодов под новые значения
+    // почти все значения разные (timestamp, raw_log): коды только тратят память,
+    // новые значения дальше хранятся как есть, занятые коды освобождаются с документами
+    std::atomic<bool> high_cardinality;
+
+public:
+    static const std::size_t MAX_CODES = 4096;
+    static const std::size_t MAX_VALUE_LEN = 64;
+    // после PROBE_VALUES обращений поле с долей новых значений выше 1 / HIGH_CARDINALITY_RATIO
+    // перестаёт кодироваться
+    static const std::size_t PROBE_VALUES = 1024;
+    static const std::size_t HIGH_CARDINALITY_RATIO = 2;
+
+    ValueDictionary();
+    ValueDictionary(const ValueDictionary &) = delete;
+    ValueDictionary &operator=(const ValueDictionary &) = delete;
+
+    // учесть значение нового документа; true - значение закодировано в code
+    bool store(std::string_view value, std::uint16_t &code);
+    // значение удалённого документа (encoded - было ли оно закодировано)
+    void drop(bool encoded, std::uint16_t code);
+
+    const std::string &decode(std::uint16_t code) const; // без блокировки
+    bool lookup(std::string_view value, std::uint16_t &code) const;
+
+    std::size_t distinctCount() const;
+    std::size_t encodedValues() const;
+    std::size_t inlineValues() const;
+    std::size_t poolBytes() const;
+    // доля обращений, нашедших уже выданный код (0 - обращений не было)
+    double hitRate() const;
+    std::size_t lookupCount() const;
+    std::size_t hitCount() const;
+    bool isHighCardinality() const;
+};
@@ -0,0 +1,358 @@
+#include "wal.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+WriteAheadLog::WriteAheadLog()
+    : fd(-1), written(0), flushed_lsn(0), durable_lsn(0),
+      sync_policy(SyncPolicy::Always), batch_ms(0),
+      sync_in_progress(false), sync_failed(false), syncer_stop(false) {}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    stop_syncer();
+    close();
+}
+
+bool WriteAheadLog::open(const string &log_path)
+{
+    close();
+    unique_lock<mutex> lock(sync_mtx);
+    path = log_path;
+    sync_failed = false;
+    return open_file();
+}
+
+bool WriteAheadLog::open_file()
+{
+    // папка базы могла ещё не существовать
+    error_code ec;
+    filesystem::path parent = filesystem::path(path).parent_path();
+    if (!parent.empty())
+        filesystem::create_directories(parent, ec);
+
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        cerr << "ERROR: не удалось открыть журнал " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    off_t end = ::lseek(fd, 0, SEEK_END);
+    written = end > 0 ? static_cast<size_t>(end) : 0;
+    return true;
+}
+
+void WriteAheadLog::close()
+{
+    if (fd >= 0)
+    {
+        flush();
+        unique_lock<mutex> lock(sync_mtx);
+        sync_all(lock);
+        ::close(fd);
+        fd = -1;
+    }
+    buffer.clear();
+}
+
+bool WriteAheadLog::isOpen() const
+{
+    return fd >= 0;
+}
+
+void WriteAheadLog::append_record(char op, const string &payload)
+{
+    buffer.push_back(op);
+    buffer.push_back(' ');
+    buffer += to_string(payload.size());
+    buffer.push_back('\n');
+    buffer += payload;
+    buffer.push_back('\n');
+}
+
+void WriteAheadLog::appendInsert(const string &doc_json)
+{
+    append_record('I', doc_json);
+}
+
+void WriteAheadLog::appendDelete(const string &id)
+{
+    append_record('D', id);
+}
+
+void WriteAheadLog::appendDropSegment(const string &label)
+{
+    append_record('S', label);
+}
+
+bool WriteAheadLog::flush()
+{
+    if (fd < 0 || buffer.empty())
+        return fd >= 0;
+
+    size_t done = 0;
+    bool ok = true;
+    while (done < buffer.size())
+    {
+        ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            cerr << "ERROR: запись в журнал " << path << ": " << strerror(errno) << endl;
+            ok = false;
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    // записанное уже в файле: при ошибке следующий flush дописывает только остаток,
+    // иначе начало записи попало бы в журнал дважды и replay оборвался бы на нём
+    written += done;
+    flushed_lsn += done;
+    buffer.erase(0, done);
+    return ok;
+}
+
+size_t WriteAheadLog::bytesWritten() const
+{
+    return written.load();
+}
+
+bool WriteAheadLog::rotate(const string &rotated_path)
+{
+    if (fd < 0)
+        return false;
+
+    // недописанный журнал нельзя отдавать контрольной точке: файл остаётся текущим
+    if (!flush())
+        return false;
+    unique_lock<mutex> lock(sync_mtx);
+    // ожидающие коммиты старого файла должны дождаться подтверждения;
+    // не подтверждённый fdatasync журнал контрольной точке не отдаём
+    if (!sync_all(lock))
+        return false;
+    ::close(fd);
+    fd = -1;
+
+    bool renamed = ::rename(path.c_str(), rotated_path.c_str()) == 0;
+    if (!renamed)
+    {
+        cerr << "ERROR: не удалось переименовать журнал " << path << ": " << strerror(errno) << endl;
+    }
+    // в любом случае продолжаем писать в path (при ошибке - в тот же файл)
+    open_file();
+    return renamed;
+}
+
+// лидер группы: один fdatasync за всех, кто успел сделать write() до него
+void WriteAheadLog::sync_group(unique_lock<mutex> &lock)
+{
+    sync_in_progress = true;
+    uint64_t target = flushed_lsn.load();
+    int sync_fd = fd; // fd не меняется, пока sync_in_progress
+
+    lock.unlock();
+    bool ok = sync_fd >= 0 && ::fdatasync(sync_fd) == 0;
+    if (!ok)
+    {
+        cerr << "ERROR: fdatasync журнала " << path << ": " << strerror(errno) << endl;
+    }
+    lock.lock();
+
+    // после ошибки fdatasync ядро могло выбросить грязные страницы:
+    // подтверждать их нельзя, ошибка остаётся до следующего open()
+    if (!ok)
+        sync_failed = true;
+    else if (target > durable_lsn)
+        durable_lsn = target;
+    sync_in_progress = false;
+    sync_cv.notify_all();
+}
+
+// синхронно довести до диска всё записанное (перед закрытием/ротацией файла)
+bool WriteAheadLog::sync_all(unique_lock<mutex> &lock)
+{
+    sync_cv.wait(lock, [this]
+                 { return !sync_in_progress; });
+    if (!sync_failed && fd >= 0 && sync_policy != SyncPolicy::None && flushed_lsn.load() > durable_lsn &&
+        ::fdatasync(fd) != 0)
+    {
+        cerr << "ERROR: fdatasync журнала " << path << ": " << strerror(errno) << endl;
+        sync_failed = true;
+    }
+    if (!sync_failed)
+        durable_lsn = flushed_lsn.load();
+    sync_cv.notify_all();
+    return !sync_failed;
+}
+
+void WriteAheadLog::syncer_loop()
+{
+    unique_lock<mutex> lock(sync_mtx);
+    while (!syncer_stop)
+    {
+        sync_cv.wait_for(lock, chrono::milliseconds(batch_ms), [this]
+                         { return syncer_stop; });
+        if (syncer_stop)
+            break;
+        if (!sync_in_progress && !sync_failed && fd >= 0 && flushed_lsn.load() > durable_lsn)
+        {
+            sync_group(lock);
+        }
+    }
+}
+
+void WriteAheadLog::stop_syncer()
+{
+    {
+        lock_guard<mutex> lock(sync_mtx);
+        syncer_stop = true;
+    }
+    sync_cv.notify_all();
+    if (syncer.joinable())
+    {
+        syncer.join();
+    }
+}
+
+void WriteAheadLog::setSyncPolicy(SyncPolicy policy, int batch_interval_ms)
+{
+    stop_syncer();
+    sync_policy = policy;
+    batch_ms = batch_interval_ms > 0 ? batch_interval_ms : 1;
+    if (sync_policy == SyncPolicy::Batch)
+    {
+        syncer_stop = false;
+        syncer = thread(&WriteAheadLog::syncer_loop, this);
+    }
+}
+
+SyncPolicy WriteAheadLog::syncPolicy() const
+{
+    return sync_policy;
+}
+
+uint64_t WriteAheadLog::lsn() const
+{
+    return flushed_lsn.load();
+}
+
+bool WriteAheadLog::waitDurable(uint64_t target)
+{
+    if (sync_policy == SyncPolicy::None)
+        return true;
+
+    unique_lock<mutex> lock(sync_mtx);
+    while (durable_lsn < target && fd >= 0 && !sync_failed)
+    {
+        if (sync_policy == SyncPolicy::Always && !sync_in_progress)
+        {
+            sync_group(lock);
+        }
+        else
+        {
+            // идёт чужой fdatasync или ждём пакетный поток
+            sync_cv.wait(lock);
+        }
+    }
+    return durable_lsn >= target;
+}
+
+bool WriteAheadLog::parseSyncPolicy(const string &text, SyncPolicy &policy, int &batch_interval_ms)
+{
+    batch_interval_ms = 0;
+    if (text == "always")
+    {
+        policy = SyncPolicy::Always;
+        return true;
+    }
+    if (text == "none")
+    {
+        policy = SyncPolicy::None;
+        return true;
+    }
+    if (text.rfind("batch:", 0) == 0)
+    {
+        try
+        {
+            batch_interval_ms = stoi(text.substr(6));
+        }
+        catch (...)
+        {
+            return false;
+        }
+        if (batch_interval_ms <= 0)
+            return false;
+        policy = SyncPolicy::Batch;
+        return true;
+    }
+    return false;
+}
+
+size_t WriteAheadLog::replay(const string &log_path,
+                             const function<void(char op, const string &payload)> &apply)
+{
+    ifstream file(log_path, ios::binary);
+    if (!file.is_open())
+        return 0;
+
+    stringstream ss;
+    ss << file.rdbuf();
+    string all = ss.str();
+    file.close();
+
+    size_t pos = 0;
+    size_t applied = 0;
+    while (pos < all.size())
+    {
+        // заголовок: op, пробел, длина, перевод строки
+        size_t header_end = all.find('\n', pos);
+        if (header_end == string::npos || header_end < pos + 3 || all[pos + 1] != ' ')
+            break;
+
+        char op = all[pos];
+        if (op != 'I' && op != 'D' && op != 'S')
+            break;
+
+        size_t len = 0;
+        bool ok = true;
+        for (size_t i = pos + 2; i < header_end; i++)
+        {
+            if (all[i] < '0' || all[i] > '9')
+            {
+                ok = false;
+                break;
+            }
+            len = len * 10 + (all[i] - '0');
+        }
+        size_t payload_start = header_end + 1;
+        if (!ok || payload_start + len >= all.size() || all[payload_start + len] != '\n')
+            break;
+
+        apply(op, all.substr(payload_start, len));
+        applied++;
+        pos = payload_start + len + 1;
+    }
+
+    if (pos < all.size())
+    {
+        // хвост оборван (падение посреди записи) - отрезаем, чтобы дописывать после целых записей
+        cerr << "WARNING: журнал " << log_path << " обрезан до " << pos
+             << " байт (битый хвост " << all.size() - pos << " байт)" << endl;
+        if (::truncate(log_path.c_str(), static_cast<off_t>(pos)) != 0)
+        {
+            cerr << "ERROR: не удалось обрезать журнал: " << strerror(errno) << endl;
+        }
+    }
+    return applied;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// политика fsync журнала
+//   Always - каждый коммит ждёт fdatasync (параллельные коммиты делят один вызов)
+//   Batch  - fdatasync раз в batch_ms, коммиты ждут ближайшую группу
+//   None   - без fsync, данные в page cache (теряются при падении ОС)
+enum class SyncPolicy
+{
+    Always,
+    Batch,
+    None
+};
+
+// журнал упреждающей записи (write-ahead log)
+// формат записи: <op> <длина>\n<payload>\n
+//   op = 'I' - вставка (payload = сериализованный документ)
+//   op = 'D' - удаление (payload = _id)
+//   op = 'S' - удаление временной секции целиком (payload = метка секции)
+class WriteAheadLog
+{
+private:
+    std::string path;   // путь к файлу журнала
+    int fd;             // дескриптор, открыт на дозапись
+    std::string buffer; // записи, ещё не переданные в write()
+    std::atomic<std::size_t> written; // байт в текущем файле журнала
+
+    // групповой коммит: позиции (lsn) считаются в байтах за всё время работы
+    std::atomic<std::uint64_t> flushed_lsn; // передано в write()
+    std::uint64_t durable_lsn;              // пережило fdatasync (под sync_mtx)
+    SyncPolicy sync_policy;
+    int batch_ms;
+    std::mutex sync_mtx;
+    std::condition_variable sync_cv;
+    bool sync_in_progress; // fdatasync идёт без sync_mtx
+    bool sync_failed;      // fdatasync вернул ошибку: durable_lsn больше не растёт до open()
+    std::thread syncer;    // только для Batch
+    bool syncer_stop;
+
+    void append_record(char op, const std::string &payload);
+    bool open_file();
+    void sync_group(std::unique_lock<std::mutex> &lock);
+    bool sync_all(std::unique_lock<std::mutex> &lock);
+    void syncer_loop();
+    void stop_syncer();
+
+public:
+    WriteAheadLog();
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    bool open(const std::string &log_path);
+    void close();
+    bool isOpen() const;
+
+    void appendInsert(const std::string &doc_json);
+    void appendDelete(const std::string &id);
+    void appendDropSegment(const std::string &label);
+    bool flush(); // сброс буфера в файл одним write()
+
+    // байт в файле журнала (читается фоновым потоком без блокировки)
+    std::size_t bytesWritten() const;
+    // переименовать текущий журнал в rotated_path и начать новый пустой;
+    // false - буфер не записан (журнал остаётся прежним) или переименование не удалось
+    bool rotate(const std::string &rotated_path);
+
+    void setSyncPolicy(SyncPolicy policy, int batch_interval_ms = 0);
+    SyncPolicy syncPolicy() const;
+    std::uint64_t lsn() const;               // позиция после последнего flush()
+    // блокирует до fdatasync позиции target; false - fdatasync не удался или журнал закрыт
+    bool waitDurable(std::uint64_t target);
+
+    // "always" | "batch:<ms>" | "none"
+    static bool parseSyncPolicy(const std::string &text, SyncPolicy &policy, int &batch_interval_ms);
+
+    // проигрывает журнал, возвращает число применённых записей;
+    // недописанный хвост (обрыв при падении) отрезается
+    static std::size_t replay(const std::string &log_path,
+                              const std::function<void(char op, const std::string &payload)> &apply);
+};
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <string>
+#include <vector>
 #include <cstdlib>
 #include <cctype>
 #include <algorithm>
@@ -133,6 +134,32 @@ bool readLine(int sock, std::string& out)
 }
 
 
+// конец первого JSON-объекта строки (позиция после '}'); npos - объект не закрыт
+static std::size_t jsonObjectEnd(const std::string& s)
+{
+    int depth = 0;
+    bool in_string = false;
+    for (std::size_t i = 0; i < s.size(); ++i)
+    {
+        char c = s[i];
+        if (in_string)
+        {
+            if (c == '\\')
+                ++i;
+            else if (c == '"')
+                in_string = false;
+            continue;
+        }
+        if (c == '"')
+            in_string = true;
+        else if (c == '{' || c == '[')
+            ++depth;
+        else if ((c == '}' || c == ']') && --depth == 0)
+            return i + 1;
+    }
+    return std::string::npos;
+}
+
 static bool buildJsonRequestFromCommand(const std::string& line, const std::string& database, std::string& outJson) // построение JSON-запроса из команды пользователя
 {
     std::string trimmed = trim(line); // убираем пробелы
@@ -147,15 +174,46 @@ static bool buildJsonRequestFromCommand(const std::string& line, const std::stri
     std::string rest = (spacePos == std::string::npos ? std::string() : trim(trimmed.substr(spacePos + 1))); // остальная часть
     std::string op = toLower(cmd); // приводим к индексу
 
-    if (op != "insert" && op != "find" && op != "delete")
+    if (op == "createindex")
+    {
+        op = "createIndex";
+    }
+    else if (op == "getmore")
+    {
+        op = "getMore";
+    }
+    else if (op == "killcursor")
+    {
+        op = "killCursor";
+    }
+    else if (op == "approxdistinct")
+    {
+        op = "approxDistinct";
+    }
+    else if (op == "createview")
+    {
+        op = "createView";
+    }
+    else if (op == "dropview")
+    {
+        op = "dropView";
+    }
+    else if (op == "views")
+    {
+        op = "view";
+    }
+    if (op != "insert" && op != "find" && op != "delete" && op != "stats" && op != "segments" && op != "retention" && op != "createIndex" &&
+        op != "getMore" && op != "killCursor" && op != "aggregate" && op != "histogram" && op != "topk" && op != "approxDistinct" &&
+        op != "createView" && op != "dropView" && op != "view")
     {
         std::cerr << "Unknown command: " << cmd
-                  << " (use INSERT, FIND, DELETE)\n";
+                  << " (use INSERT, FIND, DELETE, STATS, SEGMENTS, RETENTION, CREATEINDEX, GETMORE, KILLCURSOR, AGGREGATE, HISTOGRAM, TOPK, APPROXDISTINCT, CREATEVIEW, DROPVIEW, VIEW, VIEWS)\n";
         return false;
     }
 
     // Для find/delete, если условия нет - считаем "{}"
     std::string queryJson = "{}";
+    std::string optionsJson;
     if (op == "find" || op == "delete")
     {
         if (!rest.empty())
@@ -164,6 +222,44 @@ static bool buildJsonRequestFromCommand(const std::string& line, const std::stri
         }
     }
 
+    // FIND {условие} {"limit":10,"sort":{"timestamp":-1}} {"timestamp":1,"ip":1} -
+    // второй объект - параметры выдачи, третий - проекция (выдаваемые поля)
+    std::string projectionJson;
+    if (op == "find" && !rest.empty() && rest.front() == '{')
+    {
+        std::size_t end = jsonObjectEnd(rest);
+        if (end != std::string::npos && end < rest.size())
+        {
+            queryJson = rest.substr(0, end);
+            optionsJson = trim(rest.substr(end));
+            std::size_t options_end = jsonObjectEnd(optionsJson);
+            if (options_end != std::string::npos && options_end < optionsJson.size())
+            {
+                projectionJson = trim(optionsJson.substr(options_end));
+                optionsJson = optionsJson.substr(0, options_end);
+            }
+        }
+    }
+
+    // GETMORE 7 [100] - следующая порция курсора [размером 100], KILLCURSOR 7 - закрыть
+    if (op == "getMore" || op == "killCursor")
+    {
+        std::string id = rest;
+        std::string batch;
+        std::size_t space = rest.find(' ');
+        if (space != std::string::npos)
+        {
+            id = trim(rest.substr(0, space));
+            batch = trim(rest.substr(space + 1));
+        }
+        if (!is_integer_string(id) || (!batch.empty() && (op == "killCursor" || !is_integer_string(batch))))
+        {
+            std::cerr << cmd << " требует номер курсора" << (op == "getMore" ? " и, по желанию, размер порции" : "") << ".\n";
+            return false;
+        }
+        optionsJson = "{\"cursor\":" + id + (batch.empty() ? "" : ",\"batchSize\":" + batch) + "}";
+    }
+
 
     //  rest должен быть либо (один документ), либо (массив).
     std::string dataJson = "[]";
@@ -189,6 +285,252 @@ static bool buildJsonRequestFromCommand(const std::string& line, const std::stri
         queryJson = "{}"; 
     }
 
+    // AGGREGATE severity source - число событий по парам значений,
+    // AGGREGATE {отбор} {"groupBy":["hostname"],"fields":{"n":{"$count":1},"last":{"$max":"timestamp"}}}
+    if (op == "aggregate")
+    {
+        if (rest.empty() || rest.front() != '{')
+        {
+            std::string groupBy;
+            std::size_t start = 0;
+            while (start < rest.size())
+            {
+                std::size_t end = rest.find(' ', start);
+                std::string field = rest.substr(start, end == std::string::npos ? std::string::npos : end - start);
+                if (!field.empty())
+                {
+                    groupBy += (groupBy.empty() ? "\"" : ",\"") + escapeJsonString(field) + "\"";
+                }
+                start = end == std::string::npos ? rest.size() : end + 1;
+            }
+            dataJson = "{\"groupBy\":[" + groupBy + "]}";
+        }
+        else
+        {
+            std::size_t end = jsonObjectEnd(rest);
+            queryJson = end == std::string::npos ? rest : rest.substr(0, end);
+            std::string spec = end == std::string::npos ? std::string() : trim(rest.substr(end));
+            dataJson = spec.empty() ? "{}" : spec;
+        }
+    }
+
+    // HISTOGRAM 2026-10-15T00:00:00.000Z 2026-10-15T01:00:00.000Z 1m [severity] - события по минутам,
+    // HISTOGRAM {фильтр} {"from":"...","to":"...","bucket":"5m","splitBy":"severity"}
+    if (op == "histogram")
+    {
+        if (!rest.empty() && rest.front() == '{')
+        {
+            std::size_t end = jsonObjectEnd(rest);
+            queryJson = end == std::string::npos ? rest : rest.substr(0, end);
+            dataJson = end == std::string::npos ? std::string("{}") : trim(rest.substr(end));
+        }
+        else
+        {
+            std::vector<std::string> words;
+            std::size_t start = 0;
+            while (start < rest.size())
+            {
+                std::size_t end = rest.find(' ', start);
+                std::string word = rest.substr(start, end == std::string::npos ? std::string::npos : end - start);
+                if (!word.empty())
+                {
+                    words.push_back(word);
+                }
+                start = end == std::string::npos ? rest.size() : end + 1;
+            }
+            if (words.size() < 3 || words.size() > 4)
+            {
+                std::cerr << "HISTOGRAM требует начало, конец, ширину интервала и, по желанию, поле разбивки.\n";
+                return false;
+            }
+            dataJson = "{\"from\":\"" + escapeJsonString(words[0]) + "\",\"to\":\"" + escapeJsonString(words[1]) +
+                       "\",\"bucket\":\"" + escapeJsonString(words[2]) + "\"" +
+                       (words.size() == 4 ? ",\"splitBy\":\"" + escapeJsonString(words[3]) + "\"" : "") + "}";
+        }
+    }
+
+    // TOPK ip [10] - самые частые значения поля, TOPK {фильтр} {"field":"ip","k":10,"mode":"sketch"}
+    if (op == "topk")
+    {
+        if (!rest.empty() && rest.front() == '{')
+        {
+            std::size_t end = jsonObjectEnd(rest);
+            queryJson = end == std::string::npos ? rest : rest.substr(0, end);
+            dataJson = end == std::string::npos ? std::string("{}") : trim(rest.substr(end));
+        }
+        else
+        {
+            std::string field = rest;
+            std::string k;
+            std::size_t space = rest.find(' ');
+            if (space != std::string::npos)
+            {
+                field = trim(rest.substr(0, space));
+                k = trim(rest.substr(space + 1));
+            }
+            if (field.empty() || (!k.empty() && !is_integer_string(k)))
+            {
+                std::cerr << "TOPK требует имя поля и, по желанию, число значений.\n";
+                return false;
+            }
+            dataJson = "{\"field\":\"" + escapeJsonString(field) + "\"" + (k.empty() ? "" : ",\"k\":" + k) + "}";
+        }
+    }
+
+    // APPROXDISTINCT ip user - оценка числа различных значений полей,
+    // APPROXDISTINCT {"field":"ip","from":"...","to":"...","bySegment":true}
+    if (op == "approxDistinct")
+    {
+        if (!rest.empty() && rest.front() == '{')
+        {
+            dataJson = rest;
+        }
+        else
+        {
+            std::string fields;
+            std::size_t start = 0;
+            while (start < rest.size())
+            {
+                std::size_t end = rest.find(' ', start);
+                std::string field = rest.substr(start, end == std::string::npos ? std::string::npos : end - start);
+                if (!field.empty())
+                {
+                    fields += (fields.empty() ? "\"" : ",\"") + escapeJsonString(field) + "\"";
+                }
+                start = end == std::string::npos ? rest.size() : end + 1;
+            }
+            if (fields.empty())
+            {
+                std::cerr << "APPROXDISTINCT требует имя поля.\n";
+                return false;
+            }
+            dataJson = "{\"field\":[" + fields + "]}";
+        }
+    }
+
+    // CREATEVIEW {"name":"sev_per_min","groupBy":["severity","hostname"],"bucket":"1m"} или
+    // CREATEVIEW {отбор} {описание}
+    if (op == "createView")
+    {
+        std::size_t end = jsonObjectEnd(rest);
+        if (rest.empty() || rest.front() != '{' || end == std::string::npos)
+        {
+            std::cerr << "CREATEVIEW требует описание {\"name\": ..., \"groupBy\": ...}.\n";
+            return false;
+        }
+        std::string spec = trim(rest.substr(end));
+        if (spec.empty())
+        {
+            dataJson = rest;
+        }
+        else
+        {
+            queryJson = rest.substr(0, end);
+            dataJson = spec;
+        }
+    }
+
+    // DROPVIEW sev_per_min
+    if (op == "dropView")
+    {
+        if (rest.empty())
+        {
+            std::cerr << "DROPVIEW требует имя представления.\n";
+            return false;
+        }
+        dataJson = "{\"name\":\"" + escapeJsonString(rest) + "\"}";
+    }
+
+    // VIEW sev_per_min [начало конец], VIEW {"name":"...","from":"...","to":"..."}, VIEWS - список
+    if (op == "view")
+    {
+        if (!rest.empty() && rest.front() == '{')
+        {
+            dataJson = rest;
+        }
+        else if (!rest.empty())
+        {
+            std::vector<std::string> words;
+            std::size_t start = 0;
+            while (start < rest.size())
+            {
+                std::size_t end = rest.find(' ', start);
+                std::string word = rest.substr(start, end == std::string::npos ? std::string::npos : end - start);
+                if (!word.empty())
+                {
+                    words.push_back(word);
+                }
+                start = end == std::string::npos ? rest.size() : end + 1;
+            }
+            if (words.size() != 1 && words.size() != 3)
+            {
+                std::cerr << "VIEW требует имя представления и, по желанию, начало и конец.\n";
+                return false;
+            }
+            dataJson = "{\"name\":\"" + escapeJsonString(words[0]) + "\"" +
+                       (words.size() == 3 ? ",\"from\":\"" + escapeJsonString(words[1]) + "\",\"to\":\"" +
+                                                escapeJsonString(words[2]) + "\""
+                                          : std::string()) +
+                       "}";
+        }
+    }
+
+    // CREATEINDEX ip, CREATEINDEX timestamp ordered или CREATEINDEX {"field":"ip"}
+    if (op == "createIndex")
+    {
+        if (rest.empty())
+        {
+            std::cerr << "CREATEINDEX требует имя поля.\n";
+            return false;
+        }
+        if (rest.front() == '{')
+        {
+            dataJson = rest;
+        }
+        else
+        {
+            std::string field = rest;
+            std::string type = "hash";
+            std::size_t typePos = rest.rfind(' ');
+            if (typePos != std::string::npos)
+            {
+                std::string suffix = toLower(trim(rest.substr(typePos + 1)));
+                if (suffix == "ordered" || suffix == "hash")
+                {
+                    type = suffix;
+                    field = trim(rest.substr(0, typePos));
+                }
+            }
+            dataJson = "{\"field\":\"" + escapeJsonString(field) + "\",\"type\":\"" + type + "\"}";
+        }
+    }
+
+    // RETENTION - показать, RETENTION 720 [1024] - часы [и МБ], RETENTION {"max_mb":1024}
+    if (op == "retention" && !rest.empty())
+    {
+        if (rest.front() == '{')
+        {
+            dataJson = rest;
+        }
+        else
+        {
+            std::string hours = rest;
+            std::string mb;
+            std::size_t space = rest.find(' ');
+            if (space != std::string::npos)
+            {
+                hours = trim(rest.substr(0, space));
+                mb = trim(rest.substr(space + 1));
+            }
+            if (!is_integer_string(hours) || (!mb.empty() && !is_integer_string(mb)))
+            {
+                std::cerr << "RETENTION требует число часов и, по желанию, число МБ.\n";
+                return false;
+            }
+            dataJson = "{\"max_age_hours\":" + hours + (mb.empty() ? "" : ",\"max_mb\":" + mb) + "}";
+        }
+    }
+
     // Собираем JSON-запрос:
     // }
     std::string json;
@@ -210,6 +552,18 @@ static bool buildJsonRequestFromCommand(const std::string& line, const std::stri
     json += "\"query\":";
     json += queryJson;
 
+    if (!optionsJson.empty())
+    {
+        json += ",\"options\":";
+        json += optionsJson;
+    }
+
+    if (!projectionJson.empty())
+    {
+        json += ",\"projection\":";
+        json += projectionJson;
+    }
+
     json += "}";
     json += "\n"; // сервер ждёт строку, заканчивающуюся \n
 
@@ -0,0 +1,55 @@
+#include "../db/minidbms.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// конвертер коллекций: <db>.json -> файлы секций <db>.segments/ и обратно
+// журнал <db>.wal (если есть) тоже учитывается - сервер должен быть остановлен
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: " << argv[0] << " <db_folder> <db_name> [--to-json]\n"
+             << "  по умолчанию: <db>.json (+ журнал) -> <db>.segments/\n"
+             << "  --to-json:    <db>.segments/ (+ журнал) -> <db>.json\n";
+        return 1;
+    }
+
+    string folder = argv[1];
+    string name = argv[2];
+    bool toJson = false;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--to-json")
+        {
+            toJson = true;
+        }
+        else
+        {
+            cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    MiniDBMS db(name, folder);
+    db.loadFromDisk();
+
+    if (toJson)
+    {
+        db.saveToDisk();
+        cout << "Exported " << folder << "/" << name << ".json\n";
+        return 0;
+    }
+
+    if (!db.writeSnapshot())
+    {
+        cerr << "Failed to write snapshot\n";
+        return 1;
+    }
+    cout << "Written " << folder << "/" << name << ".segments\n";
+    return 0;
+}
@@ -35,6 +35,19 @@ static mutex g_dbListMutex;
 static std::atomic<int> g_activeClients{0};
 // максимально допустимое количество одновременно обслуживаемых клиентов
 static constexpr int MAX_CLIENTS = 16;
+// режим журнала для новых баз (--no-wal возвращает полную перезапись файла)
+static bool g_walEnabled = true;
+// пороги фоновой контрольной точки (0 - порог выключен)
+static size_t g_checkpointBytes = MiniDBMS::DEFAULT_CHECKPOINT_WAL_BYTES;
+static int g_checkpointSec = MiniDBMS::DEFAULT_CHECKPOINT_INTERVAL_SEC;
+// политика fsync журнала (--sync=always|batch:<ms>|none)
+static SyncPolicy g_syncPolicy = SyncPolicy::Always;
+static int g_syncBatchMs = 0;
+// размер временной секции коллекции (--partition=hour|day)
+static PartitionUnit g_partitionUnit = PartitionUnit::Day;
+// срок хранения по умолчанию (0 - без ограничения), для базы меняется операцией retention
+static long long g_retentionHours = 0;
+static long long g_retentionMb = 0;
 
 
 
@@ -78,8 +91,8 @@ static bool readLine(int sock, std::string& out)
 }
 
 
-// отправка всей строки
-static bool writeAll(int sock, const std::string& data)
+// отправка всей строки; more - за ней сразу пойдёт продолжение (ядро не шлёт неполный пакет)
+static bool writeAll(int sock, const std::string& data, bool more = false)
 {
     const char* buf = data.c_str();
     size_t total = data.size();
@@ -87,7 +100,7 @@ static bool writeAll(int sock, const std::string& data)
 
     while (sent < total)
     {
-        ssize_t n = ::send(sock, buf + sent, total - sent, 0);
+        ssize_t n = ::send(sock, buf + sent, total - sent, more ? MSG_MORE : 0);
 
         if (n < 0)
         {
@@ -269,6 +282,18 @@ static bool parseJsonRequest(const string& line, Request& req)
         req.query_json = query_value;
     }
 
+    string options_value;
+    if (extractJsonValueField(line, "options", options_value))
+    {
+        req.options_json = options_value;
+    }
+
+    string projection_value;
+    if (extractJsonValueField(line, "projection", projection_value))
+    {
+        req.projection_json = projection_value;
+    }
+
     return true;
 }
 
@@ -306,11 +331,11 @@ static string escapeJsonString(const string& s)
     return result;
 }
 
-// сериализация Response в JSON
-static string serializeResponseToJson(const Response& resp)
+// сериализация Response в JSON без поля data (оно уходит отдельно, без копирования)
+static string serializeResponseHead(const Response& resp)
 {
     string json;
-    json.reserve(128 + resp.data.size());
+    json.reserve(128);
 
     json += "{";
 
@@ -326,23 +351,27 @@ static string serializeResponseToJson(const Response& resp)
     json += to_string(resp.count);
     json += ",";
 
-    // data — уже валидный JSON (обычно массив []), поэтому без кавычек
-    json += "\"data\":";
-    if (resp.data.empty())
-    {
-        json += "[]";
-    }
-    else
+    if (resp.cursor != 0)
     {
-        json += resp.data;
+        json += "\"cursor\":";
+        json += to_string(resp.cursor);
+        json += ",";
     }
 
-    json += "}";
-    json += "\n";
-
+    json += "\"data\":";
     return json;
 }
 
+// ответ одной строкой: заголовок, data (уже валидный JSON, обычно массив []) и хвост
+static bool sendResponse(int sock, const Response& resp)
+{
+    static const string empty_data = "[]";
+    static const string tail = "}\n";
+    return writeAll(sock, serializeResponseHead(resp), true) &&
+           writeAll(sock, resp.data.empty() ? empty_data : resp.data, true) &&
+           writeAll(sock, tail);
+}
+
 
 static DbEntry* getOrCreateDbEntry(const string& dbName) // получение или создание записи базы
 {
@@ -361,6 +390,10 @@ static DbEntry* getOrCreateDbEntry(const string& dbName) // получение 
 
     // не нашли - создаём новую базу
     MiniDBMS* db = new MiniDBMS(dbName);
+    db->setWalEnabled(g_walEnabled);
+    db->setSyncPolicy(g_syncPolicy, g_syncBatchMs);
+    db->setPartitionUnit(g_partitionUnit);
+    db->setDefaultRetention(g_retentionHours, g_retentionMb);
     db->loadFromDisk();
 
     DbEntry* entry = new DbEntry;
@@ -370,10 +403,90 @@ static DbEntry* getOrCreateDbEntry(const string& dbName) // получение 
 
     g_dbList = entry;
 
+    // фоновые контрольные точки берут entry->mtx только на ротацию журнала
+    db->setCheckpointPolicy(g_checkpointBytes, g_checkpointSec);
+    db->startMaintenance(entry->mtx);
+
     return entry;
 }
 
 
+// запись базы только для чтения: уже открытая или с файлами на диске; nullptr - базы нет
+// (чтение не должно создавать пустые базы по опечатке в имени)
+static DbEntry* findDbEntry(const string& dbName)
+{
+    {
+        lock_guard<mutex> lock(g_dbListMutex);
+        for (DbEntry* current = g_dbList; current != nullptr; current = current->next)
+        {
+            if (current->name == dbName)
+            {
+                return current;
+            }
+        }
+    }
+    return MiniDBMS::existsOnDisk(dbName) ? getOrCreateDbEntry(dbName) : nullptr;
+}
+
+
+// approxDistinct с "databases": скетчи баз сливаются, каждая читается под своей блокировкой;
+// false - запрос не такой (обрабатывается как обычно)
+static bool processDistinctAcross(const Request& req, Response& resp)
+{
+    DistinctSpec spec;
+    string error;
+    if (req.operation != "approxDistinct" || !DistinctSpec::parse(req.data_json, spec, error) ||
+        spec.databases.empty())
+    {
+        return false;
+    }
+
+    resp.status = "error";
+    resp.count = 0;
+    resp.data = "[]";
+    if (spec.by_segment)
+    {
+        resp.message = "bySegment works for a single database only";
+        return true;
+    }
+
+    vector<DbEntry*> entries;
+    for (const string& name : spec.databases)
+    {
+        DbEntry* entry = findDbEntry(name);
+        if (entry == nullptr)
+        {
+            resp.message = "Database not found: " + name;
+            return true;
+        }
+        entries.push_back(entry);
+    }
+
+    vector<HyperLogLog> merged(spec.fields.size());
+    for (DbEntry* entry : entries)
+    {
+        string rows_json;
+        size_t rows = 0;
+        vector<HyperLogLog> part;
+        {
+            lock_guard<mutex> dbLock(entry->mtx);
+            entry->db->approxDistinct(spec, rows_json, rows, part);
+        }
+        for (size_t i = 0; i < merged.size(); i++)
+        {
+            merged[i].merge(part[i]);
+        }
+    }
+
+    resp.data = "[";
+    spec.appendRow(merged, nullptr, resp.data);
+    resp.data += "]";
+    resp.status = "success";
+    resp.message = "Estimated distinct values across " + to_string(spec.databases.size()) + " databases (HyperLogLog)";
+    resp.count = 1;
+    return true;
+}
+
 // обработка клиента
 static void handleClient(int clientSock)
 {
@@ -396,24 +509,43 @@ static void handleClient(int clientSock)
             resp.count   = 0;
             resp.data    = "[]";
 
-            string out = serializeResponseToJson(resp);
-            (void)writeAll(clientSock, out);
+            (void)sendResponse(clientSock, resp);
+            continue;
+        }
+
+        Response resp;
+        if (processDistinctAcross(req, resp))
+        {
+            if (!sendResponse(clientSock, resp))
+            {
+                break;
+            }
             continue;
         }
 
         // Получаем (или создаём) запись для нужной базы
         DbEntry* entry = getOrCreateDbEntry(req.database);
 
-        Response resp;
+        uint64_t commitLsn = 0;
         {
             // Блокируем КОНКРЕТНУЮ БД на время операции
             lock_guard<mutex> dbLock(entry->mtx);
             resp = processRequest(req, *entry->db);
+            commitLsn = entry->db->commitLsn();
+        }
+
+        // ответ на запись - только после fsync журнала; ждём без блокировки БД,
+        // чтобы параллельные вставки других агентов попали в тот же fsync
+        if (resp.status == "success" &&
+            (req.operation == "insert" || req.operation == "delete") &&
+            !entry->db->waitDurable(commitLsn))
+        {
+            resp.status  = "error";
+            resp.message += ", but not synced to disk";
         }
 
         // Сериализуем ответ в JSON и отправляем
-        string out = serializeResponseToJson(resp);
-        if (!writeAll(clientSock, out))
+        if (!sendResponse(clientSock, resp))
         {
             // Ошибка отправки - выходим из цикла и закрываем сокет
             break;
@@ -429,13 +561,63 @@ int main(int argc, char* argv[])
     if (argc < 3) // порт и имя бд
     {
         cerr << "Usage: " << argv[0]
-                  << " <port> <default_db_name>\n";
+                  << " <port> <default_db_name> [--no-wal]"
+                  << " [--checkpoint-mb=<n>] [--checkpoint-sec=<n>]"
+                  << " [--sync=always|batch:<ms>|none] [--partition=hour|day]"
+                  << " [--retention-hours=<n>] [--retention-mb=<n>] [--scan-threads=<n>]\n";
         return 1;
     }
 
     int port = stoi(argv[1]);
     string defaultDbName = argv[2];
 
+    for (int i = 3; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--no-wal")
+        {
+            g_walEnabled = false;
+        }
+        else if (arg.rfind("--sync=", 0) == 0)
+        {
+            if (!WriteAheadLog::parseSyncPolicy(arg.substr(7), g_syncPolicy, g_syncBatchMs))
+            {
+                cerr << "Invalid --sync value: " << arg.substr(7) << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--partition=hour" || arg == "--partition=day")
+        {
+            g_partitionUnit = arg == "--partition=hour" ? PartitionUnit::Hour : PartitionUnit::Day;
+        }
+        else if (arg.rfind("--retention-hours=", 0) == 0)
+        {
+            g_retentionHours = stoll(arg.substr(18));
+        }
+        else if (arg.rfind("--retention-mb=", 0) == 0)
+        {
+            g_retentionMb = stoll(arg.substr(15));
+        }
+        else if (arg.rfind("--scan-threads=", 0) == 0)
+        {
+            // потоков на полный проход find/delete/aggregate (0 - по числу ядер, 1 - без пула)
+            ScanPool::setSharedWorkers(stoul(arg.substr(15)));
+        }
+        else if (arg.rfind("--checkpoint-mb=", 0) == 0)
+        {
+            g_checkpointBytes = stoul(arg.substr(16)) << 20;
+        }
+        else if (arg.rfind("--checkpoint-sec=", 0) == 0)
+        {
+            g_checkpointSec = stoi(arg.substr(17));
+        }
+        else
+        {
+            cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+
     // заранее подгружаем дефолтную БД
     {
         DbEntry* entry = getOrCreateDbEntry(defaultDbName);
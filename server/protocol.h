@@ -2,13 +2,26 @@
 
 #include <string>
 #include <cstddef> 
+#include <cstdint>
 
 struct Request
 { 
     std::string database; // имя базы данных
-    std::string operation; // "insert", "find", "delete"
-    std::string data_json; // данные для вставки (только для insert)
+    std::string operation; // "insert", "find", "delete", "stats", "segments", "retention", "createIndex",
+                           // "getMore", "killCursor", "aggregate", "histogram", "topk",
+                           // "approxDistinct", "createView", "dropView", "view"
+    std::string data_json; // данные для вставки (insert) или {"field": "...", "type": "hash"|"ordered"} (createIndex),
+                           // {"max_age_hours": n, "max_mb": n} (retention),
+                           // {"groupBy": [...], "fields": {"имя": {"$count": 1}}} (aggregate),
+                           // {"from", "to", "bucket": "1m", "splitBy": "severity"} (histogram),
+                           // {"field": "ip", "k": 10, "mode": "auto"} (topk),
+                           // {"field": ["ip", "user"], "from", "to", "bySegment", "databases"} (approxDistinct),
+                           // {"name", "groupBy", "bucket": "1m", "fields"} (createView), {"name"} (dropView),
+                           // {"name", "from", "to"} (view; без данных - список представлений)
     std::string query_json; // уловия
+    // find: {"skip", "limit", "sort": {"поле": 1 | -1}, "batchSize"}; getMore/killCursor: {"cursor", "batchSize"}
+    std::string options_json;
+    std::string projection_json; // find: {"поле": 1, ...} - только эти поля, {"поле": 0} - без них
 };
 
 struct Response
@@ -18,4 +31,5 @@ struct Response
     std::size_t count = 0; // количество найденных/удаленных документов
 
     std::string data; // найденные данные в формате JSON (для find)
+    std::uint64_t cursor = 0; // find/getMore: курсор с остатком ответа (0 - ответ выдан весь)
 };
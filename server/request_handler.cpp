@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <stdexcept>
+#include <cstdio>
 
 #include "../db/utills.h" // trim()
 
@@ -71,6 +72,46 @@ static bool splitJsonArrayObjects(const std::string& arrJson,
 }
 
 
+// строковое поле верхнего уровня объекта: {"field": "ip"}
+static bool extractStringField(const std::string& json, const std::string& key, std::string& out)
+{
+    size_t pos = json.find("\"" + key + "\"");
+    if (pos == std::string::npos)
+        return false;
+    pos = json.find(':', pos + key.size() + 2);
+    if (pos == std::string::npos)
+        return false;
+    size_t start = json.find('"', pos + 1);
+    if (start == std::string::npos)
+        return false;
+    size_t end = json.find('"', start + 1);
+    if (end == std::string::npos)
+        return false;
+    out = trim(json.substr(start + 1, end - start - 1));
+    return true;
+}
+
+// целое поле верхнего уровня объекта: {"max_mb": 512} или {"max_mb": "512"}
+static bool extractIntegerField(const std::string& json, const std::string& key, long long& out)
+{
+    size_t pos = json.find("\"" + key + "\"");
+    if (pos == std::string::npos)
+        return false;
+    pos = json.find(':', pos + key.size() + 2);
+    if (pos == std::string::npos)
+        return false;
+    size_t start = json.find_first_not_of(" \t\"", pos + 1);
+    if (start == std::string::npos)
+        return false;
+    size_t end = json.find_first_not_of("+-0123456789", start);
+    std::string digits = json.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    if (!is_integer_string(digits))
+        return false;
+    out = std::stoll(digits);
+    return true;
+}
+
+
 Response processRequest(const Request& req, MiniDBMS& db)
 {
     Response resp;
@@ -108,7 +149,11 @@ Response processRequest(const Request& req, MiniDBMS& db)
                     resp.count++;
                 }
 
-                db.saveToDisk();
+                if (!db.commit())
+                {
+                    resp.message = "Batch inserted: " + std::to_string(resp.count) + ", but not saved to disk";
+                    return resp;
+                }
 
                 resp.status = "success";
                 resp.message = "Batch inserted: " + std::to_string(resp.count);
@@ -119,7 +164,12 @@ Response processRequest(const Request& req, MiniDBMS& db)
             if (data.front() == '{')
             {
                 db.insertQuery(data);
-                db.saveToDisk();
+                resp.count = 1;
+                if (!db.commit())
+                {
+                    resp.message = "Inserted 1 document, but not saved to disk";
+                    return resp;
+                }
 
                 resp.status = "success";
                 resp.count = 1;
@@ -138,15 +188,62 @@ Response processRequest(const Request& req, MiniDBMS& db)
             if (query.empty())
                 query = "{}";
 
-            std::string json_array;
+            FindOptions options;
+            std::string error;
+            if (!db.parseFindOptions(req.options_json, req.projection_json, options, error))
+            {
+                resp.message = error;
+                return resp;
+            }
+
             size_t count = 0;
+            db.findWithOptions(query, options, resp.data, count, resp.cursor);
 
-            db.findQueryToJsonArray(query, json_array, count);
+            resp.status = "success";
+            resp.message = "Fetched " + std::to_string(count);
+            resp.count = count;
+            return resp;
+        }
+
+        if (req.operation == "getMore" || req.operation == "killCursor")
+        {
+            long long cursor = 0;
+            long long batch = 0;
+            if (!extractIntegerField(req.options_json, "cursor", cursor) || cursor <= 0)
+            {
+                resp.message = req.operation + " requires options {\"cursor\": id}";
+                return resp;
+            }
+            extractIntegerField(req.options_json, "batchSize", batch);
+            if (batch < 0)
+            {
+                resp.message = "Option batchSize must be a non-negative integer";
+                return resp;
+            }
 
+            std::uint64_t id = static_cast<std::uint64_t>(cursor);
+            if (req.operation == "killCursor")
+            {
+                if (!db.killCursor(id))
+                {
+                    resp.message = "Cursor not found: " + std::to_string(id);
+                    return resp;
+                }
+                resp.status = "success";
+                resp.message = "Cursor closed";
+                return resp;
+            }
+
+            size_t count = 0;
+            if (!db.getMore(id, static_cast<size_t>(batch), resp.data, count))
+            {
+                resp.message = "Cursor not found: " + std::to_string(cursor);
+                return resp;
+            }
             resp.status = "success";
             resp.message = "Fetched " + std::to_string(count);
-            resp.data = json_array;
             resp.count = count;
+            resp.cursor = id;
             return resp;
         }
 
@@ -157,7 +254,12 @@ Response processRequest(const Request& req, MiniDBMS& db)
                 query = "{}";
 
             size_t removed = db.deleteQuery(query);
-            db.saveToDisk();
+            resp.count = removed;
+            if (!db.commit())
+            {
+                resp.message = "Deleted " + std::to_string(removed) + ", but not saved to disk";
+                return resp;
+            }
 
             resp.status = "success";
             resp.message = "Deleted " + std::to_string(removed);
@@ -166,6 +268,225 @@ Response processRequest(const Request& req, MiniDBMS& db)
             return resp;
         }
 
+        if (req.operation == "stats")
+        {
+            std::string json_array;
+            size_t fields = 0;
+            double hit_rate = 0.0;
+            db.dictionaryStatsToJson(json_array, fields, hit_rate);
+
+            char rate[32];
+            std::snprintf(rate, sizeof(rate), "%.4f", hit_rate);
+            resp.status = "success";
+            resp.message = std::string("Dictionary hit rate ") + rate;
+            resp.data = json_array;
+            resp.count = fields;
+            return resp;
+        }
+
+        if (req.operation == "segments")
+        {
+            db.segmentsToJson(resp.data);
+            resp.status = "success";
+            resp.message = "Segments";
+            resp.count = db.segmentCount();
+            return resp;
+        }
+
+        if (req.operation == "retention")
+        {
+            // без данных - только показать текущий срок хранения
+            long long hours = db.retentionHours();
+            long long mb = db.retentionMb();
+            bool has_hours = extractIntegerField(req.data_json, "max_age_hours", hours);
+            bool has_mb = extractIntegerField(req.data_json, "max_mb", mb);
+            if (hours < 0 || mb < 0)
+            {
+                resp.message = "Retention values must be non-negative (0 - unlimited)";
+                return resp;
+            }
+            if (has_hours || has_mb)
+            {
+                // слишком большие значения база ограничивает - показываем действующие
+                db.setRetention(hours, mb);
+                hours = db.retentionHours();
+                mb = db.retentionMb();
+            }
+
+            resp.status = "success";
+            resp.message = "Retention: max_age_hours=" + std::to_string(hours) +
+                           ", max_mb=" + std::to_string(mb);
+            resp.data = "[{\"max_age_hours\":" + std::to_string(hours) +
+                        ",\"max_mb\":" + std::to_string(mb) + "}]";
+            resp.count = db.segmentCount();
+            return resp;
+        }
+
+        if (req.operation == "aggregate")
+        {
+            // query - отбор документов, data - {"groupBy": [...], "fields": {...}}
+            std::string error;
+            size_t groups = 0;
+            if (!db.aggregate(req.query_json, req.data_json, resp.data, groups, error))
+            {
+                resp.message = error;
+                return resp;
+            }
+
+            resp.status = "success";
+            resp.message = "Groups " + std::to_string(groups);
+            resp.count = groups;
+            return resp;
+        }
+
+        if (req.operation == "histogram")
+        {
+            // query - фильтр, data - {"from", "to", "bucket", "field", "splitBy"}
+            std::string error;
+            size_t buckets = 0;
+            if (!db.histogram(req.query_json, req.data_json, resp.data, buckets, error))
+            {
+                resp.message = error;
+                return resp;
+            }
+
+            resp.status = "success";
+            resp.message = "Buckets " + std::to_string(buckets);
+            resp.count = buckets;
+            return resp;
+        }
+
+        if (req.operation == "topk")
+        {
+            // query - фильтр, data - {"field", "k", "mode", "capacity"}
+            std::string error;
+            size_t rows = 0;
+            bool exact = true;
+            if (!db.topk(req.query_json, req.data_json, resp.data, rows, exact, error))
+            {
+                resp.message = error;
+                return resp;
+            }
+
+            resp.status = "success";
+            resp.message = "Top " + std::to_string(rows) + (exact ? " (exact)" : " (approximate)");
+            resp.count = rows;
+            return resp;
+        }
+
+        if (req.operation == "approxDistinct")
+        {
+            // data - {"field", "from", "to", "bySegment"}; по нескольким базам - в db_server
+            DistinctSpec spec;
+            std::string error;
+            if (!DistinctSpec::parse(req.data_json, spec, error))
+            {
+                resp.message = error;
+                return resp;
+            }
+
+            size_t rows = 0;
+            std::vector<HyperLogLog> merged;
+            db.approxDistinct(spec, resp.data, rows, merged);
+
+            resp.status = "success";
+            resp.message = "Estimated distinct values (HyperLogLog)";
+            resp.count = rows;
+            return resp;
+        }
+
+        if (req.operation == "createView")
+        {
+            // query - отбор документов, data - {"name", "groupBy", "bucket", "field", "fields"}
+            std::string error;
+            size_t groups = 0;
+            if (!db.createView(req.query_json, req.data_json, groups, error))
+            {
+                resp.message = error;
+                return resp;
+            }
+            db.viewsToJson(resp.data);
+
+            resp.status = "success";
+            resp.message = "View created, groups " + std::to_string(groups);
+            resp.count = groups;
+            return resp;
+        }
+
+        if (req.operation == "dropView")
+        {
+            std::string name;
+            if (!extractStringField(req.data_json, "name", name) || name.empty())
+            {
+                resp.message = "dropView requires data {\"name\": \"view\"}";
+                return resp;
+            }
+            if (!db.dropView(name))
+            {
+                resp.message = "View not found: " + name;
+                return resp;
+            }
+            db.viewsToJson(resp.data);
+
+            resp.status = "success";
+            resp.message = "View dropped: " + name;
+            return resp;
+        }
+
+        if (req.operation == "view")
+        {
+            // data - {"name", "from", "to"}; без данных - список представлений
+            std::string data = trim(req.data_json);
+            if (data.empty() || data == "[]" || data == "{}")
+            {
+                db.viewsToJson(resp.data);
+                resp.status = "success";
+                resp.message = "Views";
+                return resp;
+            }
+
+            std::string error;
+            size_t rows = 0;
+            if (!db.readView(data, resp.data, rows, error))
+            {
+                resp.message = error;
+                return resp;
+            }
+
+            resp.status = "success";
+            resp.message = "Rows " + std::to_string(rows);
+            resp.count = rows;
+            return resp;
+        }
+
+        if (req.operation == "createIndex")
+        {
+            std::string field;
+            if (!extractStringField(req.data_json, "field", field) || field.empty())
+            {
+                resp.message = "createIndex requires data {\"field\": \"name\"}";
+                return resp;
+            }
+
+            // "type": "hash" (по умолчанию) или "ordered"
+            std::string type = "hash";
+            extractStringField(req.data_json, "type", type);
+            if (type != "hash" && type != "ordered")
+            {
+                resp.message = "Unknown index type: " + type + " (use hash or ordered)";
+                return resp;
+            }
+
+            size_t indexed = 0;
+            bool created = db.createIndex(field, type == "ordered", indexed);
+            db.indexesToJson(resp.data);
+
+            resp.status = "success";
+            resp.message = (created ? "Index created on " : "Index already exists on ") + field + " (" + type + ")";
+            resp.count = indexed;
+            return resp;
+        }
+
         resp.message = "Unknown operation: " + req.operation;
         return resp;
     }